@@ -0,0 +1,139 @@
+#include "json-parser.h"
+#include <stdlib.h>
+
+#define ARENA_ALIGNMENT 8
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+static size_t alignSize(size_t size)
+{
+  return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+static JsonArenaBlock* createArenaBlock(size_t size)
+{
+  // The block header is followed by its data in the same allocation
+  JsonArenaBlock* block = (JsonArenaBlock*)malloc(alignSize(sizeof(JsonArenaBlock)) + size);
+  if (block == NULL)
+    return NULL;
+
+  block->next = NULL;
+  block->data = (char*)block + alignSize(sizeof(JsonArenaBlock));
+  block->size = size;
+  block->used = 0;
+  return block;
+}
+
+JsonArena* createJsonArena(size_t blockSize)
+{
+  JsonArena* arena = (JsonArena*)malloc(sizeof(JsonArena));
+  arena->blocks = NULL;
+  arena->blockSize = blockSize > 0 ? alignSize(blockSize) : ARENA_DEFAULT_BLOCK_SIZE;
+  arena->allocated = 0;
+  return arena;
+}
+
+void deleteJsonArena(JsonArena* arena)
+{
+  if (arena == NULL)
+    return;
+
+  JsonArenaBlock* block = arena->blocks;
+  while (block != NULL)
+  {
+    JsonArenaBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+
+  free(arena);
+}
+
+void* arenaAlloc(JsonArena* arena, size_t size)
+{
+  size = alignSize(size);
+  arena->allocated += size;
+
+  JsonArenaBlock* block = arena->blocks;
+  if (block != NULL && block->size - block->used >= size)
+  {
+    void* ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+  }
+
+  // Big allocations get a block of their own, kept behind the current one so
+  // that the free space left in the current block is not thrown away
+  if (size > arena->blockSize / 4 && block != NULL)
+  {
+    JsonArenaBlock* bigBlock = createArenaBlock(size);
+    if (bigBlock == NULL)
+      return NULL;
+
+    bigBlock->used = size;
+    bigBlock->next = block->next;
+    block->next = bigBlock;
+    return bigBlock->data;
+  }
+
+  JsonArenaBlock* newBlock = createArenaBlock(size > arena->blockSize ? size : arena->blockSize);
+  if (newBlock == NULL)
+    return NULL;
+
+  newBlock->used = size;
+  newBlock->next = block;
+  arena->blocks = newBlock;
+  return newBlock->data;
+}
+
+void resetJsonArena(JsonArena* arena, size_t maxSize)
+{
+  JsonArenaBlock* block = arena->blocks;
+  size_t used = arena->allocated;
+  arena->allocated = 0;
+
+  if (block != NULL && block->next == NULL && block->size <= maxSize)
+  {
+    block->used = 0;
+    return;
+  }
+
+  while (block != NULL)
+  {
+    JsonArenaBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+  arena->blocks = NULL;
+
+  // The next content is likely as big as the last one, a single block of
+  // that size holds it without growing the arena
+  size_t size = used > arena->blockSize ? used : arena->blockSize;
+  if (used > 0 && size <= maxSize)
+    arena->blocks = createArenaBlock(size);
+}
+
+void mergeJsonArena(JsonArena* arena, JsonArena* source)
+{
+  // The blocks of source go behind the current block of arena, so that the
+  // free space left in the current block is still used
+  if (source->blocks != NULL)
+  {
+    JsonArenaBlock* last = source->blocks;
+    while (last->next != NULL)
+      last = last->next;
+
+    if (arena->blocks == NULL)
+    {
+      arena->blocks = source->blocks;
+    }
+    else
+    {
+      last->next = arena->blocks->next;
+      arena->blocks->next = source->blocks;
+    }
+  }
+
+  arena->allocated += source->allocated;
+  source->blocks = NULL;
+  deleteJsonArena(source);
+}
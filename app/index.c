@@ -0,0 +1,140 @@
+#include "json-parser.h"
+#include <stdlib.h>
+#include <string.h>
+
+uint32_t jsonHashKey(const char* key, size_t length)
+{
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++)
+  {
+    hash ^= (unsigned char)key[i];
+    hash *= 16777619u;
+  }
+
+  // 0 marks a hash that has not been computed yet
+  return hash != 0 ? hash : 1;
+}
+
+static bool keyEquals(const char* nodeKey, const char* key, size_t length)
+{
+  if (nodeKey == NULL)
+    return false;
+
+  // Interned keys are found by address
+  if (nodeKey == key)
+    return nodeKey[length] == '\0';
+
+  // Keys are short, a plain loop beats a call to strncmp. It stops at the
+  // end of nodeKey, which may be shorter than key
+  for (size_t i = 0; i < length; i++)
+    if (nodeKey[i] != key[i] || nodeKey[i] == '\0')
+      return false;
+  return nodeKey[length] == '\0';
+}
+
+bool buildJsonObjectIndex(JsonNode* node, JsonArena* arena)
+{
+  if (node == NULL || node->type != OBJECT_NODE)
+    return false;
+  if (node->index != NULL)
+    return true;
+  if (node->vSize >= UINT32_MAX)
+    return false;
+
+  // At most half full, so that probe sequences stay short
+  size_t capacity = 1;
+  while (capacity < node->vSize * 2)
+    capacity <<= 1;
+
+  size_t bytes = sizeof(JsonObjectIndex) + capacity * sizeof(JsonIndexEntry);
+  JsonObjectIndex* index = (JsonObjectIndex*)(arena != NULL ? arenaAlloc(arena, bytes) : malloc(bytes));
+  if (index == NULL)
+    return false;
+
+  index->mask = capacity - 1;
+  index->entries = (JsonIndexEntry*)(index + 1);
+  memset(index->entries, 0, capacity * sizeof(JsonIndexEntry));
+
+  for (size_t i = 0; i < node->vSize; i++)
+  {
+    JsonNode* child = &node->value.v_object[i];
+    if (child->key == NULL)
+      continue;
+    if (child->keyHash == 0)
+      child->keyHash = jsonHashKey(child->key, strlen(child->key));
+
+    size_t slot = child->keyHash & index->mask;
+    bool duplicate = false;
+    while (index->entries[slot].position != 0)
+    {
+      JsonIndexEntry* entry = &index->entries[slot];
+      const char* key = node->value.v_object[entry->position - 1].key;
+      if (entry->hash == child->keyHash && (key == child->key || strcmp(key, child->key) == 0))
+      {
+        duplicate = true;
+        break;
+      }
+      slot = (slot + 1) & index->mask;
+    }
+
+    if (!duplicate)
+    {
+      index->entries[slot].hash = child->keyHash;
+      index->entries[slot].position = (uint32_t)(i + 1);
+    }
+  }
+
+  node->index = index;
+  return true;
+}
+
+void dropJsonObjectIndex(JsonNode* node)
+{
+  if (node == NULL || node->type != OBJECT_NODE || node->index == NULL)
+    return;
+
+  // An index allocated in an arena is released together with the arena
+  if (!node->inArena)
+    free(node->index);
+  node->index = NULL;
+}
+
+JsonNode* jsonObjectGet(JsonNode* node, const char* key, size_t length)
+{
+  return jsonObjectGetHashed(node, key, length, jsonHashKey(key, length));
+}
+
+JsonNode* jsonObjectGetHashed(JsonNode* node, const char* key, size_t length, uint32_t hash)
+{
+  if (node == NULL || node->type != OBJECT_NODE)
+    return NULL;
+
+  // Nobody would free an index allocated with malloc for an arena node
+  if (node->index == NULL && node->vSize >= JSON_INDEX_MIN_SIZE && !node->inArena)
+    buildJsonObjectIndex(node, NULL);
+
+  if (node->index == NULL)
+  {
+    for (size_t i = 0; i < node->vSize; i++)
+    {
+      JsonNode* child = &node->value.v_object[i];
+      if ((child->keyHash == 0 || child->keyHash == hash) && keyEquals(child->key, key, length))
+        return child;
+    }
+    return NULL;
+  }
+
+  JsonObjectIndex* index = node->index;
+  size_t slot = hash & index->mask;
+
+  while (index->entries[slot].position != 0)
+  {
+    JsonIndexEntry* entry = &index->entries[slot];
+    JsonNode* child = &node->value.v_object[entry->position - 1];
+    if (entry->hash == hash && keyEquals(child->key, key, length))
+      return child;
+    slot = (slot + 1) & index->mask;
+  }
+
+  return NULL;
+}
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
 /**
@@ -35,6 +36,7 @@ typedef enum TokenType
 typedef struct Token
 {
   TokenType type;   /**< Tipo di token */
+  uint32_t hash;    /**< Hash del contenuto delle stringhe, 0 se non calcolato */
   size_t startPos;  /**< Posizione iniziale del token nel file */
   size_t endPos;    /**< Posizione finale del token nel file */
   size_t lineCount; /**< Numero di linea per il rilevamento degli errori */
@@ -47,10 +49,12 @@ typedef struct Token
  */
 typedef struct TokenManager
 {
-  Token* tokens;   /**< Array di token */
-  size_t capacity; /**< Capacità massima dell'array */
-  size_t size;     /**< Numero attuale di token */
-  size_t pos;      /**< Posizione corrente per la scansione */
+  Token* tokens;        /**< Array di token */
+  size_t capacity;      /**< Capacità massima dell'array */
+  size_t size;          /**< Numero attuale di token */
+  size_t pos;           /**< Posizione corrente per la scansione */
+  struct Lexer* lexer;  /**< Lexer da cui leggere i token su richiesta, NULL se già tutti presenti */
+  struct TokenPipeline* pipeline; /**< Thread lexer da cui ricevere i token, NULL se non usato */
 } TokenManager;
 
 /**
@@ -65,6 +69,56 @@ TokenManager* createTokenManager();
  */
 void deleteTokenManager(TokenManager* manager);
 
+/**
+ * @brief Crea un TokenManager che legge i token dal lexer solo quando servono.
+ *
+ * I token non vengono memorizzati tutti: `tokens` è un buffer circolare che
+ * conserva soltanto gli ultimi token letti, per cui la memoria usata non
+ * dipende dalla dimensione del JSON.
+ *
+ * @param lexer Puntatore al lexer da cui leggere i token.
+ * @return Puntatore alla struttura TokenManager allocata.
+ */
+TokenManager* createTokenStream(struct Lexer* lexer);
+
+/**
+ * @brief Crea un TokenManager che riceve i token da un thread lexer dedicato.
+ *
+ * Il lexer viene eseguito su un altro thread e scrive i token in un buffer
+ * circolare senza lock, con un solo produttore e un solo consumatore: può
+ * precedere il parser al massimo di `capacity` token, per cui la scansione
+ * dell'input si sovrappone alla costruzione dell'albero e la memoria usata
+ * per i token non dipende dalla dimensione del JSON. Come in
+ * `createTokenStream`, `tokens` conserva soltanto gli ultimi token letti.
+ *
+ * @param lexer Puntatore al lexer da cui leggere i token.
+ * @param capacity Token che il lexer può produrre in anticipo, arrotondati
+ *                 alla potenza di 2 successiva.
+ * @return Puntatore alla struttura TokenManager allocata, o NULL se il thread
+ *         non può essere avviato.
+ * @warning Il lexer appartiene al thread finché `advance` non restituisce
+ *          NULL: solo allora se ne può leggere l'errore. `clearLexer` va
+ *          chiamata dopo `deleteTokenManager`, che ferma il thread.
+ */
+TokenManager* createTokenPipeline(struct Lexer* lexer, size_t capacity);
+
+/**
+ * @brief Riceve il prossimo token prodotto dal thread lexer.
+ * @param pipeline Puntatore al buffer condiviso con il thread.
+ * @param token Puntatore al token da riempire.
+ * @return `true` se è stato ricevuto un token, `false` se il lexer ha finito.
+ */
+bool nextPipelineToken(struct TokenPipeline* pipeline, Token* token);
+
+/**
+ * @brief Ferma il thread lexer e dealloca il buffer condiviso.
+ *
+ * Viene chiamata da `deleteTokenManager`.
+ *
+ * @param pipeline Puntatore al buffer condiviso con il thread.
+ */
+void deleteTokenPipeline(struct TokenPipeline* pipeline);
+
 /**
  * @brief Crea un nuovo token e lo aggiunge al TokenManager.
  * @param manager Puntatore alla struttura TokenManager.
@@ -99,12 +153,219 @@ typedef struct LexError
 } LexError;
 
 /**
- * @brief Esegue l'analisi lessicale su un file JSON.
- * @param jsonFile Puntatore al file JSON da analizzare.
+ * @struct StructuralIndex
+ * @brief Indice delle posizioni in cui inizia ogni token del JSON.
+ *
+ * Viene costruito a blocchi da 64 byte classificando i caratteri con
+ * istruzioni SIMD (AVX2 o SSE2, con un'implementazione scalare di riserva).
+ * Contiene le posizioni dei caratteri strutturali fuori dalle stringhe, di
+ * tutti i doppi apici non preceduti da escape (di apertura e di chiusura) e
+ * del primo carattere di ogni numero o literal.
+ */
+typedef struct StructuralIndex
+{
+  size_t* offsets;   /**< Posizioni trovate, in ordine crescente */
+  size_t capacity;   /**< Capacità massima dell'array */
+  size_t size;       /**< Numero attuale di posizioni */
+  size_t scanned;    /**< Numero di byte già indicizzati */
+  uint64_t inString; /**< Tutti i bit a 1 se l'ultimo blocco termina dentro una stringa */
+  uint64_t escaped;  /**< 1 se il primo carattere del blocco successivo è preceduto da escape */
+  uint64_t inScalar; /**< 1 se l'ultimo blocco termina dentro un numero o literal */
+} StructuralIndex;
+
+/**
+ * @brief Crea e inizializza un nuovo StructuralIndex vuoto.
+ * @return Puntatore alla struttura StructuralIndex allocata.
+ */
+StructuralIndex* createStructuralIndex();
+
+/**
+ * @brief Dealloca la memoria utilizzata da uno StructuralIndex.
+ * @param index Puntatore allo StructuralIndex da eliminare.
+ */
+void deleteStructuralIndex(StructuralIndex* index);
+
+/**
+ * @brief Svuota uno StructuralIndex per un nuovo contenuto, conservando
+ *        l'array delle posizioni.
+ * @param index Puntatore allo StructuralIndex da svuotare.
+ */
+void resetStructuralIndex(StructuralIndex* index);
+
+/**
+ * @brief Indicizza i prossimi byte del contenuto JSON.
+ *
+ * Riprende dal punto in cui si era fermata la chiamata precedente e aggiunge
+ * le nuove posizioni in coda all'indice. Lo stato tra un blocco e l'altro
+ * (stringhe ed escape aperti) viene conservato nell'indice.
+ *
+ * @param index Puntatore all'indice da estendere.
+ * @param json Puntatore al contenuto JSON.
+ * @param length Numero di byte del contenuto JSON.
+ * @param maxBytes Numero massimo (arrotondato a blocchi da 64) di byte da indicizzare.
+ */
+void indexStructurals(StructuralIndex* index, const char* json, size_t length, size_t maxBytes);
+
+/**
+ * @struct Lexer
+ * @brief Stato dell'analisi lessicale incrementale, un token alla volta.
+ */
+typedef struct Lexer
+{
+  const char* json;        /**< Contenuto JSON da analizzare */
+  size_t length;           /**< Numero di byte del contenuto JSON */
+  StructuralIndex* index;  /**< Indice del blocco di input corrente */
+  size_t next;             /**< Prossima posizione dell'indice da consumare */
+  size_t pos;              /**< Primo byte non ancora consumato */
+  size_t lineCount;        /**< Numero di linea corrente */
+  size_t charCount;        /**< Numero di carattere corrente */
+  bool afterScalar;        /**< Indica se l'ultimo token era un numero o literal */
+  bool finished;           /**< Indica se l'input è terminato */
+  bool hashStrings;        /**< Calcola l'hash del contenuto dei token stringa */
+  struct ParseStats* stats; /**< Statistiche in cui contare i token, NULL se non richieste */
+  LexError error;          /**< Errore lessicale rilevato */
+} Lexer;
+
+/**
+ * @brief Inizializza un Lexer sul contenuto JSON indicato.
+ * @param lexer Puntatore al lexer da inizializzare.
+ * @param json Puntatore al contenuto JSON da analizzare.
+ * @param length Numero di byte del contenuto JSON.
+ */
+void initLexer(Lexer* lexer, const char* json, size_t length);
+
+/**
+ * @brief Libera la memoria utilizzata da un Lexer.
+ * @param lexer Puntatore al lexer da ripulire.
+ */
+void clearLexer(Lexer* lexer);
+
+/**
+ * @brief Prepara un Lexer già inizializzato per un nuovo contenuto,
+ *        riutilizzando il suo indice strutturale.
+ * @param lexer Puntatore al lexer da reimpostare.
+ * @param json Puntatore al contenuto JSON da analizzare.
+ * @param length Numero di byte del contenuto JSON.
+ */
+void resetLexer(Lexer* lexer, const char* json, size_t length);
+
+/**
+ * @brief Legge il prossimo token.
+ *
+ * L'input viene indicizzato a blocchi man mano che serve, per cui la
+ * memoria usata dal lexer non dipende dalla dimensione del JSON.
+ *
+ * @param lexer Puntatore al lexer.
+ * @param token Puntatore al token da riempire.
+ * @return `true` se è stato letto un token, `false` a fine input o in caso
+ *         di errore (riportato in `lexer->error`).
+ */
+bool lexNextToken(Lexer* lexer, Token* token);
+
+/**
+ * @brief Legge tutti i token rimanenti di un Lexer.
+ * @param lexer Puntatore al lexer, già inizializzato.
+ * @param error Puntatore alla struttura di errore lessicale.
+ * @return Puntatore alla struttura TokenManager contenente i token letti.
+ */
+TokenManager* lexTokens(Lexer* lexer, LexError* error);
+
+/**
+ * @brief Come `lexTokens`, ma aggiunge i token a un TokenManager esistente.
+ * @param lexer Puntatore al lexer, già inizializzato.
+ * @param manager Puntatore al TokenManager in cui aggiungere i token.
+ * @param error Puntatore alla struttura di errore lessicale.
+ */
+void lexTokensInto(Lexer* lexer, TokenManager* manager, LexError* error);
+
+/**
+ * @brief Esegue l'analisi lessicale su un contenuto JSON in memoria.
+ * @param json Puntatore al contenuto JSON da analizzare.
+ * @param length Numero di byte del contenuto JSON.
  * @param error Puntatore alla struttura di errore lessicale.
  * @return Puntatore a un TokenManager contenente i token rilevati.
  */
-TokenManager* lex(FILE* jsonFile, LexError* error);
+TokenManager* lex(const char* json, size_t length, LexError* error);
+
+/**
+ * ALLOCAZIONE
+ */
+
+/**
+ * @struct JsonArenaBlock
+ * @brief Blocco di memoria contiguo gestito da una JsonArena.
+ */
+typedef struct JsonArenaBlock
+{
+  struct JsonArenaBlock* next; /**< Blocco precedente nella lista */
+  char* data;                  /**< Inizio dell'area utilizzabile */
+  size_t size;                 /**< Dimensione dell'area utilizzabile */
+  size_t used;                 /**< Byte già assegnati */
+} JsonArenaBlock;
+
+/**
+ * @struct JsonArena
+ * @brief Allocatore a incremento (bump allocator) per nodi e stringhe.
+ *
+ * Le allocazioni vengono ricavate in sequenza da blocchi di grandi
+ * dimensioni e non possono essere liberate singolarmente: tutta la memoria
+ * viene rilasciata insieme eliminando l'arena.
+ */
+typedef struct JsonArena
+{
+  JsonArenaBlock* blocks; /**< Lista dei blocchi, il primo è quello corrente */
+  size_t blockSize;       /**< Dimensione dei nuovi blocchi */
+  size_t allocated;       /**< Byte assegnati in totale */
+} JsonArena;
+
+/**
+ * @brief Crea una nuova JsonArena vuota.
+ * @param blockSize Dimensione dei blocchi da allocare, 0 per quella predefinita (64 KiB).
+ * @return Puntatore alla JsonArena allocata.
+ */
+JsonArena* createJsonArena(size_t blockSize);
+
+/**
+ * @brief Dealloca una JsonArena e tutta la memoria assegnata da essa.
+ * @param arena Puntatore alla JsonArena da eliminare.
+ */
+void deleteJsonArena(JsonArena* arena);
+
+/**
+ * @brief Assegna un'area di memoria dall'arena.
+ * @param arena Puntatore alla JsonArena.
+ * @param size Numero di byte richiesti.
+ * @return Puntatore all'area assegnata (allineata a 8 byte), o NULL se
+ *         l'allocazione fallisce.
+ */
+void* arenaAlloc(JsonArena* arena, size_t size);
+
+/**
+ * @brief Trasferisce in un'arena tutta la memoria di un'altra.
+ *
+ * I blocchi di `source` vengono accodati a quelli di `arena` senza copie,
+ * quindi i puntatori assegnati da `source` restano validi e vengono
+ * rilasciati insieme ad `arena`.
+ *
+ * @param arena Puntatore alla JsonArena che riceve i blocchi.
+ * @param source Puntatore alla JsonArena da svuotare, viene eliminata.
+ */
+void mergeJsonArena(JsonArena* arena, JsonArena* source);
+
+/**
+ * @brief Rilascia tutte le assegnazioni di un'arena per riutilizzarla.
+ *
+ * Se tutto è stato assegnato da un unico blocco, il blocco viene solo
+ * svuotato. Altrimenti i blocchi vengono sostituiti da uno solo grande
+ * quanto la memoria assegnata, così che un contenuto simile al precedente
+ * non richieda altre allocazioni.
+ *
+ * @param arena Puntatore alla JsonArena da svuotare.
+ * @param maxSize Numero massimo di byte da tenere allocati: i blocchi più
+ *                grandi vengono liberati.
+ * @warning Tutti i puntatori assegnati in precedenza diventano non validi.
+ */
+void resetJsonArena(JsonArena* arena, size_t maxSize);
 
 /**
  * ANALISI SINTATTICA
@@ -116,13 +377,15 @@ TokenManager* lex(FILE* jsonFile, LexError* error);
  */
 typedef enum JsonNodeType
 {
-  NULL_NODE = 0, /**< Nodo null */
-  OBJECT_NODE,   /**< Nodo oggetto */
-  ARRAY_NODE,    /**< Nodo array */
-  STRING_NODE,   /**< Nodo stringa */
-  INTEGER_NODE,  /**< Nodo numero intero */
-  DOUBLE_NODE,   /**< Nodo numero decimale */
-  BOOLEAN_NODE   /**< Nodo booleano */
+  NULL_NODE = 0,      /**< Nodo null */
+  OBJECT_NODE,        /**< Nodo oggetto */
+  ARRAY_NODE,         /**< Nodo array */
+  STRING_NODE,        /**< Nodo stringa */
+  INTEGER_NODE,       /**< Nodo numero intero */
+  DOUBLE_NODE,        /**< Nodo numero decimale */
+  BOOLEAN_NODE,       /**< Nodo booleano */
+  INTEGER_ARRAY_NODE, /**< Array di soli interi, compatto (vedi `jsonNodeIntegers`) */
+  DOUBLE_ARRAY_NODE   /**< Array di soli decimali, compatto (vedi `jsonNodeDoubles`) */
 } JsonNodeType;
 
 /**
@@ -134,25 +397,60 @@ typedef union JsonValue
   struct JsonNode* v_object; /**< Puntatore a un oggetto JSON */
   struct JsonNode* v_array;  /**< Puntatore a un array JSON */
   char* v_string;            /**< Valore stringa */
-  int v_int;                 /**< Valore intero */
+  int64_t v_int;             /**< Valore intero */
   double v_double;           /**< Valore decimale */
   bool v_bool;               /**< Valore booleano */
+  int64_t* v_integers;       /**< Elementi di un array compatto di interi */
+  double* v_doubles;         /**< Elementi di un array compatto di decimali */
 } JsonValue;
 
+/**
+ * Byte disponibili nel nodo per una stringa corta, terminatore compreso:
+ * le stringhe più brevi non richiedono un'allocazione separata.
+ */
+#define JSON_INLINE_STRING_SIZE 16
+
 /**
  * @struct JsonNode
  * @brief Nodo nell'albero JSON.
+ *
+ * Occupa 40 byte: tipo e flag sono campi di bit, dimensione e capacità sono
+ * a 32 bit (al massimo `UINT32_MAX` figli per contenitore) e una stringa
+ * di meno di `JSON_INLINE_STRING_SIZE` byte è memorizzata al posto di
+ * `value` e `index`. Il valore di un nodo stringa va quindi letto con
+ * `jsonNodeString`.
  */
 typedef struct JsonNode
 {
-  JsonNodeType type; /**< Tipo di nodo */
-  char* key;         /**< Chiave JSON (per oggetti) */
-  JsonValue value;   /**< Valore del nodo */
-  bool isRoot;       /**< Indica se il nodo è la radice */
-  size_t vCapacity;  /**< Capacità dinamica per array/oggetto */
-  size_t vSize;      /**< Dimensione attuale */
+  char* key; /**< Chiave JSON (per oggetti) */
+  union
+  {
+    struct
+    {
+      JsonValue value;               /**< Valore del nodo */
+      struct JsonObjectIndex* index; /**< Indice delle chiavi (per oggetti), NULL se assente */
+    };
+    char inlineString[JSON_INLINE_STRING_SIZE]; /**< Stringa corta, se `stringInline` */
+  };
+  uint32_t keyHash;      /**< Hash della chiave, 0 se non ancora calcolato */
+  uint32_t vSize;        /**< Dimensione attuale */
+  uint32_t vCapacity;    /**< Capacità allocata per i figli (per oggetti e array) */
+  JsonNodeType type : 8; /**< Tipo di nodo */
+  bool isRoot : 1;       /**< Indica se il nodo è la radice */
+  bool inArena : 1;      /**< Indica se il nodo è allocato in un'arena */
+  bool keyInterned : 1;  /**< Indica se la chiave appartiene a una JsonKeyTable */
+  bool stringInline : 1; /**< Indica se la stringa è in `inlineString` invece che in `value` */
+  bool keyInSitu : 1;    /**< Indica se la chiave punta nel buffer analizzato in-situ */
+  bool stringInSitu : 1; /**< Indica se la stringa punta nel buffer analizzato in-situ */
 } JsonNode;
 
+/**
+ * @brief Inizializza i campi di un nodo JSON già allocato.
+ * @param node Puntatore al nodo da inizializzare.
+ * @param type Tipo del nodo.
+ */
+void initJsonNode(JsonNode* node, JsonNodeType type);
+
 /**
  * @brief Crea un nuovo nodo JSON.
  * @param type Tipo di nodo da creare.
@@ -160,6 +458,57 @@ typedef struct JsonNode
  */
 JsonNode* createJsonNode(JsonNodeType type);
 
+/**
+ * @brief Restituisce il valore di un nodo stringa.
+ * @param node Puntatore al nodo stringa.
+ * @return Puntatore alla stringa terminata da '\0', interna al nodo se corta.
+ */
+const char* jsonNodeString(const JsonNode* node);
+
+/**
+ * @brief Restituisce gli elementi di un array compatto di interi.
+ *
+ * Gli `vSize` valori sono contigui e possono essere passati direttamente
+ * a codice vettoriale.
+ *
+ * @param node Puntatore al nodo.
+ * @return Puntatore al primo elemento, NULL se il nodo non è un
+ *         `INTEGER_ARRAY_NODE` o è vuoto.
+ */
+const int64_t* jsonNodeIntegers(const JsonNode* node);
+
+/**
+ * @brief Restituisce gli elementi di un array compatto di decimali.
+ * @param node Puntatore al nodo.
+ * @return Puntatore al primo dei `vSize` elementi contigui, NULL se il nodo
+ *         non è un `DOUBLE_ARRAY_NODE` o è vuoto.
+ */
+const double* jsonNodeDoubles(const JsonNode* node);
+
+/**
+ * @brief Imposta il valore di un nodo stringa copiandolo.
+ *
+ * Le stringhe corte vengono copiate nel nodo, le altre in memoria allocata
+ * con malloc.
+ *
+ * @param node Puntatore al nodo stringa.
+ * @param str Puntatore ai byte della stringa.
+ * @param length Numero di byte della stringa.
+ */
+void setJsonNodeString(JsonNode* node, const char* str, size_t length);
+
+/**
+ * @brief Assicura che un contenitore abbia spazio per `size` figli.
+ *
+ * I figli stanno per cambiare, per cui l'indice delle chiavi di un oggetto
+ * viene eliminato con `dropJsonObjectIndex`.
+ *
+ * @param node Puntatore al nodo oggetto o array.
+ * @param size Numero di figli richiesto.
+ * @return Puntatore ai figli, eventualmente spostati.
+ */
+JsonNode* reserveJsonChildren(JsonNode* node, size_t size);
+
 /**
  * @enum ParserErrorType
  * @brief Tipi di errori sintattici nel parsing JSON.
@@ -175,7 +524,11 @@ typedef enum ParserErrorType
   EXPECTED_END_OF_ARRAY_BRACE,  /**< Attesa parentesi quadra chiusa */
   EXPECTED_COLON,               /**< Attesi due punti */
   EXPECTED_COMMA,               /**< Attesa virgola */
-  UNEXPECTED_TOKEN              /**< Token inatteso */
+  UNEXPECTED_TOKEN,             /**< Token inatteso */
+  INVALID_ESCAPE_SEQUENCE,      /**< Sequenza di escape non valida in una stringa */
+  UNESCAPED_CONTROL_CHARACTER,  /**< Carattere di controllo non preceduto da escape */
+  INVALID_UTF8_SEQUENCE,        /**< Sequenza UTF-8 non valida in una stringa */
+  PARSING_ABORTED               /**< Analisi interrotta da un callback */
 } ParserErrorType;
 
 /**
@@ -188,6 +541,57 @@ typedef struct ParserError
   Token token;          /**< Token coinvolto nell'errore */
 } ParserError;
 
+/**
+ * @struct ParseContext
+ * @brief Stato condiviso dalle funzioni di parsing durante l'analisi.
+ */
+typedef struct ParseContext
+{
+  const char* json;                        /**< Contenuto JSON analizzato da `lex` */
+  TokenManager* manager;                   /**< Token da analizzare */
+  JsonArena* arena;                        /**< Arena per nodi e stringhe, NULL per usare malloc */
+  JsonNode* freeNodes;                     /**< Nodi temporanei riutilizzabili */
+  JsonNode* stack;                         /**< Figli dei contenitori in costruzione */
+  size_t stackCapacity;                    /**< Capacità massima della pila */
+  size_t stackSize;                        /**< Numero attuale di figli nella pila */
+  bool indexObjects;                       /**< Costruisce l'indice delle chiavi alla chiusura degli oggetti */
+  struct ParseStats* stats;                /**< Statistiche da aggiornare, NULL se non richieste */
+  size_t depth;                            /**< Contenitori aperti, aggiornato solo con `stats` */
+  struct JsonKeyTable* keys;               /**< Tabella in cui internare le chiavi, NULL per copiarle */
+  char* scratch;                           /**< Buffer per decodificare le chiavi da internare o confrontare */
+  size_t scratchCapacity;                  /**< Capacità del buffer `scratch` */
+  const struct JsonProjection* projection; /**< Percorsi da tenere, NULL per tenere tutto */
+  size_t projectionNode;                   /**< Passo della proiezione del contenitore corrente */
+  char* inSitu;                            /**< Buffer in cui decodificare le stringhe, NULL per copiarle */
+  bool packNumbers;                        /**< Memorizza gli array di numeri dello stesso tipo come array compatti */
+  JsonValue* numbers;                      /**< Numeri letti dall'array che si sta compattando */
+  size_t numbersCapacity;                  /**< Capacità del buffer `numbers` */
+} ParseContext;
+
+/**
+ * @brief Inizializza un ParseContext.
+ * @param context Puntatore al contesto da inizializzare.
+ * @param json Puntatore al contenuto JSON analizzato da `lex`.
+ * @param manager Puntatore alla struttura di gestione token.
+ * @param arena Arena in cui allocare l'albero, o NULL per usare malloc.
+ */
+void initParseContext(ParseContext* context, const char* json, TokenManager* manager, JsonArena* arena);
+
+/**
+ * @brief Prepara un ParseContext già usato per un nuovo contenuto.
+ *
+ * Come `initParseContext`, ma conserva la pila dei figli e il buffer
+ * `scratch`. I nodi liberi vengono conservati solo se né il contesto né
+ * il nuovo contenuto usano un'arena.
+ */
+void resetParseContext(ParseContext* context, const char* json, TokenManager* manager, JsonArena* arena);
+
+/**
+ * @brief Libera la memoria temporanea di un ParseContext.
+ * @param context Puntatore al contesto da ripulire.
+ */
+void clearParseContext(ParseContext* context);
+
 /**
  * @brief Avanza al prossimo token nella gestione dei token.
  * @param manager Puntatore alla struttura di gestione token.
@@ -195,6 +599,19 @@ typedef struct ParserError
  */
 Token* advance(TokenManager* manager);
 
+/**
+ * @brief Restituisce l'ultimo token letto con `advance`.
+ *
+ * Funziona con tutti i tipi di TokenManager, anche quando `tokens` è un
+ * buffer circolare. Serve a riportare la posizione degli errori quando
+ * l'input finisce dove era atteso un token.
+ *
+ * @param manager Puntatore alla struttura di gestione token.
+ * @return Puntatore all'ultimo token letto, o NULL se non ne è stato letto
+ *         nessuno.
+ */
+Token* previousToken(const TokenManager* manager);
+
 /**
  * @brief Aggiunge una coppia chiave-valore a un nodo oggetto JSON.
  * @param node Puntatore al nodo oggetto JSON.
@@ -211,47 +628,61 @@ void addElement(JsonNode* node, JsonNode* elemNode);
 
 /**
  * @brief Effettua il parsing di un oggetto JSON.
- * @param jsonFile Puntatore al file JSON.
- * @param manager Puntatore alla struttura di gestione token.
+ * @param context Puntatore al contesto di parsing.
  * @param error Puntatore alla struttura di errore.
  * @return Puntatore al nodo JSON risultante.
  */
-JsonNode* parseObject(FILE* jsonFile, TokenManager* manager, ParserError* error);
+JsonNode* parseObject(ParseContext* context, ParserError* error);
 
 /**
  * @brief Effettua il parsing di un array JSON.
  */
-JsonNode* parseArray(FILE* jsonFile, TokenManager* manager, ParserError* error);
+JsonNode* parseArray(ParseContext* context, ParserError* error);
+
+/**
+ * @brief Effettua il parsing di una sequenza di valori separati da virgole.
+ *
+ * Analizza gli elementi di un array privi delle parentesi, fino alla fine
+ * dei token, copiandoli in `values`. Trovare più di `capacity` valori è un
+ * errore.
+ *
+ * @param context Puntatore al contesto di parsing.
+ * @param values Array in cui copiare i valori.
+ * @param capacity Numero massimo di valori.
+ * @param error Puntatore alla struttura di errore.
+ * @return Numero di valori copiati, anche in caso di errore.
+ */
+size_t parseArrayValues(ParseContext* context, JsonNode* values, size_t capacity, ParserError* error);
 
 /**
  * @brief Effettua il parsing di una stringa JSON.
  */
-JsonNode* parseString(FILE* jsonFile, Token* token);
+JsonNode* parseString(ParseContext* context, Token* token, ParserError* error);
 
 /**
  * @brief Effettua il parsing di un numero intero JSON.
  */
-JsonNode* parseInteger(FILE* jsonFile, Token* token, ParserError* error);
+JsonNode* parseInteger(ParseContext* context, Token* token, ParserError* error);
 
 /**
  * @brief Effettua il parsing di un numero decimale JSON.
  */
-JsonNode* parseDouble(FILE* jsonFile, Token* token, ParserError* error);
+JsonNode* parseDouble(ParseContext* context, Token* token, ParserError* error);
 
 /**
  * @brief Effettua il parsing di un valore booleano JSON.
  */
-JsonNode* parseBoolean(FILE* jsonFile, Token* token);
+JsonNode* parseBoolean(ParseContext* context, Token* token);
 
 /**
  * @brief Effettua il parsing di un valore null JSON.
  */
-JsonNode* parseNull(FILE* jsonFile, Token* token);
+JsonNode* parseNull(ParseContext* context, Token* token);
 
 /**
  * @brief Esegue il parsing completo di un file JSON.
  */
-JsonNode* parse(FILE* jsonFile, TokenManager* manager, ParserError* error);
+JsonNode* parse(ParseContext* context, ParserError* error);
 
 /**
  * @brief Analizza un file JSON e restituisce la radice della struttura
@@ -272,15 +703,1357 @@ JsonNode* parse(FILE* jsonFile, TokenManager* manager, ParserError* error);
  * @warning Il chiamante è responsabile della gestione della memoria per la
  *          struttura JSON restituita e per eventuali errori memorizzati in
  *          `strError`.
- * @note La funzione chiude automaticamente il file JSON aperto,
- *       indipendentemente dal risultato.
+ * @note Il file viene mappato in memoria (o letto in un buffer se non è un
+ *       file regolare) e rilasciato automaticamente, indipendentemente
+ *       dal risultato.
  *
  */
 JsonNode* parseJsonFile(const char* filename, char** strError);
 
+/**
+ * @brief Analizza un contenuto JSON già presente in memoria.
+ *
+ * Esegue la tokenizzazione e il parsing direttamente sul buffer del chiamante,
+ * senza copiarlo né passare dal filesystem. Gli errori vengono riportati con
+ * gli stessi messaggi di `parseJsonFile`.
+ *
+ * @param data Puntatore al contenuto JSON (non serve che termini con '\0').
+ * @param length Numero di byte del contenuto JSON.
+ * @param strError Puntatore a una stringa in cui verrà memorizzato un
+ *                 messaggio di errore in caso di fallimento. Può essere `NULL`.
+ * @return Un puntatore alla radice della struttura ad albero JSON in caso di
+ *         successo, oppure `NULL` in caso di errore.
+ * @note L'albero restituito non fa riferimento a `data`, che può essere
+ *       rilasciato subito dopo la chiamata.
+ */
+JsonNode* parseJsonBuffer(const char* data, size_t length, char** strError);
+
+/**
+ * @struct ParseStats
+ * @brief Statistiche raccolte durante l'analisi di un contenuto JSON.
+ *
+ * Servono a capire perché un documento è lento da analizzare. Vanno
+ * inizializzate con `initParseStats` e richieste tramite `ParserOptions`:
+ * ogni analisi somma i propri valori a quelli già presenti (per `maxDepth`
+ * tiene il massimo), così che possano essere accumulati su più documenti.
+ * Se non richieste costano un confronto con NULL per token e per nodo.
+ */
+typedef struct ParseStats
+{
+  size_t bytes;                        /**< Byte di input letti */
+  size_t tokens[CURLY_CLOSE + 1];      /**< Token letti, indicizzati per TokenType */
+  size_t nodes[DOUBLE_ARRAY_NODE + 1]; /**< Nodi creati, indicizzati per JsonNodeType */
+  size_t maxDepth;                     /**< Massima profondità di annidamento dei contenitori */
+  size_t reallocations;                /**< Riallocazioni eseguite da `vec_alloc` */
+  size_t bytesAllocated;               /**< Byte allocati per l'albero */
+  double ioSeconds;                    /**< Secondi spesi a caricare e rilasciare il file */
+  double lexSeconds;                   /**< Secondi spesi nell'analisi lessicale, se eseguita prima del parsing */
+  double parseSeconds;                 /**< Secondi spesi nel parsing, lexing compreso se in streaming */
+  double freeSeconds;                  /**< Secondi spesi a liberare token e memoria temporanea */
+} ParseStats;
+
+/**
+ * @brief Azzera le statistiche.
+ * @param stats Puntatore alle statistiche da inizializzare.
+ */
+void initParseStats(ParseStats* stats);
+
+/**
+ * @struct ParserOptions
+ * @brief Opzioni facoltative per l'analisi di un contenuto JSON.
+ *
+ * Va inizializzata con `initParserOptions`, che imposta il comportamento
+ * predefinito di `parseJsonBuffer`.
+ */
+typedef struct ParserOptions
+{
+  JsonArena* arena;                        /**< Arena in cui allocare l'albero, NULL per usare malloc */
+  bool streamTokens;                       /**< Legge i token dal lexer durante il parsing invece di memorizzarli tutti */
+  bool indexObjects;                       /**< Indicizza le chiavi degli oggetti grandi durante il parsing */
+  size_t threads;                          /**< Thread per analizzare un array radice grande, 0 per uno per core */
+  size_t lexAhead;                         /**< Token che un thread lexer dedicato può produrre in anticipo, 0 per non usarlo */
+  ParseStats* stats;                       /**< Statistiche da aggiornare, NULL per non raccoglierle */
+  struct JsonKeyTable* keys;               /**< Tabella in cui internare le chiavi, NULL per copiarle */
+  const struct JsonProjection* projection; /**< Percorsi da tenere, NULL per l'intero documento */
+  bool packNumbers;                        /**< Memorizza gli array di numeri dello stesso tipo come array compatti */
+} ParserOptions;
+
+/**
+ * @brief Imposta le opzioni predefinite.
+ * @param options Puntatore alle opzioni da inizializzare.
+ */
+void initParserOptions(ParserOptions* options);
+
+/**
+ * @brief Analizza un contenuto JSON in memoria con le opzioni indicate.
+ *
+ * Con `arena` impostata, tutti i nodi e le stringhe dell'albero vengono
+ * assegnati dall'arena, che ne diventa proprietaria.
+ *
+ * Con `streamTokens` il parser chiede i token al lexer uno alla volta
+ * invece di costruire prima l'intero TokenManager: oltre all'albero viene
+ * usata solo memoria proporzionale alla profondità del JSON. Gli errori
+ * riportati (tipo e posizione) sono gli stessi.
+ *
+ * Con `indexObjects` il lexer calcola l'hash delle stringhe e gli oggetti
+ * con almeno `JSON_INDEX_MIN_SIZE` coppie ricevono subito l'indice usato da
+ * `jsonObjectGet` (allocato nell'arena, se presente).
+ *
+ * Con `lexAhead` maggiore di 0 i token vengono prodotti da un thread lexer
+ * dedicato, in parallelo al parsing, tramite `createTokenPipeline`: la
+ * memoria usata per i token è limitata come con `streamTokens`.
+ *
+ * Con `stats` vengono raccolte le statistiche dell'analisi (vedi
+ * `ParseStats`).
+ *
+ * Con `threads` diverso da 1 un contenuto grande formato da un unico array
+ * viene analizzato in parallelo da `parseJsonArrayParallel`.
+ *
+ * Con `keys` le chiavi degli oggetti non vengono copiate ma internate nella
+ * tabella (vedi `internJsonKey`) e hanno sempre l'hash. La tabella non è
+ * thread-safe, per cui l'analisi resta sequenziale anche con `threads`.
+ *
+ * Con `projection` l'albero contiene solo i valori selezionati dai percorsi
+ * (vedi `compileJsonProjection`). Gli altri valori vengono validati come
+ * nel parsing completo, con gli stessi errori, oppure solo saltati se
+ * `validate` è `false`. Anche in questo caso l'analisi è sequenziale.
+ *
+ * Con `packNumbers` un array non vuoto di soli interi o di soli decimali
+ * diventa un `INTEGER_ARRAY_NODE` o un `DOUBLE_ARRAY_NODE`, con i valori
+ * contigui invece di un nodo per elemento. Un array che mescola interi e
+ * decimali resta un `ARRAY_NODE`. L'array radice non viene diviso tra più
+ * thread, per cui anche in questo caso l'analisi è sequenziale.
+ *
+ * @param data Puntatore al contenuto JSON.
+ * @param length Numero di byte del contenuto JSON.
+ * @param options Puntatore alle opzioni di analisi.
+ * @param strError Puntatore a una stringa in cui verrà memorizzato un
+ *                 messaggio di errore in caso di fallimento. Può essere `NULL`.
+ * @return Un puntatore alla radice della struttura ad albero JSON in caso di
+ *         successo, oppure `NULL` in caso di errore.
+ * @warning Un albero allocato in un'arena NON va liberato con `freeJsonTree`:
+ *          viene rilasciato in un colpo solo con `deleteJsonArena`.
+ */
+JsonNode* parseJsonBufferWithOptions(const char* data, size_t length, const ParserOptions* options, char** strError);
+
+/**
+ * @brief Analizza un contenuto JSON modificabile senza copiarne le stringhe.
+ *
+ * Come `parseJsonBufferWithOptions`, ma le stringhe e le chiavi vengono
+ * decodificate nel buffer stesso, al posto del testo originale, e
+ * terminate con '\0' dove c'erano i doppi apici di chiusura: i nodi puntano
+ * nel buffer invece che in memoria allocata. Le chiavi da internare
+ * (`keys`) vengono comunque copiate nella tabella e l'analisi è sempre
+ * sequenziale.
+ *
+ * @param data Puntatore al contenuto JSON, che viene modificato anche in
+ *             caso di errore.
+ * @param length Numero di byte del contenuto JSON.
+ * @param options Puntatore alle opzioni di analisi.
+ * @param strError Puntatore a una stringa in cui verrà memorizzato un
+ *                 messaggio di errore in caso di fallimento. Può essere `NULL`.
+ * @return Un puntatore alla radice della struttura ad albero JSON in caso di
+ *         successo, oppure `NULL` in caso di errore.
+ * @warning Il buffer deve restare valido, e non va analizzato di nuovo,
+ *          finché l'albero è in uso. `freeJsonTree` non lo libera.
+ */
+JsonNode* parseJsonBufferInSitu(char* data, size_t length, const ParserOptions* options, char** strError);
+
+/**
+ * @brief Analizza in parallelo un contenuto JSON formato da un unico array.
+ *
+ * Una prima passata sequenziale sull'indice strutturale (che tiene conto
+ * delle stringhe e degli escape) trova le virgole di primo livello e divide
+ * gli elementi in gruppi di dimensione simile. I gruppi vengono analizzati
+ * contemporaneamente da più thread, ognuno con la propria arena, e gli
+ * elementi vengono scritti direttamente nella loro posizione finale
+ * dell'array radice, quindi nell'ordine originale.
+ *
+ * Non riporta errori: se il contenuto è piccolo, non è un array, non è
+ * valido, le chiavi vanno internate (`keys`), c'è una proiezione
+ * (`projection`) o i numeri vanno compattati (`packNumbers`) restituisce
+ * `false` e va
+ * analizzato con il parser sequenziale, che produce il messaggio di errore
+ * esatto.
+ *
+ * @param data Puntatore al contenuto JSON.
+ * @param length Numero di byte del contenuto JSON.
+ * @param options Opzioni di analisi, `threads` indica i thread da usare.
+ * @param root Puntatore in cui memorizzare la radice in caso di successo.
+ * @return `true` se il contenuto è stato analizzato, `false` altrimenti.
+ */
+bool parseJsonArrayParallel(const char* data, size_t length, const ParserOptions* options, JsonNode** root);
+
+/**
+ * @brief Analizza un file JSON con le opzioni indicate.
+ *
+ * Come `parseJsonFile`, con le opzioni di `parseJsonBufferWithOptions`.
+ */
+JsonNode* parseJsonFileWithOptions(const char* filename, const ParserOptions* options, char** strError);
+
+/**
+ * @brief Analizza un contenuto JSON in memoria allocando l'albero in un'arena.
+ *
+ * Equivale a `parseJsonBufferWithOptions` con la sola opzione `arena`.
+ *
+ * @warning L'albero restituito NON va liberato con `freeJsonTree`: viene
+ *          rilasciato in un colpo solo con `deleteJsonArena`.
+ */
+JsonNode* parseJsonBufferArena(const char* data, size_t length, JsonArena* arena, char** strError);
+
+/**
+ * @brief Analizza un file JSON allocando l'albero in un'arena.
+ *
+ * Equivale a `parseJsonFileWithOptions` con la sola opzione `arena`.
+ */
+JsonNode* parseJsonFileArena(const char* filename, JsonArena* arena, char** strError);
+
+/**
+ * @brief Analizza una stringa JSON terminata con '\0'.
+ *
+ * Equivale a `parseJsonBuffer(str, strlen(str), strError)`.
+ */
+JsonNode* parseJsonString(const char* str, char** strError);
+
 /**
  * @brief Libera la memoria allocata per un albero JSON.
+ * @note Non ha effetto sui nodi allocati in un'arena.
  */
 void freeJsonTree(JsonNode* node);
 
+/**
+ * PARSER RIUTILIZZABILE
+ */
+
+// Byte che un JsonParser tiene allocati per buffer, se non indicato
+#define JSON_PARSER_RETAIN_LIMIT (4 * 1024 * 1024)
+
+/**
+ * @struct JsonParser
+ * @brief Parser che conserva la propria memoria da un contenuto all'altro.
+ *
+ * L'albero viene allocato nell'arena del parser, che viene svuotata
+ * all'analisi successiva. Restano allocati anche l'indice strutturale, il
+ * buffer dei token e la pila e il buffer `scratch` del contesto. Una volta
+ * raggiunta la dimensione dei contenuti analizzati, documenti simili non
+ * richiedono più nessuna allocazione.
+ */
+typedef struct JsonParser
+{
+  ParserOptions options; /**< Opzioni di analisi, `arena` è quella del parser */
+  JsonArena* arena;      /**< Arena dell'ultimo albero */
+  Lexer lexer;           /**< Lexer con l'indice strutturale da riutilizzare */
+  TokenManager* tokens;  /**< Buffer dei token letti prima del parsing */
+  ParseContext context;  /**< Contesto con la pila e il buffer `scratch` */
+  size_t retainLimit;    /**< Byte oltre i quali un buffer viene liberato dopo l'analisi */
+} JsonParser;
+
+/**
+ * @brief Crea un parser riutilizzabile.
+ *
+ * Le opzioni vengono copiate, tranne `arena` che viene sostituita da
+ * quella del parser. Il buffer dei token viene riutilizzato solo senza
+ * `streamTokens` e `lexAhead`, e l'analisi parallela (`threads`) alloca
+ * comunque la memoria dei propri thread.
+ *
+ * @param options Opzioni di analisi, NULL per quelle predefinite.
+ * @param retainLimit Byte che ogni buffer può tenere allocati tra
+ *                    un'analisi e l'altra, 0 per `JSON_PARSER_RETAIN_LIMIT`.
+ * @return Puntatore al parser, da liberare con `deleteJsonParser`.
+ */
+JsonParser* createJsonParser(const ParserOptions* options, size_t retainLimit);
+
+/**
+ * @brief Libera un parser e l'ultimo albero che ha prodotto.
+ * @param parser Puntatore al parser da liberare.
+ */
+void deleteJsonParser(JsonParser* parser);
+
+/**
+ * @brief Analizza un contenuto JSON in memoria con un parser riutilizzabile.
+ *
+ * Gli errori sono gli stessi di `parseJsonBufferWithOptions`.
+ *
+ * @param parser Puntatore al parser.
+ * @param data Puntatore al contenuto JSON.
+ * @param length Numero di byte del contenuto JSON.
+ * @param strError Puntatore a una stringa in cui verrà memorizzato un
+ *                 messaggio di errore in caso di fallimento. Può essere `NULL`.
+ * @return Radice dell'albero, oppure `NULL` in caso di errore.
+ * @warning L'albero appartiene al parser: resta valido fino all'analisi
+ *          successiva o a `deleteJsonParser` e NON va liberato con
+ *          `freeJsonTree`.
+ */
+JsonNode* parseJsonBufferWithParser(JsonParser* parser, const char* data, size_t length, char** strError);
+
+/**
+ * @brief Analizza un file JSON con un parser riutilizzabile.
+ *
+ * Come `parseJsonFile`, con la memoria di `parseJsonBufferWithParser`.
+ */
+JsonNode* parseJsonFileWithParser(JsonParser* parser, const char* filename, char** strError);
+
+/**
+ * NUMERI
+ */
+
+/**
+ * @brief Converte un numero JSON (RFC 8259) nel valore corrispondente.
+ *
+ * Lavora direttamente sui byte dell'input, senza copiarli. Gli interi che
+ * rientrano in `int64_t` diventano INTEGER_NODE, tutti gli altri numeri
+ * DOUBLE_NODE: i decimali sono convertiti con l'algoritmo di Eisel-Lemire,
+ * arrotondati correttamente, ricorrendo a `strtod` solo nei rari casi in cui
+ * non è sufficiente (ad esempio oltre 19 cifre significative).
+ *
+ * @param str Puntatore al primo byte del numero.
+ * @param length Numero di byte del numero.
+ * @param type Puntatore in cui memorizzare il tipo di nodo del valore.
+ * @param value Puntatore in cui memorizzare il valore.
+ * @return `true` se il numero rispetta la grammatica JSON, `false` altrimenti.
+ */
+bool parseJsonNumber(const char* str, size_t length, JsonNodeType* type, JsonValue* value);
+
+/**
+ * STRINGHE
+ */
+
+/**
+ * @brief Decodifica il contenuto di una stringa JSON (senza i doppi apici).
+ *
+ * In un solo passaggio copia i byte, sostituisce le sequenze di escape
+ * (comprese `\uXXXX` e le coppie surrogate) con la loro codifica UTF-8 e
+ * verifica che il resto sia UTF-8 valido. I tratti senza escape né byte
+ * non ASCII vengono copiati a blocchi di 16 byte con SSE2.
+ *
+ * @param src Puntatore al contenuto della stringa.
+ * @param length Numero di byte del contenuto.
+ * @param dst Buffer di destinazione di almeno `length + 1` byte: la stringa
+ *            decodificata non è mai più lunga di quella originale. Può
+ *            coincidere con `src` per decodificare sul posto.
+ * @param dstLength Puntatore in cui memorizzare il numero di byte decodificati
+ *                  (escluso il '\0' finale). Può essere `NULL`.
+ * @param errorOffset Puntatore in cui memorizzare la posizione del byte non
+ *                    valido in caso di errore. Può essere `NULL`.
+ * @return `NO_PARSER_ERROR`, oppure il tipo di errore rilevato.
+ * @note Una sequenza `\u0000` produce un byte nullo all'interno della stringa.
+ */
+ParserErrorType decodeJsonString(const char* src, size_t length, char* dst, size_t* dstLength, size_t* errorOffset);
+
+/**
+ * @brief Verifica se il contenuto di una stringa JSON può essere usato così
+ *        com'è, senza decodifica.
+ *
+ * @param src Puntatore al contenuto della stringa (senza i doppi apici).
+ * @param length Numero di byte del contenuto.
+ * @return `true` se contiene solo ASCII stampabile e nessun '\\', `false`
+ *         altrimenti.
+ */
+bool isPlainJsonString(const char* src, size_t length);
+
+/**
+ * ANALISI A EVENTI (SAX)
+ */
+
+/**
+ * @struct JsonSaxHandler
+ * @brief Callback invocati durante l'analisi a eventi.
+ *
+ * I callback `NULL` vengono ignorati. Se un callback restituisce `false`
+ * l'analisi si interrompe subito con l'errore PARSING_ABORTED.
+ *
+ * Le stringhe passate a `onKey` e `onString` sono già decodificate ma non
+ * sono terminate da '\0', e restano valide solo fino al ritorno del
+ * callback: quando non contengono escape né byte non ASCII puntano
+ * direttamente all'input, altrimenti a un buffer interno riutilizzato.
+ */
+typedef struct JsonSaxHandler
+{
+  void* userData;                                                   /**< Puntatore passato a ogni callback */
+  bool (*onObjectStart)(void* userData);                            /**< Inizio di un oggetto */
+  bool (*onObjectEnd)(void* userData);                              /**< Fine di un oggetto */
+  bool (*onArrayStart)(void* userData);                             /**< Inizio di un array */
+  bool (*onArrayEnd)(void* userData);                               /**< Fine di un array */
+  bool (*onKey)(void* userData, const char* key, size_t length);    /**< Chiave di una coppia */
+  bool (*onString)(void* userData, const char* str, size_t length); /**< Valore stringa */
+  bool (*onInt64)(void* userData, int64_t value);                   /**< Valore intero */
+  bool (*onDouble)(void* userData, double value);                   /**< Valore decimale */
+  bool (*onBool)(void* userData, bool value);                       /**< Valore booleano */
+  bool (*onNull)(void* userData);                                   /**< Valore nullo */
+} JsonSaxHandler;
+
+/**
+ * @brief Analizza un buffer JSON notificando ogni valore a un handler,
+ *        senza costruire alcun albero.
+ *
+ * La memoria usata non dipende dalla dimensione dell'input: solo la finestra
+ * di token, lo stack della discesa ricorsiva e il buffer per le stringhe con
+ * escape, grande quanto la più lunga di esse.
+ *
+ * @param data Puntatore ai dati JSON.
+ * @param length Lunghezza dei dati.
+ * @param handler Callback da invocare.
+ * @param strError Puntatore a una stringa in cui memorizzare l'errore. Può
+ *                 essere `NULL`.
+ * @return `true` se l'input è stato analizzato per intero, `false` in caso di
+ *         errore o di interruzione.
+ * @note Gli eventi precedenti a un errore sono comunque già stati notificati.
+ */
+bool parseJsonSax(const char* data, size_t length, const JsonSaxHandler* handler, char** strError);
+
+/**
+ * ANALISI INCREMENTALE (PUSH)
+ */
+
+/**
+ * @enum JsonPushState
+ * @brief Elemento sintattico atteso dal parser incrementale.
+ */
+typedef enum JsonPushState
+{
+  PUSH_EXPECT_VALUE = 0,      /**< Atteso un valore */
+  PUSH_EXPECT_VALUE_OR_CLOSE, /**< Atteso un valore o la fine dell'array */
+  PUSH_EXPECT_KEY_OR_CLOSE,   /**< Attesa una chiave o la fine dell'oggetto */
+  PUSH_EXPECT_KEY,            /**< Attesa una chiave dopo una virgola */
+  PUSH_EXPECT_COLON,          /**< Attesi i due punti dopo una chiave */
+  PUSH_EXPECT_COMMA_OR_CLOSE, /**< Attesa una virgola o la fine del contenitore */
+  PUSH_COMPLETE               /**< Valore radice completo */
+} JsonPushState;
+
+/**
+ * @enum JsonPushLexState
+ * @brief Token lasciato a metà dall'ultimo blocco di input.
+ */
+typedef enum JsonPushLexState
+{
+  PUSH_LEX_NONE = 0, /**< Nessun token in corso */
+  PUSH_LEX_STRING,   /**< Stringa in corso */
+  PUSH_LEX_NUMBER,   /**< Numero in corso */
+  PUSH_LEX_LITERAL   /**< Literal (`true`, `false` o `null`) in corso */
+} JsonPushLexState;
+
+/**
+ * @struct JsonPushParser
+ * @brief Parser che riceve l'input a blocchi di dimensione arbitraria.
+ *
+ * Tutto lo stato dell'analisi (token interrotto a metà, contenitori aperti,
+ * posizione per gli errori) viene conservato tra un blocco e l'altro, per cui
+ * l'input può essere analizzato mentre arriva da un socket o da una pipe.
+ * I valori vengono notificati a un JsonSaxHandler oppure, in sua assenza,
+ * usati per costruire un albero.
+ */
+typedef struct JsonPushParser
+{
+  JsonSaxHandler handler;          /**< Callback da invocare */
+  struct JsonTreeBuilder* builder; /**< Albero in costruzione, NULL se si usano i callback */
+  JsonPushState state;             /**< Elemento sintattico atteso */
+  char* containers;                /**< Stack dei contenitori aperti ('{' o '[') */
+  size_t containersCapacity;       /**< Capacità massima dello stack */
+  size_t depth;                    /**< Numero di contenitori aperti */
+  JsonPushLexState lexState;       /**< Token lasciato a metà */
+  char* pending;                   /**< Byte già ricevuti del token a metà */
+  size_t pendingCapacity;          /**< Capacità massima del buffer */
+  size_t pendingSize;              /**< Numero di byte del token a metà */
+  const char* literal;             /**< Literal atteso, se in corso */
+  bool escaped;                    /**< Il prossimo byte della stringa è preceduto da escape */
+  bool afterCarriageReturn;        /**< L'ultimo byte ricevuto era '\r' */
+  char* scratch;                   /**< Buffer per le stringhe decodificate */
+  size_t scratchCapacity;          /**< Capacità massima del buffer */
+  Token token;                     /**< Token corrente o ultimo letto */
+  size_t lineCount;                /**< Numero di linea corrente */
+  size_t charCount;                /**< Numero di carattere corrente */
+  LexError lexError;               /**< Errore lessicale rilevato */
+  ParserError parserError;         /**< Errore sintattico rilevato */
+} JsonPushParser;
+
+/**
+ * @brief Crea un parser incrementale.
+ * @param handler Callback da invocare, copiati nel parser. Se `NULL` il
+ *                parser costruisce un albero, da ottenere con
+ *                `takeJsonPushTree`.
+ * @return Puntatore al parser allocato.
+ */
+JsonPushParser* createJsonPushParser(const JsonSaxHandler* handler);
+
+/**
+ * @brief Dealloca un parser incrementale e l'albero eventualmente non ritirato.
+ * @param parser Puntatore al parser da eliminare.
+ */
+void deleteJsonPushParser(JsonPushParser* parser);
+
+/**
+ * @brief Analizza il prossimo blocco di input.
+ *
+ * I blocchi possono interrompersi in qualsiasi punto, anche a metà di una
+ * stringa, di un numero, di un literal o di una sequenza "\r\n". I byte
+ * del blocco non servono più al ritorno della funzione.
+ *
+ * @param parser Puntatore al parser.
+ * @param data Puntatore ai byte del blocco.
+ * @param length Numero di byte del blocco.
+ * @param strError Puntatore a una stringa in cui memorizzare l'errore. Può
+ *                 essere `NULL`.
+ * @return `false` se è stato rilevato un errore, nel blocco corrente o in
+ *         uno precedente.
+ * @note Gli errori vengono riportati nel punto in cui si presentano: a
+ *       differenza di `parseJsonBuffer`, un errore lessicale più avanti
+ *       nell'input non ha la precedenza su un errore sintattico.
+ */
+bool feedJsonPushParser(JsonPushParser* parser, const char* data, size_t length, char** strError);
+
+/**
+ * @brief Segnala la fine dell'input e completa l'analisi.
+ *
+ * Un numero alla fine dell'ultimo blocco viene notificato solo qui, perché
+ * fino ad allora potrebbe continuare nel blocco successivo.
+ *
+ * @param parser Puntatore al parser.
+ * @param strError Puntatore a una stringa in cui memorizzare l'errore. Può
+ *                 essere `NULL`.
+ * @return `true` se l'input contiene un valore JSON completo e valido.
+ */
+bool finishJsonPushParser(JsonPushParser* parser, char** strError);
+
+/**
+ * @brief Indica se il valore radice è già completo.
+ * @param parser Puntatore al parser.
+ * @return `true` se il valore radice è stato chiuso, anche prima della
+ *         fine dell'input.
+ */
+bool isJsonPushComplete(const JsonPushParser* parser);
+
+/**
+ * @brief Ritira l'albero costruito da un parser creato senza callback.
+ * @param parser Puntatore al parser.
+ * @return Puntatore alla radice, `NULL` se il valore non è ancora completo o
+ *         se l'albero è già stato ritirato.
+ * @warning L'albero va liberato con `freeJsonTree`.
+ */
+JsonNode* takeJsonPushTree(JsonPushParser* parser);
+
+/**
+ * SEQUENZE DI DOCUMENTI (NDJSON)
+ */
+
+/**
+ * @enum JsonSequenceFormat
+ * @brief Modo in cui i documenti di una sequenza sono separati.
+ */
+typedef enum JsonSequenceFormat
+{
+  JSON_SEQUENCE_LINES = 0,   /**< Un documento per riga (NDJSON / JSON Lines), le righe vuote sono ignorate */
+  JSON_SEQUENCE_CONCATENATED /**< Documenti uno di seguito all'altro, separati o meno da spazi */
+} JsonSequenceFormat;
+
+/**
+ * @brief Riceve un documento di una sequenza.
+ * @param userData Puntatore indicato nelle opzioni.
+ * @param document Puntatore al primo byte del documento nell'input.
+ * @param length Numero di byte del documento.
+ * @param root Albero del documento, che passa al chiamato e va liberato con
+ *             `freeJsonTree`. `NULL` se il documento non è valido.
+ * @param strError Descrizione dell'errore (con linea e colonna relative al
+ *                 documento), `NULL` se il documento è valido. Non va
+ *                 liberata.
+ * @return `false` per interrompere l'analisi della sequenza.
+ */
+typedef bool (*JsonDocumentCallback)(void* userData, const char* document, size_t length, JsonNode* root, const char* strError);
+
+/**
+ * @struct JsonSequenceOptions
+ * @brief Opzioni per l'analisi di una sequenza di documenti.
+ */
+typedef struct JsonSequenceOptions
+{
+  JsonSequenceFormat format;       /**< Separazione tra i documenti */
+  size_t threads;                  /**< Thread di analisi, 0 per uno per ogni core */
+  size_t batchSize;                /**< Byte di documenti assegnati a ogni thread per volta, 0 per il valore predefinito */
+  bool unordered;                  /**< Consegna i documenti appena pronti invece che nell'ordine dell'input */
+  JsonDocumentCallback onDocument; /**< Funzione che riceve i documenti */
+  void* userData;                  /**< Puntatore passato a `onDocument` */
+} JsonSequenceOptions;
+
+/**
+ * @brief Inizializza le opzioni con i valori predefiniti: documenti per riga,
+ *        un thread per core, consegna in ordine.
+ * @param options Puntatore alle opzioni da inizializzare.
+ */
+void initJsonSequenceOptions(JsonSequenceOptions* options);
+
+/**
+ * @brief Analizza una sequenza di documenti JSON distribuendoli su più thread.
+ *
+ * Il thread chiamante divide l'input in lotti di documenti interi e li
+ * assegna a un gruppo di thread, che ne costruiscono gli alberi in
+ * parallelo. I documenti vengono poi consegnati a `onDocument`, sempre dal
+ * thread chiamante e mai in contemporanea: nell'ordine dell'input oppure,
+ * con `unordered`, un lotto alla volta appena è pronto. In memoria restano
+ * al più pochi lotti per thread.
+ *
+ * Un documento non valido non interrompe l'analisi: viene consegnato con il
+ * suo errore. A differenza di `parseJsonBuffer`, un documento deve
+ * contenere un solo valore: una riga come `{"a":1} {"b":2}` è un errore.
+ *
+ * @param data Puntatore ai dati.
+ * @param length Lunghezza dei dati.
+ * @param options Opzioni di analisi.
+ * @param strError Puntatore a una stringa in cui memorizzare l'errore. Può
+ *                 essere `NULL`.
+ * @return `false` se `onDocument` ha interrotto l'analisi.
+ */
+bool parseJsonSequence(const char* data, size_t length, const JsonSequenceOptions* options, char** strError);
+
+/**
+ * @brief Analizza una sequenza di documenti JSON letta da un file.
+ *
+ * Come `parseJsonSequence`, sul contenuto del file mappato in memoria.
+ */
+bool parseJsonSequenceFile(const char* filename, const JsonSequenceOptions* options, char** strError);
+
+/**
+ * RICERCA PER CHIAVE
+ */
+
+/**
+ * Numero minimo di coppie oltre il quale un oggetto viene indicizzato: per
+ * oggetti più piccoli la scansione lineare è più veloce.
+ */
+#define JSON_INDEX_MIN_SIZE 8
+
+/**
+ * @struct JsonIndexEntry
+ * @brief Cella della tabella hash di un JsonObjectIndex.
+ */
+typedef struct JsonIndexEntry
+{
+  uint32_t hash;     /**< Hash della chiave */
+  uint32_t position; /**< Posizione della coppia nell'oggetto + 1, 0 se la cella è vuota */
+} JsonIndexEntry;
+
+/**
+ * @struct JsonObjectIndex
+ * @brief Tabella hash a indirizzamento aperto delle chiavi di un oggetto.
+ *
+ * Le celle seguono la struttura nella stessa allocazione. Con chiavi
+ * duplicate viene indicizzata la prima, come nella scansione lineare.
+ */
+typedef struct JsonObjectIndex
+{
+  size_t mask;             /**< Numero di celle - 1 (le celle sono una potenza di 2) */
+  JsonIndexEntry* entries; /**< Celle della tabella */
+} JsonObjectIndex;
+
+/**
+ * @brief Calcola l'hash (FNV-1a) di una chiave.
+ * @param key Puntatore ai byte della chiave.
+ * @param length Numero di byte della chiave.
+ * @return Hash della chiave, mai 0.
+ */
+uint32_t jsonHashKey(const char* key, size_t length);
+
+/**
+ * @brief Costruisce l'indice delle chiavi di un oggetto.
+ *
+ * Un eventuale indice già presente viene mantenuto.
+ *
+ * @param node Puntatore al nodo oggetto.
+ * @param arena Arena in cui allocare l'indice, o NULL per usare malloc.
+ * @return `true` se l'oggetto ha un indice.
+ */
+bool buildJsonObjectIndex(JsonNode* node, JsonArena* arena);
+
+/**
+ * @brief Elimina l'indice delle chiavi di un oggetto, se presente.
+ *
+ * Va chiamata quando le coppie dell'oggetto cambiano: l'indice viene
+ * ricostruito alla ricerca successiva. Un indice allocato in un'arena
+ * viene rilasciato insieme all'arena.
+ *
+ * @param node Puntatore al nodo oggetto.
+ */
+void dropJsonObjectIndex(JsonNode* node);
+
+/**
+ * @brief Cerca il valore associato a una chiave in un oggetto.
+ *
+ * Gli oggetti con almeno `JSON_INDEX_MIN_SIZE` coppie vengono indicizzati
+ * alla prima ricerca, per cui le successive costano O(1). Fanno eccezione
+ * i nodi allocati in un'arena, che vengono scansionati linearmente a meno
+ * che l'indice non sia stato costruito durante il parsing (`indexObjects`)
+ * o con `buildJsonObjectIndex`.
+ *
+ * @param node Puntatore al nodo oggetto.
+ * @param key Puntatore ai byte della chiave.
+ * @param length Numero di byte della chiave.
+ * @return Puntatore al nodo valore, o NULL se la chiave non è presente o
+ *         il nodo non è un oggetto.
+ * @warning La costruzione dell'indice modifica il nodo: ricerche concorrenti
+ *          sullo stesso oggetto richiedono che sia già indicizzato.
+ */
+JsonNode* jsonObjectGet(JsonNode* node, const char* key, size_t length);
+
+/**
+ * @brief Come `jsonObjectGet`, con l'hash della chiave già calcolato.
+ * @param hash Hash della chiave restituito da `jsonHashKey`.
+ */
+JsonNode* jsonObjectGetHashed(JsonNode* node, const char* key, size_t length, uint32_t hash);
+
+/**
+ * INTERNAMENTO DELLE CHIAVI
+ */
+
+/**
+ * @struct JsonInternedKey
+ * @brief Intestazione di una chiave internata, seguita dai suoi byte.
+ */
+typedef struct JsonInternedKey
+{
+  uint32_t hash; /**< Hash della chiave calcolato da `jsonHashKey` */
+  size_t length; /**< Numero di byte della chiave, escluso il terminatore */
+} JsonInternedKey;
+
+/**
+ * @struct JsonKeyTable
+ * @brief Tabella che conserva una sola copia di ogni chiave distinta.
+ *
+ * Può servire un solo documento o essere condivisa da molti: le chiavi
+ * restano valide fino all'eliminazione della tabella, che deve quindi
+ * sopravvivere a tutti gli alberi che la usano.
+ */
+typedef struct JsonKeyTable
+{
+  JsonInternedKey** slots; /**< Celle della tabella hash, NULL se vuote */
+  size_t mask;             /**< Numero di celle - 1 (le celle sono una potenza di 2) */
+  size_t count;            /**< Numero di chiavi distinte */
+  JsonArena* arena;        /**< Arena in cui sono allocate le chiavi */
+} JsonKeyTable;
+
+/**
+ * @brief Crea una nuova JsonKeyTable vuota.
+ * @return Puntatore alla JsonKeyTable allocata.
+ */
+JsonKeyTable* createJsonKeyTable();
+
+/**
+ * @brief Dealloca una JsonKeyTable e tutte le sue chiavi.
+ * @param table Puntatore alla JsonKeyTable da eliminare.
+ */
+void deleteJsonKeyTable(JsonKeyTable* table);
+
+/**
+ * @brief Restituisce la copia internata di una chiave, creandola se manca.
+ *
+ * Chiavi uguali ottengono lo stesso puntatore, per cui possono essere
+ * confrontate senza leggerne i byte.
+ *
+ * @param table Puntatore alla JsonKeyTable.
+ * @param key Puntatore ai byte della chiave.
+ * @param length Numero di byte della chiave.
+ * @param hash Hash della chiave restituito da `jsonHashKey`, 0 per calcolarlo.
+ * @return Puntatore alla chiave internata terminata da '\0', da non
+ *         modificare né liberare, o NULL se l'allocazione fallisce.
+ */
+char* internJsonKey(JsonKeyTable* table, const char* key, size_t length, uint32_t hash);
+
+/**
+ * @brief Restituisce l'intestazione di una chiave internata.
+ * @param key Puntatore restituito da `internJsonKey`.
+ * @return Puntatore all'intestazione con hash e lunghezza della chiave.
+ */
+const JsonInternedKey* jsonInternedKey(const char* key);
+
+/**
+ * PERCORSI (JSON POINTER)
+ */
+
+/** Valore di `JsonPathStep.index` per i passi che non sono un indice valido */
+#define JSON_PATH_NO_INDEX SIZE_MAX
+
+/**
+ * @struct JsonPathStep
+ * @brief Passo di un percorso compilato.
+ *
+ * Lo stesso passo seleziona una chiave negli oggetti e un elemento negli
+ * array, per cui contiene già sia l'hash della chiave che l'indice.
+ */
+typedef struct JsonPathStep
+{
+  const char* key; /**< Chiave, senza le sequenze di escape `~0` e `~1` */
+  size_t length;   /**< Numero di byte della chiave */
+  uint32_t hash;   /**< Hash della chiave (`jsonHashKey`) */
+  size_t index;    /**< Indice negli array, `JSON_PATH_NO_INDEX` se non numerico */
+} JsonPathStep;
+
+/**
+ * @struct JsonPath
+ * @brief Percorso JSON Pointer (RFC 6901) compilato in una sequenza di passi.
+ */
+typedef struct JsonPath
+{
+  JsonPathStep* steps; /**< Passi del percorso */
+  size_t size;         /**< Numero di passi */
+  char* keys;          /**< Buffer delle chiavi dei passi */
+} JsonPath;
+
+/**
+ * @brief Compila un JSON Pointer, ad esempio `/items/3/price`.
+ *
+ * Il percorso vuoto `""` indica la radice.
+ *
+ * @param pointer Stringa JSON Pointer terminata con '\0'.
+ * @param strError Puntatore a una stringa in cui verrà memorizzato un
+ *                 messaggio di errore in caso di fallimento. Può essere `NULL`.
+ * @return Puntatore al percorso, da liberare con `deleteJsonPath`, oppure
+ *         `NULL` se il JSON Pointer non è valido.
+ */
+JsonPath* compileJsonPath(const char* pointer, char** strError);
+
+/**
+ * @brief Libera la memoria utilizzata da un percorso compilato.
+ * @param path Puntatore al percorso da liberare.
+ */
+void deleteJsonPath(JsonPath* path);
+
+/**
+ * @brief Valuta un percorso compilato a partire da un nodo.
+ *
+ * La valutazione non alloca memoria, a parte l'indice delle chiavi che
+ * `jsonObjectGet` costruisce una sola volta per gli oggetti grandi.
+ *
+ * Gli elementi degli array compatti non sono nodi: un percorso che li
+ * raggiunge restituisce NULL, l'array va letto con `jsonNodeIntegers` o
+ * `jsonNodeDoubles`.
+ *
+ * @param path Puntatore al percorso compilato.
+ * @param root Nodo da cui parte il percorso.
+ * @return Nodo selezionato, o NULL se il percorso non esiste.
+ */
+JsonNode* evalJsonPath(const JsonPath* path, JsonNode* root);
+
+/**
+ * @struct JsonPathBatch
+ * @brief Insieme di percorsi valutati con un'unica visita dell'albero.
+ *
+ * I percorsi sono ordinati in modo che quelli con un prefisso comune siano
+ * adiacenti: ogni prefisso condiviso viene percorso una sola volta.
+ */
+typedef struct JsonPathBatch
+{
+  const JsonPath** paths; /**< Percorsi in ordine di valutazione */
+  size_t* order;          /**< Posizione del risultato di ogni percorso */
+  size_t* shared;         /**< Passi in comune con il percorso precedente */
+  size_t count;           /**< Numero di percorsi */
+  JsonNode** stack;       /**< Nodi raggiunti dal percorso precedente */
+  size_t depth;           /**< Numero massimo di passi di un percorso */
+} JsonPathBatch;
+
+/**
+ * @brief Crea un insieme di percorsi da valutare insieme.
+ * @param paths Array di percorsi compilati, che devono restare validi per
+ *              tutta la vita dell'insieme.
+ * @param count Numero di percorsi.
+ * @return Puntatore all'insieme, da liberare con `deleteJsonPathBatch`.
+ */
+JsonPathBatch* createJsonPathBatch(const JsonPath* const* paths, size_t count);
+
+/**
+ * @brief Libera la memoria utilizzata da un insieme di percorsi.
+ * @param batch Puntatore all'insieme da liberare.
+ */
+void deleteJsonPathBatch(JsonPathBatch* batch);
+
+/**
+ * @brief Valuta tutti i percorsi di un insieme a partire da un nodo.
+ * @param batch Puntatore all'insieme di percorsi.
+ * @param root Nodo da cui partono i percorsi.
+ * @param results Array di `count` nodi: l'i-esimo riceve il risultato
+ *                dell'i-esimo percorso passato a `createJsonPathBatch`.
+ * @warning L'insieme contiene lo stato della visita: non va valutato
+ *          contemporaneamente da più thread.
+ */
+void evalJsonPathBatch(JsonPathBatch* batch, JsonNode* root, JsonNode** results);
+
+/**
+ * PROIEZIONE
+ */
+
+/**
+ * @struct JsonProjectionNode
+ * @brief Passo di una proiezione, nodo dell'albero dei percorsi.
+ *
+ * I passi che seguono lo stesso prefisso sono fratelli, per cui i percorsi
+ * con un prefisso comune lo condividono.
+ */
+typedef struct JsonProjectionNode
+{
+  char* key;          /**< Chiave del passo, NULL per i passi sugli elementi degli array */
+  size_t length;      /**< Numero di byte della chiave */
+  size_t index;       /**< Indice dell'elemento, `JSON_PATH_NO_INDEX` per `[*]` e per le chiavi */
+  bool selected;      /**< Un percorso termina qui: il valore viene tenuto per intero */
+  size_t firstChild;  /**< Posizione del primo passo successivo, 0 se assente */
+  size_t nextSibling; /**< Posizione del passo fratello successivo, 0 se assente */
+} JsonProjectionNode;
+
+/**
+ * @struct JsonProjection
+ * @brief Insieme di percorsi da tenere durante il parsing.
+ *
+ * Con `ParserOptions.projection` il parser crea i nodi solo per i valori
+ * selezionati dai percorsi e per i contenitori che li contengono: gli altri
+ * valori vengono letti senza allocare nulla.
+ */
+typedef struct JsonProjection
+{
+  JsonProjectionNode* nodes; /**< Passi dei percorsi, la radice è in posizione 0 */
+  size_t size;               /**< Numero di passi */
+  size_t capacity;           /**< Capacità massima dell'array */
+  bool validate;             /**< Valida i valori esclusi (`true` dopo la compilazione) */
+} JsonProjection;
+
+/**
+ * @brief Compila un insieme di percorsi, ad esempio `user.id` e
+ *        `items[*].price`.
+ *
+ * Un percorso è una sequenza di passi: una chiave (preceduta da '.' tranne
+ * che all'inizio), `[n]` per l'elemento n di un array o `[*]` per tutti
+ * gli elementi. Le chiavi non possono contenere '.' o '[' e vengono
+ * confrontate con le chiavi già decodificate. Il percorso vuoto seleziona
+ * l'intero documento. Sullo stesso array non si possono usare sia `[*]` che
+ * indici.
+ *
+ * Un contenitore sul percorso di un valore selezionato viene tenuto anche
+ * se il valore manca, eventualmente vuoto.
+ *
+ * @param paths Percorsi da tenere.
+ * @param count Numero di percorsi.
+ * @param strError Puntatore a una stringa in cui verrà memorizzato un
+ *                 messaggio di errore in caso di fallimento. Può essere `NULL`.
+ * @return Puntatore alla proiezione, da liberare con `deleteJsonProjection`,
+ *         oppure `NULL` se un percorso non è valido.
+ */
+JsonProjection* compileJsonProjection(const char** paths, size_t count, char** strError);
+
+/**
+ * @brief Libera la memoria utilizzata da una proiezione.
+ * @param projection Puntatore alla proiezione da liberare.
+ */
+void deleteJsonProjection(JsonProjection* projection);
+
+/**
+ * @brief Cerca il passo che segue `node` per una chiave.
+ * @return Posizione del passo, 0 se la chiave non è selezionata.
+ */
+size_t findJsonProjectionKey(const JsonProjection* projection, size_t node, const char* key, size_t length);
+
+/**
+ * @brief Cerca il passo che segue `node` per l'elemento `index` di un array.
+ * @return Posizione del passo, 0 se l'elemento non è selezionato.
+ */
+size_t findJsonProjectionElement(const JsonProjection* projection, size_t node, size_t index);
+
+/**
+ * SERIALIZZAZIONE
+ */
+
+/** Numero massimo di caratteri scritti da `formatJsonInteger` e `formatJsonDouble` */
+#define JSON_NUMBER_MAX_LENGTH 32
+
+/**
+ * @struct JsonWriter
+ * @brief Buffer di uscita per la serializzazione JSON.
+ *
+ * Senza destinazione il buffer cresce fino a contenere tutto il JSON,
+ * altrimenti viene svuotato nel FILE* o nel descrittore quando è pieno.
+ */
+typedef struct JsonWriter
+{
+  char* buffer;    /**< Byte scritti e non ancora inviati alla destinazione */
+  size_t capacity; /**< Capacità massima del buffer */
+  size_t size;     /**< Numero attuale di byte nel buffer */
+  FILE* file;      /**< Destinazione, NULL se assente */
+  int fd;          /**< Descrittore di destinazione, -1 se assente */
+  bool failed;     /**< Indica se un'allocazione o una scrittura è fallita */
+} JsonWriter;
+
+/**
+ * @brief Inizializza un JsonWriter che scrive in un buffer in memoria.
+ * @param writer Puntatore al writer da inizializzare.
+ */
+void initJsonWriter(JsonWriter* writer);
+
+/**
+ * @brief Inizializza un JsonWriter che scrive su un FILE*.
+ * @param writer Puntatore al writer da inizializzare.
+ * @param file File di destinazione, aperto in scrittura.
+ */
+void initJsonFileWriter(JsonWriter* writer, FILE* file);
+
+/**
+ * @brief Inizializza un JsonWriter che scrive su un descrittore di file.
+ * @param writer Puntatore al writer da inizializzare.
+ * @param fd Descrittore di destinazione, aperto in scrittura.
+ */
+void initJsonFdWriter(JsonWriter* writer, int fd);
+
+/**
+ * @brief Invia alla destinazione i byte ancora nel buffer.
+ * @param writer Puntatore al writer.
+ * @return `true` se tutte le scritture sono andate a buon fine.
+ */
+bool flushJsonWriter(JsonWriter* writer);
+
+/**
+ * @brief Libera il buffer di un JsonWriter, senza svuotarlo.
+ * @param writer Puntatore al writer da ripulire.
+ */
+void clearJsonWriter(JsonWriter* writer);
+
+/**
+ * @brief Scrive un albero JSON.
+ *
+ * Con `indent` uguale a 0 il JSON è compatto, altrimenti ogni elemento va
+ * su una nuova riga indentata di `indent` spazi per livello. I numeri
+ * decimali sono scritti con il minor numero di cifre che li rilegge uguali
+ * (Grisu2), le stringhe con i soli escape necessari.
+ *
+ * @param writer Puntatore al writer.
+ * @param node Radice dell'albero da scrivere.
+ * @param indent Spazi di indentazione per livello, 0 per il JSON compatto.
+ * @return `true` se non si sono verificati errori finora.
+ * @note Con una destinazione, parte del JSON può restare nel buffer fino a
+ *       `flushJsonWriter`.
+ */
+bool writeJson(JsonWriter* writer, const JsonNode* node, size_t indent);
+
+/**
+ * @brief Serializza un albero JSON in una stringa terminata con '\0'.
+ * @param node Radice dell'albero da serializzare.
+ * @param indent Spazi di indentazione per livello, 0 per il JSON compatto.
+ * @param length Puntatore in cui memorizzare la lunghezza. Può essere `NULL`.
+ * @return La stringa allocata, da liberare con `free`, o NULL in caso di errore.
+ */
+char* serializeJson(const JsonNode* node, size_t indent, size_t* length);
+
+/**
+ * @brief Scrive un intero come testo.
+ * @param value Valore da scrivere.
+ * @param buffer Buffer di almeno `JSON_NUMBER_MAX_LENGTH` byte.
+ * @return Numero di caratteri scritti (senza '\0' finale).
+ */
+size_t formatJsonInteger(int64_t value, char* buffer);
+
+/**
+ * @brief Scrive un numero decimale come numero JSON.
+ *
+ * Il risultato contiene sempre un punto o un esponente, così viene riletto
+ * come decimale. NaN e infinito, che JSON non prevede, diventano `null`.
+ *
+ * @param value Valore da scrivere.
+ * @param buffer Buffer di almeno `JSON_NUMBER_MAX_LENGTH` byte.
+ * @return Numero di caratteri scritti (senza '\0' finale).
+ */
+size_t formatJsonDouble(double value, char* buffer);
+
+/**
+ * RAPPRESENTAZIONE A NASTRO (TAPE)
+ */
+
+/**
+ * @struct JsonTape
+ * @brief Documento JSON memorizzato come un unico nastro di parole a 64 bit.
+ *
+ * Ogni valore occupa una parola (due per i numeri, il cui valore si trova
+ * nella parola successiva) con il tipo negli 8 bit alti. Le chiavi degli
+ * oggetti precedono il rispettivo valore. Le parentesi di apertura
+ * contengono il numero di figli e la posizione successiva alla parentesi di
+ * chiusura corrispondente, così interi sotto-alberi possono essere saltati
+ * in tempo costante. Le stringhe sono copiate in un unico buffer separato.
+ *
+ * I valori sono identificati dalla loro posizione nel nastro (`ref`): la
+ * radice si trova sempre in posizione 0.
+ */
+typedef struct JsonTape
+{
+  uint64_t* words;        /**< Parole del nastro */
+  size_t capacity;        /**< Capacità massima del nastro */
+  size_t size;            /**< Numero attuale di parole */
+  char* strings;          /**< Buffer delle stringhe (lunghezza a 32 bit, byte, '\0') */
+  size_t stringsCapacity; /**< Capacità massima del buffer delle stringhe */
+  size_t stringsSize;     /**< Byte utilizzati nel buffer delle stringhe */
+} JsonTape;
+
+/**
+ * @brief Crea un nuovo JsonTape vuoto.
+ * @return Puntatore al JsonTape allocato.
+ */
+JsonTape* createJsonTape();
+
+/**
+ * @brief Dealloca un JsonTape.
+ * @param tape Puntatore al JsonTape da eliminare.
+ */
+void deleteJsonTape(JsonTape* tape);
+
+/**
+ * @brief Analizza un contenuto JSON in memoria costruendo un nastro.
+ *
+ * I token vengono letti dal lexer durante la costruzione, senza memorizzarli.
+ * Gli errori vengono riportati con gli stessi messaggi di `parseJsonBuffer`.
+ *
+ * @param data Puntatore al contenuto JSON.
+ * @param length Numero di byte del contenuto JSON.
+ * @param strError Puntatore a una stringa in cui verrà memorizzato un
+ *                 messaggio di errore in caso di fallimento. Può essere `NULL`.
+ * @return Puntatore al nastro costruito, oppure `NULL` in caso di errore.
+ * @warning Il nastro va liberato con `deleteJsonTape`.
+ */
+JsonTape* parseJsonTapeBuffer(const char* data, size_t length, char** strError);
+
+/**
+ * @brief Restituisce il tipo del valore in posizione `ref`.
+ */
+JsonNodeType jsonTapeType(const JsonTape* tape, size_t ref);
+
+/**
+ * @brief Restituisce la stringa (o chiave) in posizione `ref`.
+ * @param length Se non NULL, riceve la lunghezza della stringa.
+ * @return Puntatore alla stringa terminata con '\0' nel buffer del nastro.
+ */
+const char* jsonTapeString(const JsonTape* tape, size_t ref, size_t* length);
+
+/**
+ * @brief Restituisce il numero intero in posizione `ref`.
+ */
+int64_t jsonTapeInteger(const JsonTape* tape, size_t ref);
+
+/**
+ * @brief Restituisce il numero decimale in posizione `ref`.
+ */
+double jsonTapeDouble(const JsonTape* tape, size_t ref);
+
+/**
+ * @brief Restituisce il valore booleano in posizione `ref`.
+ */
+bool jsonTapeBoolean(const JsonTape* tape, size_t ref);
+
+/**
+ * @brief Restituisce il numero di figli (coppie per gli oggetti) del
+ *        contenitore in posizione `ref`, saturato a 2^24 - 1.
+ */
+size_t jsonTapeSize(const JsonTape* tape, size_t ref);
+
+/**
+ * @brief Restituisce la posizione del primo figlio del contenitore `ref`.
+ *
+ * Per gli oggetti è la posizione della prima chiave, il valore si trova
+ * nella posizione successiva. Se il contenitore è vuoto coincide con
+ * `jsonTapeEnd`.
+ */
+size_t jsonTapeFirstChild(const JsonTape* tape, size_t ref);
+
+/**
+ * @brief Restituisce la posizione della parentesi di chiusura del
+ *        contenitore `ref`, da usare come fine dell'iterazione.
+ */
+size_t jsonTapeEnd(const JsonTape* tape, size_t ref);
+
+/**
+ * @brief Restituisce la posizione del valore che segue `ref`, saltando in
+ *        tempo costante l'eventuale sotto-albero.
+ */
+size_t jsonTapeNext(const JsonTape* tape, size_t ref);
+
+/**
+ * @brief Restituisce la posizione della chiave che segue la coppia con
+ *        chiave in posizione `keyRef`.
+ */
+size_t jsonTapeNextMember(const JsonTape* tape, size_t keyRef);
+
+/**
+ * @brief Converte il valore in posizione `ref` in un albero di JsonNode.
+ * @return Radice dell'albero, da liberare con `freeJsonTree`.
+ */
+JsonNode* jsonTapeToTree(const JsonTape* tape, size_t ref);
+
+/**
+ * @brief Converte un albero di JsonNode in un nastro.
+ * @return Puntatore al nastro, da liberare con `deleteJsonTape`.
+ */
+JsonTape* jsonTreeToTape(const JsonNode* root);
+
+/**
+ * ACCESSO SU RICHIESTA (ON DEMAND)
+ */
+
+/**
+ * @struct JsonDocument
+ * @brief Contenuto JSON preparato per l'accesso su richiesta.
+ *
+ * Contiene solo l'indice strutturale dell'input e, per ogni parentesi
+ * aperta, la posizione che segue quella di chiusura: nessun valore viene
+ * decodificato finché non viene letto e i contenitori che non interessano
+ * vengono saltati in tempo costante.
+ */
+typedef struct JsonDocument
+{
+  const char* data; /**< Contenuto JSON, deve restare valido quanto il documento */
+  size_t length;    /**< Numero di byte del contenuto JSON */
+  size_t* offsets;  /**< Posizioni dell'indice strutturale */
+  size_t size;      /**< Numero di posizioni */
+  size_t* ends;     /**< Per ogni parentesi aperta, la posizione che segue la sua chiusura */
+} JsonDocument;
+
+/**
+ * @struct JsonCursor
+ * @brief Posizione di un valore in un JsonDocument.
+ *
+ * È un valore leggero da copiare liberamente; resta valido finché esiste
+ * il documento.
+ */
+typedef struct JsonCursor
+{
+  const JsonDocument* document; /**< Documento a cui appartiene */
+  size_t pos;                   /**< Posizione del valore nell'indice strutturale */
+  bool member;                  /**< Indica se il valore è quello di una coppia di un oggetto */
+} JsonCursor;
+
+/**
+ * @brief Prepara un contenuto JSON per l'accesso su richiesta.
+ *
+ * Costruisce l'indice strutturale e verifica che il contenuto sia un unico
+ * valore con parentesi bilanciate e stringhe chiuse. Il resto della
+ * validazione avviene solo per le parti lette: gli accessori restituiscono
+ * `false` (o NULL) per valori non validi e la navigazione si ferma sui
+ * separatori mancanti. Per validare un sotto-albero per intero si usa
+ * `jsonCursorToTree`.
+ *
+ * @param data Puntatore al contenuto JSON, che non viene copiato.
+ * @param length Numero di byte del contenuto JSON.
+ * @param strError Puntatore a una stringa in cui verrà memorizzato un
+ *                 messaggio di errore in caso di fallimento. Può essere `NULL`.
+ * @return Puntatore al documento, da liberare con `deleteJsonDocument`,
+ *         oppure `NULL` in caso di errore.
+ */
+JsonDocument* createJsonDocument(const char* data, size_t length, char** strError);
+
+/**
+ * @brief Dealloca un JsonDocument, ma non il contenuto JSON.
+ * @param document Puntatore al documento da eliminare.
+ */
+void deleteJsonDocument(JsonDocument* document);
+
+/**
+ * @brief Restituisce il cursore del valore radice.
+ */
+JsonCursor jsonDocumentRoot(const JsonDocument* document);
+
+/**
+ * @brief Restituisce il tipo del valore, dedotto dal suo primo byte.
+ *
+ * I numeri sono `DOUBLE_NODE` se contengono '.', 'e' o 'E'. Un valore non
+ * riconoscibile risulta `NULL_NODE`, ma non supera `jsonCursorIsNull`.
+ */
+JsonNodeType jsonCursorType(JsonCursor cursor);
+
+/**
+ * @brief Posiziona un cursore sul primo elemento di un array o sul valore
+ *        della prima coppia di un oggetto.
+ * @return `false` se il contenitore è vuoto o il valore non è un contenitore.
+ */
+bool jsonCursorChild(JsonCursor container, JsonCursor* child);
+
+/**
+ * @brief Sposta il cursore sul valore successivo dello stesso contenitore,
+ *        saltando senza leggerlo il sotto-albero di quello attuale.
+ * @return `false` se non ci sono altri valori (il cursore non cambia).
+ */
+bool jsonCursorNext(JsonCursor* cursor);
+
+/**
+ * @brief Restituisce la chiave del valore di una coppia.
+ * @param member Cursore sul valore di una coppia.
+ * @param key Puntatore in cui memorizzare i byte della chiave nell'input,
+ *            senza decodificare le sequenze di escape.
+ * @param length Puntatore in cui memorizzare il numero di byte della chiave.
+ * @return `false` se il cursore non è il valore di una coppia.
+ */
+bool jsonCursorKey(JsonCursor member, const char** key, size_t* length);
+
+/**
+ * @brief Cerca il valore associato a una chiave in un oggetto.
+ *
+ * Le coppie vengono scorse in ordine saltando i valori che precedono
+ * quella cercata; le chiavi sono decodificate solo se contengono sequenze
+ * di escape.
+ *
+ * @return `true` se la chiave è presente, con `value` posizionato sul valore.
+ */
+bool jsonCursorFind(JsonCursor object, const char* key, size_t length, JsonCursor* value);
+
+/**
+ * @brief Posiziona un cursore sull'elemento `index` di un array.
+ * @return `true` se l'elemento esiste.
+ */
+bool jsonCursorAt(JsonCursor array, size_t index, JsonCursor* value);
+
+/**
+ * @brief Legge un numero intero.
+ * @return `false` se il valore non è un numero intero valido.
+ */
+bool jsonCursorInt64(JsonCursor cursor, int64_t* value);
+
+/**
+ * @brief Legge un numero, anche intero, come decimale.
+ * @return `false` se il valore non è un numero valido.
+ */
+bool jsonCursorDouble(JsonCursor cursor, double* value);
+
+/**
+ * @brief Legge un valore booleano.
+ * @return `false` se il valore non è `true` o `false`.
+ */
+bool jsonCursorBoolean(JsonCursor cursor, bool* value);
+
+/**
+ * @brief Indica se il valore è `null`.
+ */
+bool jsonCursorIsNull(JsonCursor cursor);
+
+/**
+ * @brief Restituisce i byte di una stringa nell'input, senza copiarli né
+ *        decodificare le sequenze di escape.
+ * @param length Puntatore in cui memorizzare il numero di byte.
+ * @return Puntatore ai byte, o NULL se il valore non è una stringa.
+ */
+const char* jsonCursorRawString(JsonCursor cursor, size_t* length);
+
+/**
+ * @brief Restituisce una copia decodificata di una stringa.
+ * @param length Puntatore in cui memorizzare il numero di byte decodificati. Può essere `NULL`.
+ * @return Stringa terminata da '\0' da liberare con `free`, o NULL se il
+ *         valore non è una stringa valida.
+ */
+char* jsonCursorString(JsonCursor cursor, size_t* length);
+
+/**
+ * @brief Costruisce l'albero del valore con `parseJsonBuffer`.
+ *
+ * L'intero sotto-albero viene validato; le posizioni degli errori sono
+ * relative all'inizio del valore.
+ *
+ * @return Radice dell'albero da liberare con `freeJsonTree`, o NULL in caso
+ *         di errore.
+ */
+JsonNode* jsonCursorToTree(JsonCursor cursor, char** strError);
+
+/**
+ * @brief Valuta un percorso compilato a partire da un cursore.
+ *
+ * Come `evalJsonPath`, ma legge solo le chiavi e i separatori lungo il
+ * percorso.
+ *
+ * @return `true` se il percorso esiste, con `result` posizionato sul valore.
+ */
+bool evalJsonPathCursor(const JsonPath* path, JsonCursor root, JsonCursor* result);
+
 #endif // JSON_PARSER_C
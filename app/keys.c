@@ -0,0 +1,90 @@
+#include "json-parser.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Slots of an empty table, a power of two
+#define KEY_TABLE_MIN_CAPACITY 64
+
+JsonKeyTable* createJsonKeyTable()
+{
+  JsonKeyTable* table = (JsonKeyTable*)malloc(sizeof(JsonKeyTable));
+  table->slots = (JsonInternedKey**)calloc(KEY_TABLE_MIN_CAPACITY, sizeof(JsonInternedKey*));
+  table->mask = KEY_TABLE_MIN_CAPACITY - 1;
+  table->count = 0;
+  table->arena = createJsonArena(0);
+  return table;
+}
+
+void deleteJsonKeyTable(JsonKeyTable* table)
+{
+  if (table == NULL)
+    return;
+
+  deleteJsonArena(table->arena);
+  free(table->slots);
+  free(table);
+}
+
+/**
+ * Doubles the slots, the stored hashes make it a plain reinsertion.
+ */
+static void growJsonKeyTable(JsonKeyTable* table)
+{
+  size_t capacity = (table->mask + 1) * 2;
+  JsonInternedKey** slots = (JsonInternedKey**)calloc(capacity, sizeof(JsonInternedKey*));
+
+  for (size_t i = 0; i <= table->mask; i++)
+  {
+    JsonInternedKey* entry = table->slots[i];
+    if (entry == NULL)
+      continue;
+
+    size_t slot = entry->hash & (capacity - 1);
+    while (slots[slot] != NULL)
+      slot = (slot + 1) & (capacity - 1);
+    slots[slot] = entry;
+  }
+
+  free(table->slots);
+  table->slots = slots;
+  table->mask = capacity - 1;
+}
+
+char* internJsonKey(JsonKeyTable* table, const char* key, size_t length, uint32_t hash)
+{
+  if (hash == 0)
+    hash = jsonHashKey(key, length);
+
+  size_t slot = hash & table->mask;
+  while (table->slots[slot] != NULL)
+  {
+    JsonInternedKey* entry = table->slots[slot];
+    if (entry->hash == hash && entry->length == length && memcmp(entry + 1, key, length) == 0)
+      return (char*)(entry + 1);
+    slot = (slot + 1) & table->mask;
+  }
+
+  // The bytes follow the header, which keeps them aligned like the arena
+  JsonInternedKey* entry = (JsonInternedKey*)arenaAlloc(table->arena, sizeof(JsonInternedKey) + length + 1);
+  if (entry == NULL)
+    return NULL;
+  entry->hash = hash;
+  entry->length = length;
+  char* bytes = (char*)(entry + 1);
+  memcpy(bytes, key, length);
+  bytes[length] = '\0';
+
+  table->slots[slot] = entry;
+  table->count++;
+
+  // At most half full, so that probe sequences stay short
+  if (table->count * 2 > table->mask + 1)
+    growJsonKeyTable(table);
+
+  return bytes;
+}
+
+const JsonInternedKey* jsonInternedKey(const char* key)
+{
+  return (const JsonInternedKey*)key - 1;
+}
@@ -3,6 +3,13 @@
 #include <ctype.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+
+// Bytes of input indexed at a time, keeps the structural index small
+#define LEXER_BATCH_SIZE (64 * 1024)
+
+// Tokens kept by a token stream, the parser never looks further back
+#define TOKEN_STREAM_WINDOW 16
 
 TokenManager* createTokenManager()
 {
@@ -11,15 +18,28 @@ TokenManager* createTokenManager()
   manager->capacity = 0;
   manager->size = 0;
   manager->pos = 0;
+  manager->lexer = NULL;
+  manager->pipeline = NULL;
   return manager;
 }
 
 void deleteTokenManager(TokenManager* manager)
 {
+  if (manager->pipeline != NULL)
+    deleteTokenPipeline(manager->pipeline);
   free(manager->tokens);
   free(manager);
 }
 
+TokenManager* createTokenStream(Lexer* lexer)
+{
+  TokenManager* manager = createTokenManager();
+  manager->lexer = lexer;
+  manager->capacity = TOKEN_STREAM_WINDOW;
+  manager->tokens = (Token*)malloc(manager->capacity * sizeof(Token));
+  return manager;
+}
+
 Token* createToken(TokenManager* manager)
 {
   manager->size++;
@@ -27,173 +47,302 @@ Token* createToken(TokenManager* manager)
   return &manager->tokens[manager->size - 1];
 }
 
-bool matchFileCharacter(FILE* jsonFile, int match, LexError* error, LexErrorType errorType)
+bool matchLiteral(const char* json, size_t length, size_t* pos, const char* literal, LexError* error, LexErrorType errorType)
 {
-  int c = fgetc(jsonFile);
-  if ((c != match || c == EOF) && error)
+  for (; *literal != '\0'; literal++, (*pos)++)
   {
-    error->type = errorType;
-    return false;
+    if (*pos >= length || json[*pos] != *literal)
+    {
+      if (error)
+        error->type = errorType;
+      return false;
+    }
   }
   return true;
 }
 
-TokenManager* lex(FILE* jsonFile, LexError* error)
+static bool isNumberCharacter(char c)
 {
-  fseek(jsonFile, 0, SEEK_SET);
-  if (error)
-    error->type = NO_LEX_ERROR;
+  return isdigit((unsigned char)c) || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-';
+}
 
-  TokenManager* manager = createTokenManager();
+static bool isDelimiter(char c)
+{
+  switch (c)
+  {
+  case '{':
+  case '}':
+  case '[':
+  case ']':
+  case ',':
+  case ':':
+  case '"':
+    return true;
+  }
+  return isspace((unsigned char)c);
+}
 
-  int c;
-  size_t lineCount = 0;
-  size_t charCount = 0;
-  while ((c = fgetc(jsonFile)) != EOF)
+void initLexer(Lexer* lexer, const char* json, size_t length)
+{
+  lexer->index = createStructuralIndex();
+  resetLexer(lexer, json, length);
+}
+
+void resetLexer(Lexer* lexer, const char* json, size_t length)
+{
+  lexer->json = json;
+  lexer->length = length;
+  resetStructuralIndex(lexer->index);
+  lexer->next = 0;
+  lexer->pos = 0;
+  lexer->lineCount = 0;
+  lexer->charCount = 0;
+  lexer->afterScalar = false;
+  lexer->finished = false;
+  lexer->hashStrings = false;
+  lexer->stats = NULL;
+  lexer->error.type = NO_LEX_ERROR;
+  lexer->error.lineCount = 0;
+  lexer->error.charCount = 0;
+}
+
+void clearLexer(Lexer* lexer)
+{
+  deleteStructuralIndex(lexer->index);
+  lexer->index = NULL;
+}
+
+/**
+ * Returns the next indexed position, indexing the next batch of the input
+ * once the current one has been consumed.
+ */
+static bool nextStructural(Lexer* lexer, size_t* offset)
+{
+  StructuralIndex* index = lexer->index;
+  while (lexer->next >= index->size)
   {
-    charCount++;
+    if (index->scanned >= lexer->length)
+      return false;
 
-    if (c == '\n' || c == '\r')
+    index->size = 0;
+    lexer->next = 0;
+    indexStructurals(index, lexer->json, lexer->length, LEXER_BATCH_SIZE);
+  }
+
+  *offset = index->offsets[lexer->next++];
+  return true;
+}
+
+/**
+ * Counts the lines and columns of the whitespace up to `end`.
+ */
+static void skipWhitespace(Lexer* lexer, size_t end)
+{
+  const char* json = lexer->json;
+  for (; lexer->pos < end; lexer->pos++)
+  {
+    if (json[lexer->pos] == '\n' || json[lexer->pos] == '\r')
     {
-      lineCount++;
-      charCount = 0;
+      lexer->lineCount++;
+      lexer->charCount = 0;
 
       // Handle possible Windows newline by ignoring it's adjacent \n
-      if (c == '\r')
-      {
-        int next = fgetc(jsonFile);
-        if (next != '\n' && next != EOF)
-          ungetc(next, jsonFile);
-      }
+      if (json[lexer->pos] == '\r' && lexer->pos + 1 < end && json[lexer->pos + 1] == '\n')
+        lexer->pos++;
     }
-
-    if (isspace(c))
+    else
     {
-      continue;
+      lexer->charCount++;
     }
+  }
+}
 
-    Token* token = createToken(manager);
-    token->startPos = ftell(jsonFile) - 1;
-    token->lineCount = lineCount + 1;
-    token->charCount = charCount;
+static bool finishLexer(Lexer* lexer)
+{
+  skipWhitespace(lexer, lexer->length);
+  lexer->finished = true;
 
-    error->lineCount = lineCount + 1;
-    error->charCount = charCount;
+  if (lexer->lineCount == 0 && lexer->charCount == 0)
+  {
+    lexer->error.type = EMPTY_FILE;
+    lexer->error.charCount = 0;
+    lexer->error.lineCount = 0;
+  }
+  return false;
+}
 
-    switch (c)
-    {
-    case '{':
-    case '}':
-    case '[':
-    case ']':
-    case ',':
-    case ':':
-      token->type = (TokenType)c;
-      token->endPos = token->startPos;
-      continue;
-    }
+static bool scanToken(Lexer* lexer, Token* token)
+{
+  if (lexer->finished || lexer->error.type != NO_LEX_ERROR)
+    return false;
+
+  const char* json = lexer->json;
+  size_t length = lexer->length;
+  LexError* error = &lexer->error;
+  size_t start;
 
-    if (c == '"')
+  // Characters glued to the end of a number or literal (e.g. "12x" or
+  // "truex") belong to the same scalar run in the index, lex them here
+  if (lexer->afterScalar && lexer->pos < length && !isDelimiter(json[lexer->pos]))
+  {
+    start = lexer->pos;
+  }
+  else
+  {
+    do
     {
-      token->type = STRING_LEX;
-
-      do
-      {
-        c = fgetc(jsonFile);
-        charCount++;
-      } while (c != '"' && c != EOF);
-
-      if (c == '"')
-        token->endPos = ftell(jsonFile) - 1;
-
-      if (c == EOF && error)
-      {
-        error->type = EXPECTED_END_OF_STRING;
-        return manager;
-      }
-    }
-    else if (c == '-' || isdigit(c))
+      if (!nextStructural(lexer, &start))
+        return finishLexer(lexer);
+    } while (start < lexer->pos);
+  }
+
+  // Only whitespace lies between two tokens
+  skipWhitespace(lexer, start);
+
+  char c = json[lexer->pos++];
+  lexer->charCount++;
+  lexer->afterScalar = false;
+
+  token->startPos = start;
+  token->hash = 0;
+  token->lineCount = lexer->lineCount + 1;
+  token->charCount = lexer->charCount;
+
+  error->lineCount = lexer->lineCount + 1;
+  error->charCount = lexer->charCount;
+
+  switch (c)
+  {
+  case '{':
+  case '}':
+  case '[':
+  case ']':
+  case ',':
+  case ':':
+    token->type = (TokenType)c;
+    token->endPos = token->startPos;
+    return true;
+  }
+
+  if (c == '"')
+  {
+    token->type = STRING_LEX;
+
+    // The next structural after an opening quote is always its closing quote
+    if (!nextStructural(lexer, &token->endPos))
     {
-      bool isDouble = false;
-      do
-      {
-        c = fgetc(jsonFile);
-        if (c == '.')
-          isDouble = true;
-        charCount++;
-      } while ((isdigit(c) || c == '.') && c != EOF);
-      ungetc(c, jsonFile);
-
-      token->endPos = ftell(jsonFile);
-
-      if (isDouble)
-        token->type = DOUBLE_LEX;
-      else
-        token->type = INTEGER_LEX;
-
-      if (c == EOF && error)
-      {
-        error->type = UNEXPECTED_END_OF_INPUT;
-        return manager;
-      }
+      error->type = EXPECTED_END_OF_STRING;
+      return false;
     }
-    else if (c == 't')
-    {
-      token->type = BOOLEAN_LEX;
 
-      if (!matchFileCharacter(jsonFile, 'r', error, INVALID_BOOLEAN_LITERAL))
-        return manager;
-      if (!matchFileCharacter(jsonFile, 'u', error, INVALID_BOOLEAN_LITERAL))
-        return manager;
-      if (!matchFileCharacter(jsonFile, 'e', error, INVALID_BOOLEAN_LITERAL))
-        return manager;
+    // Object keys are hashed while their bytes are still in cache
+    if (lexer->hashStrings)
+      token->hash = jsonHashKey(json + token->startPos + 1, token->endPos - token->startPos - 1);
 
-      token->endPos = ftell(jsonFile);
-      charCount += 3;
-    }
-    else if (c == 'f')
+    lexer->charCount += token->endPos - token->startPos;
+    lexer->pos = token->endPos + 1;
+    return true;
+  }
+
+  lexer->afterScalar = true;
+
+  if (c == '-' || isdigit((unsigned char)c))
+  {
+    // The run of number characters is validated and converted by the
+    // parser, a fraction or an exponent makes it a double
+    size_t pos = lexer->pos;
+    bool isDouble = false;
+    while (pos < length && isNumberCharacter(json[pos]))
     {
-      token->type = BOOLEAN_LEX;
-
-      if (!matchFileCharacter(jsonFile, 'a', error, INVALID_BOOLEAN_LITERAL))
-        return manager;
-      if (!matchFileCharacter(jsonFile, 'l', error, INVALID_BOOLEAN_LITERAL))
-        return manager;
-      if (!matchFileCharacter(jsonFile, 's', error, INVALID_BOOLEAN_LITERAL))
-        return manager;
-      if (!matchFileCharacter(jsonFile, 'e', error, INVALID_BOOLEAN_LITERAL))
-        return manager;
-
-      token->endPos = ftell(jsonFile);
-      charCount += 4;
+      if (json[pos] == '.' || json[pos] == 'e' || json[pos] == 'E')
+        isDouble = true;
+      pos++;
     }
-    else if (c == 'n')
-    {
-      token->type = NULL_LEX;
 
-      if (!matchFileCharacter(jsonFile, 'u', error, INVALID_NULL_LITERAL))
-        return manager;
-      if (!matchFileCharacter(jsonFile, 'l', error, INVALID_NULL_LITERAL))
-        return manager;
-      if (!matchFileCharacter(jsonFile, 'l', error, INVALID_NULL_LITERAL))
-        return manager;
+    token->endPos = pos;
+    lexer->charCount += token->endPos - token->startPos - 1;
+    lexer->pos = pos;
 
-      token->endPos = ftell(jsonFile);
-      charCount += 3;
-    }
+    if (isDouble)
+      token->type = DOUBLE_LEX;
     else
-    {
-      error->type = UNEXPECTED_CHARACTER;
-      return manager;
-    }
+      token->type = INTEGER_LEX;
   }
+  else if (c == 't')
+  {
+    token->type = BOOLEAN_LEX;
+
+    if (!matchLiteral(json, length, &lexer->pos, "rue", error, INVALID_BOOLEAN_LITERAL))
+      return false;
 
-  if (lineCount == 0 && charCount == 0 && error)
+    token->endPos = lexer->pos;
+    lexer->charCount += 3;
+  }
+  else if (c == 'f')
   {
-    error->type = EMPTY_FILE;
-    error->charCount = 0;
-    error->lineCount = 0;
+    token->type = BOOLEAN_LEX;
+
+    if (!matchLiteral(json, length, &lexer->pos, "alse", error, INVALID_BOOLEAN_LITERAL))
+      return false;
+
+    token->endPos = lexer->pos;
+    lexer->charCount += 4;
   }
+  else if (c == 'n')
+  {
+    token->type = NULL_LEX;
 
+    if (!matchLiteral(json, length, &lexer->pos, "ull", error, INVALID_NULL_LITERAL))
+      return false;
+
+    token->endPos = lexer->pos;
+    lexer->charCount += 3;
+  }
+  else
+  {
+    error->type = UNEXPECTED_CHARACTER;
+    return false;
+  }
+
+  return true;
+}
+
+bool lexNextToken(Lexer* lexer, Token* token)
+{
+  if (!scanToken(lexer, token))
+    return false;
+
+  if (lexer->stats != NULL)
+    lexer->stats->tokens[token->type]++;
+  return true;
+}
+
+TokenManager* lexTokens(Lexer* lexer, LexError* error)
+{
+  TokenManager* manager = createTokenManager();
+  lexTokensInto(lexer, manager, error);
   return manager;
-}
\ No newline at end of file
+}
+
+void lexTokensInto(Lexer* lexer, TokenManager* manager, LexError* error)
+{
+  Token token;
+  while (lexNextToken(lexer, &token))
+    *createToken(manager) = token;
+
+  if (error)
+    *error = lexer->error;
+}
+
+TokenManager* lex(const char* json, size_t length, LexError* error)
+{
+  // First stage: the lexer finds the position of every token with SIMD
+  // classification, second stage: each position is turned into a token
+  Lexer lexer;
+  initLexer(&lexer, json, length);
+
+  TokenManager* manager = lexTokens(&lexer, error);
+
+  clearLexer(&lexer);
+  return manager;
+}
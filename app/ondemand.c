@@ -0,0 +1,506 @@
+#include "json-parser.h"
+#include "utils.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Keys up to this size are decoded on the stack when they are compared
+#define ONDEMAND_KEY_BUFFER 128
+
+/**
+ * DOCUMENT
+ */
+
+static void setOffsetPosition(const char* data, size_t offset, size_t* lineCount, size_t* charCount)
+{
+  size_t lineStart = 0;
+  *lineCount = 1;
+  for (size_t i = 0; i < offset; i++)
+  {
+    if (data[i] == '\n')
+    {
+      (*lineCount)++;
+      lineStart = i + 1;
+    }
+  }
+  *charCount = offset - lineStart + 1;
+}
+
+static char* buildDocumentParseError(const char* data, size_t offset, ParserErrorType type)
+{
+  ParserError error;
+  error.type = type;
+  error.token.startPos = offset;
+  error.token.endPos = offset;
+  setOffsetPosition(data, offset, &error.token.lineCount, &error.token.charCount);
+  return buildParseStringError(&error);
+}
+
+static char* buildDocumentLexError(const char* data, size_t offset, LexErrorType type)
+{
+  LexError error;
+  error.type = type;
+  setOffsetPosition(data, offset, &error.lineCount, &error.charCount);
+  return buildLexStringError(&error);
+}
+
+/**
+ * Matches the brackets of the root value, so that every container can be
+ * skipped in constant time. Returns the error message if the root is not a
+ * single value with balanced brackets and closed strings.
+ */
+static char* matchBrackets(JsonDocument* document)
+{
+  const char* data = document->data;
+  const size_t* offsets = document->offsets;
+  size_t* opens = NULL;
+  size_t capacity = 0;
+  size_t depth = 0;
+  size_t i = 0;
+  char* error = NULL;
+
+  for (; i < document->size; i++)
+  {
+    char c = data[offsets[i]];
+    if (c == '"')
+    {
+      // The index holds the closing quote as well
+      if (++i == document->size)
+      {
+        error = buildDocumentLexError(data, offsets[i - 1], EXPECTED_END_OF_STRING);
+        break;
+      }
+    }
+    else if (c == '[' || c == '{')
+    {
+      opens = (size_t*)vec_alloc(opens, &capacity, depth + 1, sizeof(size_t));
+      opens[depth++] = i;
+    }
+    else if (c == ']' || c == '}')
+    {
+      if (depth == 0)
+      {
+        error = buildDocumentParseError(data, offsets[i], UNEXPECTED_TOKEN);
+        break;
+      }
+
+      size_t open = opens[--depth];
+      if ((c == ']') != (data[offsets[open]] == '['))
+      {
+        error = buildDocumentParseError(data, offsets[i], data[offsets[open]] == '[' ? EXPECTED_END_OF_ARRAY_BRACE : EXPECTED_END_OF_OBJECT_BRACE);
+        break;
+      }
+      document->ends[open] = i + 1;
+    }
+
+    if (depth == 0)
+    {
+      i++;
+      break;
+    }
+  }
+
+  if (error == NULL && depth > 0)
+    error = buildDocumentParseError(data, document->length, data[offsets[opens[depth - 1]]] == '[' ? EXPECTED_END_OF_ARRAY_BRACE : EXPECTED_END_OF_OBJECT_BRACE);
+  else if (error == NULL && i < document->size)
+    error = buildDocumentParseError(data, offsets[i], UNEXPECTED_TOKEN);
+
+  free(opens);
+  return error;
+}
+
+JsonDocument* createJsonDocument(const char* data, size_t length, char** strError)
+{
+  StructuralIndex* index = createStructuralIndex();
+  indexStructurals(index, data, length, length);
+
+  if (index->size == 0)
+  {
+    if (strError != NULL)
+      *strError = buildDocumentLexError(data, 0, EMPTY_FILE);
+    deleteStructuralIndex(index);
+    return NULL;
+  }
+
+  JsonDocument* document = (JsonDocument*)malloc(sizeof(JsonDocument));
+  document->data = data;
+  document->length = length;
+  document->offsets = index->offsets;
+  document->size = index->size;
+  document->ends = (size_t*)malloc(index->size * sizeof(size_t));
+
+  // The offsets now belong to the document
+  index->offsets = NULL;
+  deleteStructuralIndex(index);
+
+  char* error = matchBrackets(document);
+  if (error != NULL)
+  {
+    if (strError != NULL)
+      *strError = error;
+    else
+      free(error);
+    deleteJsonDocument(document);
+    return NULL;
+  }
+
+  return document;
+}
+
+void deleteJsonDocument(JsonDocument* document)
+{
+  if (document == NULL)
+    return;
+
+  free(document->offsets);
+  free(document->ends);
+  free(document);
+}
+
+JsonCursor jsonDocumentRoot(const JsonDocument* document)
+{
+  JsonCursor cursor;
+  cursor.document = document;
+  cursor.pos = 0;
+  cursor.member = false;
+  return cursor;
+}
+
+/**
+ * CURSOR
+ */
+
+static char cursorChar(const JsonDocument* document, size_t pos)
+{
+  return pos < document->size ? document->data[document->offsets[pos]] : '\0';
+}
+
+/**
+ * Position that follows the value at pos, its subtree is never read.
+ */
+static size_t skipValue(const JsonDocument* document, size_t pos)
+{
+  char c = cursorChar(document, pos);
+  if (c == '[' || c == '{')
+    return document->ends[pos];
+  if (c == '"')
+    return pos + 2;
+  return pos + 1;
+}
+
+/**
+ * Bytes of the number or literal at pos, up to the next structural
+ * character without the whitespace before it.
+ */
+static const char* scalarBytes(JsonCursor cursor, size_t* length)
+{
+  const JsonDocument* document = cursor.document;
+  size_t start = document->offsets[cursor.pos];
+  size_t end = cursor.pos + 1 < document->size ? document->offsets[cursor.pos + 1] : document->length;
+  while (end > start && isspace((unsigned char)document->data[end - 1]))
+    end--;
+
+  *length = end - start;
+  return document->data + start;
+}
+
+static bool isValueStart(char c)
+{
+  return c != '\0' && c != ']' && c != '}' && c != ',' && c != ':';
+}
+
+/**
+ * Points cursor at the value of the member whose key starts at pos.
+ */
+static bool enterMember(JsonCursor* cursor, size_t pos)
+{
+  const JsonDocument* document = cursor->document;
+  if (cursorChar(document, pos) != '"' || cursorChar(document, pos + 2) != ':' || !isValueStart(cursorChar(document, pos + 3)))
+    return false;
+
+  cursor->pos = pos + 3;
+  cursor->member = true;
+  return true;
+}
+
+JsonNodeType jsonCursorType(JsonCursor cursor)
+{
+  switch (cursorChar(cursor.document, cursor.pos))
+  {
+  case '{':
+    return OBJECT_NODE;
+  case '[':
+    return ARRAY_NODE;
+  case '"':
+    return STRING_NODE;
+  case 't':
+  case 'f':
+    return BOOLEAN_NODE;
+  case '-':
+  case '0':
+  case '1':
+  case '2':
+  case '3':
+  case '4':
+  case '5':
+  case '6':
+  case '7':
+  case '8':
+  case '9':
+  {
+    size_t length;
+    const char* bytes = scalarBytes(cursor, &length);
+    for (size_t i = 0; i < length; i++)
+      if (bytes[i] == '.' || bytes[i] == 'e' || bytes[i] == 'E')
+        return DOUBLE_NODE;
+    return INTEGER_NODE;
+  }
+  default:
+    return NULL_NODE;
+  }
+}
+
+bool jsonCursorChild(JsonCursor container, JsonCursor* child)
+{
+  const JsonDocument* document = container.document;
+  char c = cursorChar(document, container.pos);
+  size_t first = container.pos + 1;
+
+  *child = container;
+  if (c == '[')
+  {
+    if (!isValueStart(cursorChar(document, first)))
+      return false;
+    child->pos = first;
+    child->member = false;
+    return true;
+  }
+  if (c == '{')
+    return cursorChar(document, first) != '}' && enterMember(child, first);
+  return false;
+}
+
+bool jsonCursorNext(JsonCursor* cursor)
+{
+  const JsonDocument* document = cursor->document;
+
+  // The root has no siblings
+  if (cursor->pos == 0)
+    return false;
+
+  size_t next = skipValue(document, cursor->pos);
+  if (cursorChar(document, next) != ',')
+    return false;
+
+  if (cursor->member)
+    return enterMember(cursor, next + 1);
+
+  if (!isValueStart(cursorChar(document, next + 1)))
+    return false;
+  cursor->pos = next + 1;
+  return true;
+}
+
+bool jsonCursorKey(JsonCursor member, const char** key, size_t* length)
+{
+  if (!member.member)
+    return false;
+
+  const size_t* offsets = member.document->offsets;
+  *key = member.document->data + offsets[member.pos - 3] + 1;
+  *length = offsets[member.pos - 2] - offsets[member.pos - 3] - 1;
+  return true;
+}
+
+/**
+ * Compares a raw key with the decoded key, decoding only keys that have
+ * escape sequences.
+ */
+static bool rawKeyEquals(const char* raw, size_t rawLength, const char* key, size_t length)
+{
+  if (isPlainJsonString(raw, rawLength))
+    return rawLength == length && memcmp(raw, key, length) == 0;
+
+  // Decoding never makes a key longer
+  if (length > rawLength)
+    return false;
+
+  char buffer[ONDEMAND_KEY_BUFFER];
+  char* decoded = rawLength < ONDEMAND_KEY_BUFFER ? buffer : (char*)malloc(rawLength + 1);
+  size_t decodedLength;
+  size_t errorOffset;
+  bool equals = decodeJsonString(raw, rawLength, decoded, &decodedLength, &errorOffset) == NO_PARSER_ERROR &&
+                decodedLength == length && memcmp(decoded, key, length) == 0;
+
+  if (decoded != buffer)
+    free(decoded);
+  return equals;
+}
+
+bool jsonCursorFind(JsonCursor object, const char* key, size_t length, JsonCursor* value)
+{
+  if (cursorChar(object.document, object.pos) != '{')
+    return false;
+
+  JsonCursor member;
+  bool found = jsonCursorChild(object, &member);
+  while (found)
+  {
+    const char* memberKey;
+    size_t memberLength;
+    if (!jsonCursorKey(member, &memberKey, &memberLength))
+      return false;
+    if (rawKeyEquals(memberKey, memberLength, key, length))
+    {
+      *value = member;
+      return true;
+    }
+    found = jsonCursorNext(&member);
+  }
+
+  return false;
+}
+
+bool jsonCursorAt(JsonCursor array, size_t index, JsonCursor* value)
+{
+  if (cursorChar(array.document, array.pos) != '[')
+    return false;
+
+  JsonCursor element;
+  bool found = jsonCursorChild(array, &element);
+  for (size_t i = 0; found && i < index; i++)
+    found = jsonCursorNext(&element);
+
+  if (found)
+    *value = element;
+  return found;
+}
+
+/**
+ * VALUES
+ */
+
+bool jsonCursorInt64(JsonCursor cursor, int64_t* value)
+{
+  size_t length;
+  const char* bytes = scalarBytes(cursor, &length);
+
+  JsonNodeType type;
+  JsonValue number;
+  if (!parseJsonNumber(bytes, length, &type, &number) || type != INTEGER_NODE)
+    return false;
+
+  *value = number.v_int;
+  return true;
+}
+
+bool jsonCursorDouble(JsonCursor cursor, double* value)
+{
+  size_t length;
+  const char* bytes = scalarBytes(cursor, &length);
+
+  JsonNodeType type;
+  JsonValue number;
+  if (!parseJsonNumber(bytes, length, &type, &number))
+    return false;
+
+  *value = type == INTEGER_NODE ? (double)number.v_int : number.v_double;
+  return true;
+}
+
+bool jsonCursorBoolean(JsonCursor cursor, bool* value)
+{
+  size_t length;
+  const char* bytes = scalarBytes(cursor, &length);
+
+  if (length == 4 && memcmp(bytes, "true", 4) == 0)
+    *value = true;
+  else if (length == 5 && memcmp(bytes, "false", 5) == 0)
+    *value = false;
+  else
+    return false;
+  return true;
+}
+
+bool jsonCursorIsNull(JsonCursor cursor)
+{
+  size_t length;
+  const char* bytes = scalarBytes(cursor, &length);
+  return length == 4 && memcmp(bytes, "null", 4) == 0;
+}
+
+const char* jsonCursorRawString(JsonCursor cursor, size_t* length)
+{
+  const JsonDocument* document = cursor.document;
+  if (cursorChar(document, cursor.pos) != '"')
+    return NULL;
+
+  size_t start = document->offsets[cursor.pos] + 1;
+  *length = document->offsets[cursor.pos + 1] - start;
+  return document->data + start;
+}
+
+char* jsonCursorString(JsonCursor cursor, size_t* length)
+{
+  size_t rawLength;
+  const char* raw = jsonCursorRawString(cursor, &rawLength);
+  if (raw == NULL)
+    return NULL;
+
+  char* str = (char*)malloc(rawLength + 1);
+  size_t strLength;
+  size_t errorOffset;
+  if (decodeJsonString(raw, rawLength, str, &strLength, &errorOffset) != NO_PARSER_ERROR)
+  {
+    free(str);
+    return NULL;
+  }
+
+  if (length != NULL)
+    *length = strLength;
+  return str;
+}
+
+JsonNode* jsonCursorToTree(JsonCursor cursor, char** strError)
+{
+  const JsonDocument* document = cursor.document;
+  size_t start = document->offsets[cursor.pos];
+  size_t end;
+
+  char c = cursorChar(document, cursor.pos);
+  if (c == '[' || c == '{')
+  {
+    end = document->offsets[document->ends[cursor.pos] - 1] + 1;
+  }
+  else if (c == '"')
+  {
+    end = document->offsets[cursor.pos + 1] + 1;
+  }
+  else
+  {
+    size_t length;
+    scalarBytes(cursor, &length);
+    end = start + length;
+  }
+
+  return parseJsonBuffer(document->data + start, end - start, strError);
+}
+
+bool evalJsonPathCursor(const JsonPath* path, JsonCursor root, JsonCursor* result)
+{
+  JsonCursor cursor = root;
+  for (size_t s = 0; s < path->size; s++)
+  {
+    const JsonPathStep* step = &path->steps[s];
+    if (jsonCursorType(cursor) == ARRAY_NODE && step->index == JSON_PATH_NO_INDEX)
+      return false;
+
+    bool found = jsonCursorType(cursor) == OBJECT_NODE ? jsonCursorFind(cursor, step->key, step->length, &cursor)
+                                                       : jsonCursorAt(cursor, step->index, &cursor);
+    if (!found)
+      return false;
+  }
+
+  *result = cursor;
+  return true;
+}
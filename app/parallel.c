@@ -0,0 +1,388 @@
+#include "json-parser.h"
+#include "utils.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Smaller inputs are parsed faster than the threads can be started
+#define PARALLEL_MIN_SIZE (1024 * 1024)
+
+// Chunks per thread, so that a thread that got cheap elements takes more
+#define PARALLEL_CHUNKS_PER_THREAD 8
+
+// Lower bound of the chunk size, keeps the per chunk setup negligible
+#define PARALLEL_MIN_CHUNK_SIZE (64 * 1024)
+
+// Input indexed at a time by the pre-pass
+#define PARALLEL_INDEX_SIZE (64 * 1024)
+
+/**
+ * Elements of the root array between start and end (a top-level ',' or
+ * the closing ']'), stored from elements[first] on.
+ */
+typedef struct ParallelChunk
+{
+  size_t start;
+  size_t end;
+  size_t first;
+  size_t count;
+  bool parsed; // Written by its worker, read after the join
+} ParallelChunk;
+
+typedef struct ParallelJob
+{
+  const char* data;
+  const ParserOptions* options;
+  ParallelChunk* chunks;
+  size_t chunkCount;
+  size_t nextChunk; // Atomic, next chunk to hand out
+  bool failed;      // Atomic, stops the workers at the first invalid chunk
+  JsonNode* elements;
+} ParallelJob;
+
+typedef struct ParallelWorker
+{
+  ParallelJob* job;
+  JsonArena* arena; // Private arena, NULL when the tree uses malloc
+  ParseStats stats; // Private statistics, used only if they are requested
+  pthread_t thread;
+} ParallelWorker;
+
+/**
+ * PRE-PASS
+ */
+
+typedef struct ArraySplitter
+{
+  const char* data;
+  size_t length;
+  StructuralIndex* index;
+  size_t next;
+} ArraySplitter;
+
+static bool nextArrayStructural(ArraySplitter* splitter, size_t* offset)
+{
+  StructuralIndex* index = splitter->index;
+  while (splitter->next >= index->size)
+  {
+    if (index->scanned >= splitter->length)
+      return false;
+
+    index->size = 0;
+    splitter->next = 0;
+    indexStructurals(index, splitter->data, splitter->length, PARALLEL_INDEX_SIZE);
+  }
+
+  *offset = index->offsets[splitter->next++];
+  return true;
+}
+
+/**
+ * Splits the elements of the root array into chunks of about chunkSize
+ * bytes by following the nesting of the structural characters. The index
+ * already skips the content of the strings, whose closing quote is the only
+ * position to drop. Returns false if the input is not a closed array,
+ * otherwise tail is the offset right after its closing ']'.
+ */
+static bool splitRootArray(const char* data, size_t length, size_t chunkSize, ParallelChunk** chunks, size_t* chunkCount, size_t* tail)
+{
+  ArraySplitter splitter;
+  splitter.data = data;
+  splitter.length = length;
+  splitter.index = createStructuralIndex();
+  splitter.next = 0;
+
+  size_t capacity = 0;
+  size_t start = 0;
+  size_t commas = 0;
+  size_t depth = 0;
+  size_t offset;
+  bool closed = false;
+
+  *chunks = NULL;
+  *chunkCount = 0;
+
+  if (nextArrayStructural(&splitter, &offset) && data[offset] == '[')
+  {
+    start = offset + 1;
+    depth = 1;
+  }
+
+  while (depth > 0 && nextArrayStructural(&splitter, &offset))
+  {
+    char c = data[offset];
+    if (c == '"')
+    {
+      size_t closing;
+      if (!nextArrayStructural(&splitter, &closing))
+        break;
+      continue;
+    }
+    if (c == '[' || c == '{')
+    {
+      depth++;
+      continue;
+    }
+
+    // A chunk ends at a top-level comma once it is big enough, or at the
+    // closing bracket of the root
+    if (c == ']' || c == '}')
+    {
+      if (--depth > 0)
+        continue;
+      if (c != ']')
+        break;
+    }
+    else if (c == ',' && depth == 1)
+    {
+      commas++;
+      if (offset - start < chunkSize)
+        continue;
+    }
+    else
+    {
+      continue;
+    }
+
+    (*chunkCount)++;
+    *chunks = (ParallelChunk*)vec_alloc(*chunks, &capacity, *chunkCount, sizeof(ParallelChunk));
+    ParallelChunk* chunk = &(*chunks)[*chunkCount - 1];
+    chunk->start = start;
+    chunk->end = offset;
+    chunk->count = depth == 0 ? commas + 1 : commas;
+    chunk->first = *chunkCount > 1 ? chunk[-1].first + chunk[-1].count : 0;
+    chunk->parsed = false;
+
+    start = offset + 1;
+    commas = 0;
+    closed = depth == 0;
+  }
+
+  *tail = start;
+  deleteStructuralIndex(splitter.index);
+  return closed;
+}
+
+/**
+ * PARSING
+ */
+
+static void freeChunkValues(ParallelJob* job, ParallelChunk* chunk, size_t count)
+{
+  // Arena values are released together with the arena
+  if (job->options->arena != NULL)
+    return;
+
+  for (size_t i = 0; i < count; i++)
+    freeJsonTree(&job->elements[chunk->first + i]);
+}
+
+static bool parseChunk(ParallelJob* job, ParallelChunk* chunk, ParallelWorker* worker)
+{
+  const char* json = job->data + chunk->start;
+  ParseStats* stats = job->options->stats != NULL ? &worker->stats : NULL;
+
+  Lexer lexer;
+  initLexer(&lexer, json, chunk->end - chunk->start);
+  lexer.hashStrings = job->options->indexObjects;
+  lexer.stats = stats;
+  TokenManager* manager = createTokenStream(&lexer);
+
+  ParseContext context;
+  initParseContext(&context, json, manager, worker->arena);
+  context.indexObjects = job->options->indexObjects;
+  context.stats = stats;
+
+  ParserError error;
+  error.type = NO_PARSER_ERROR;
+  size_t count = parseArrayValues(&context, job->elements + chunk->first, chunk->count, &error);
+
+  Token token;
+  while (lexNextToken(&lexer, &token))
+    ;
+
+  bool success = lexer.error.type == NO_LEX_ERROR && error.type == NO_PARSER_ERROR && count == chunk->count;
+  if (!success)
+    freeChunkValues(job, chunk, count);
+  chunk->parsed = success;
+
+  clearParseContext(&context);
+  clearLexer(&lexer);
+  deleteTokenManager(manager);
+  return success;
+}
+
+static void* runParallelWorker(void* arg)
+{
+  ParallelWorker* worker = (ParallelWorker*)arg;
+  ParallelJob* job = worker->job;
+  size_t reallocations = vecReallocationCount();
+
+  while (!__atomic_load_n(&job->failed, __ATOMIC_RELAXED))
+  {
+    size_t i = __atomic_fetch_add(&job->nextChunk, 1, __ATOMIC_RELAXED);
+    if (i >= job->chunkCount)
+      break;
+
+    if (!parseChunk(job, &job->chunks[i], worker))
+      __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+  }
+
+  worker->stats.reallocations += vecReallocationCount() - reallocations;
+  return NULL;
+}
+
+/**
+ * Adds the statistics of a worker, whose containers are all one level below
+ * the root array.
+ */
+static void mergeParseStats(ParseStats* stats, const ParseStats* worker)
+{
+  for (size_t i = 0; i <= CURLY_CLOSE; i++)
+    stats->tokens[i] += worker->tokens[i];
+  for (size_t i = 0; i <= DOUBLE_ARRAY_NODE; i++)
+    stats->nodes[i] += worker->nodes[i];
+  if (worker->maxDepth + 1 > stats->maxDepth)
+    stats->maxDepth = worker->maxDepth + 1;
+  stats->reallocations += worker->reallocations;
+  stats->bytesAllocated += worker->bytesAllocated;
+}
+
+/**
+ * Lexes what follows the root array, lexical errors there make the whole
+ * input invalid like in parseJsonBuffer.
+ */
+static bool isValidTail(const char* data, size_t length)
+{
+  Lexer lexer;
+  initLexer(&lexer, data, length);
+
+  Token token;
+  while (lexNextToken(&lexer, &token))
+    ;
+
+  // An empty tail is not an empty file
+  bool valid = lexer.error.type == NO_LEX_ERROR || lexer.error.type == EMPTY_FILE;
+  clearLexer(&lexer);
+  return valid;
+}
+
+bool parseJsonArrayParallel(const char* data, size_t length, const ParserOptions* options, JsonNode** root)
+{
+  size_t threads = options->threads > 0 ? options->threads : countProcessors();
+  // The key table is not thread-safe, projections select elements by index
+  // and a root array of numbers should be packed as a whole
+  if (threads <= 1 || length < PARALLEL_MIN_SIZE || options->keys != NULL || options->projection != NULL ||
+      options->packNumbers)
+    return false;
+
+  ParseStats* stats = options->stats;
+  double clock = stats != NULL ? monotonicSeconds() : 0;
+
+  size_t chunkSize = length / (threads * PARALLEL_CHUNKS_PER_THREAD);
+  if (chunkSize < PARALLEL_MIN_CHUNK_SIZE)
+    chunkSize = PARALLEL_MIN_CHUNK_SIZE;
+
+  ParallelJob job;
+  job.data = data;
+  job.options = options;
+  job.nextChunk = 0;
+  job.failed = false;
+  job.elements = NULL;
+
+  size_t tail;
+  if (!splitRootArray(data, length, chunkSize, &job.chunks, &job.chunkCount, &tail) || job.chunkCount < 2 ||
+      !isValidTail(data + tail, length - tail))
+  {
+    free(job.chunks);
+    return false;
+  }
+
+  double splitSeconds = stats != NULL ? lapSeconds(&clock) : 0;
+
+  ParallelChunk* lastChunk = &job.chunks[job.chunkCount - 1];
+  size_t elementCount = lastChunk->first + lastChunk->count;
+  if (options->arena != NULL)
+    job.elements = (JsonNode*)arenaAlloc(options->arena, elementCount * sizeof(JsonNode));
+  else
+    job.elements = (JsonNode*)malloc(elementCount * sizeof(JsonNode));
+
+  if (threads > job.chunkCount)
+    threads = job.chunkCount;
+
+  ParallelWorker* workers = (ParallelWorker*)malloc(threads * sizeof(ParallelWorker));
+  size_t started = 0;
+  for (size_t i = 0; i < threads; i++)
+  {
+    workers[i].job = &job;
+    workers[i].arena = options->arena != NULL ? createJsonArena(options->arena->blockSize) : NULL;
+    initParseStats(&workers[i].stats);
+  }
+
+  // The calling thread is the first worker
+  for (size_t i = 1; i < threads; i++)
+  {
+    if (pthread_create(&workers[i].thread, NULL, runParallelWorker, &workers[i]) != 0)
+      break;
+    started++;
+  }
+  runParallelWorker(&workers[0]);
+  for (size_t i = 1; i <= started; i++)
+    pthread_join(workers[i].thread, NULL);
+
+  bool success = !job.failed;
+  if (!success)
+  {
+    for (size_t i = 0; i < job.chunkCount; i++)
+      if (job.chunks[i].parsed)
+        freeChunkValues(&job, &job.chunks[i], job.chunks[i].count);
+    if (options->arena == NULL)
+      free(job.elements);
+  }
+
+  for (size_t i = 0; i < threads; i++)
+  {
+    if (workers[i].arena == NULL)
+      continue;
+    if (success)
+      mergeJsonArena(options->arena, workers[i].arena);
+    else
+      deleteJsonArena(workers[i].arena);
+  }
+
+  if (success && stats != NULL)
+  {
+    for (size_t i = 0; i < threads; i++)
+      mergeParseStats(stats, &workers[i].stats);
+
+    // The root array itself, whose brackets and chunk separators were
+    // never seen by the workers
+    stats->tokens[BRACKET_OPEN]++;
+    stats->tokens[BRACKET_CLOSE]++;
+    stats->tokens[COMMA] += job.chunkCount - 1;
+    stats->nodes[ARRAY_NODE]++;
+    stats->bytesAllocated += (elementCount + 1) * sizeof(JsonNode);
+    stats->lexSeconds += splitSeconds;
+    stats->parseSeconds += lapSeconds(&clock);
+  }
+
+  free(workers);
+  free(job.chunks);
+  if (!success)
+    return false;
+
+  JsonNode* node;
+  if (options->arena != NULL)
+    node = (JsonNode*)arenaAlloc(options->arena, sizeof(JsonNode));
+  else
+    node = (JsonNode*)malloc(sizeof(JsonNode));
+
+  initJsonNode(node, ARRAY_NODE);
+  node->isRoot = true;
+  node->inArena = options->arena != NULL;
+  node->value.v_array = job.elements;
+  node->vSize = elementCount;
+  node->vCapacity = elementCount;
+  *root = node;
+  return true;
+}
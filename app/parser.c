@@ -4,98 +4,593 @@
 #include <stdlib.h>
 #include <string.h>
 
-JsonNode* createJsonNode(JsonNodeType type)
+void initJsonNode(JsonNode* node, JsonNodeType type)
 {
-  JsonNode* node = (JsonNode*)malloc(sizeof(JsonNode));
   node->type = type;
+  node->keyHash = 0;
   node->key = NULL;
   node->value.v_object = NULL;
   node->isRoot = false;
+  node->inArena = false;
+  node->keyInterned = false;
+  node->stringInline = false;
+  node->keyInSitu = false;
+  node->stringInSitu = false;
   node->vCapacity = 0;
   node->vSize = 0;
+  node->index = NULL;
+}
+
+JsonNode* createJsonNode(JsonNodeType type)
+{
+  JsonNode* node = (JsonNode*)malloc(sizeof(JsonNode));
+  initJsonNode(node, type);
   return node;
 }
 
+const char* jsonNodeString(const JsonNode* node)
+{
+  return node->stringInline ? node->inlineString : node->value.v_string;
+}
+
+const int64_t* jsonNodeIntegers(const JsonNode* node)
+{
+  return node->type == INTEGER_ARRAY_NODE ? node->value.v_integers : NULL;
+}
+
+const double* jsonNodeDoubles(const JsonNode* node)
+{
+  return node->type == DOUBLE_ARRAY_NODE ? node->value.v_doubles : NULL;
+}
+
+void setJsonNodeString(JsonNode* node, const char* str, size_t length)
+{
+  char* copy;
+  node->stringInline = length < JSON_INLINE_STRING_SIZE;
+  if (node->stringInline)
+    copy = node->inlineString;
+  else
+    copy = node->value.v_string = (char*)malloc(length + 1);
+
+  memcpy(copy, str, length);
+  copy[length] = '\0';
+}
+
+JsonNode* reserveJsonChildren(JsonNode* node, size_t size)
+{
+  // The new children would not be found through the old index, and the
+  // next lookup rebuilds it
+  dropJsonObjectIndex(node);
+
+  size_t capacity = node->vCapacity;
+  node->value.v_object = (JsonNode*)vec_alloc(node->value.v_object, &capacity, size, sizeof(JsonNode));
+  node->vCapacity = (uint32_t)capacity;
+  return node->value.v_object;
+}
+
+/**
+ * Returns where the token at pos is kept, streams only keep the last ones.
+ */
+static size_t tokenSlot(const TokenManager* manager, size_t pos)
+{
+  if (manager->lexer == NULL && manager->pipeline == NULL)
+    return pos;
+  return pos % manager->capacity;
+}
+
 Token* advance(TokenManager* manager)
 {
   if (manager->pos >= manager->size)
-    return NULL;
+  {
+    // Token streams pull the next token into their ring buffer, from the
+    // lexer or from the thread that runs it
+    Token* token = manager->tokens + tokenSlot(manager, manager->size);
+    if (manager->pipeline != NULL)
+    {
+      if (!nextPipelineToken(manager->pipeline, token))
+        return NULL;
+    }
+    else if (manager->lexer == NULL || !lexNextToken(manager->lexer, token))
+    {
+      return NULL;
+    }
+    manager->size++;
+  }
 
-  Token* token = manager->tokens + manager->pos;
+  Token* token = manager->tokens + tokenSlot(manager, manager->pos);
   manager->pos++;
   return token;
 }
 
-JsonNode* parseJsonFile(const char* filename, char** strError)
+Token* previousToken(const TokenManager* manager)
 {
-  FILE* jsonFile = fopen(filename, "r");
+  if (manager->pos == 0)
+    return NULL;
+  return manager->tokens + tokenSlot(manager, manager->pos - 1);
+}
+
+static void* allocBytes(ParseContext* context, size_t size)
+{
+  if (context->stats != NULL)
+    context->stats->bytesAllocated += size;
+
+  if (context->arena != NULL)
+    return arenaAlloc(context->arena, size);
+  return malloc(size);
+}
+
+static JsonNode* allocNode(ParseContext* context, JsonNodeType type)
+{
+  // Value nodes only live until they are copied into their parent, so they
+  // are recycled through a free list instead of being freed
+  JsonNode* node = context->freeNodes;
+  if (node != NULL)
+    context->freeNodes = node->value.v_object;
+  else
+    node = (JsonNode*)allocBytes(context, sizeof(JsonNode));
 
-  if (!jsonFile)
+  if (context->stats != NULL)
+    context->stats->nodes[type]++;
+
+  initJsonNode(node, type);
+  node->inArena = context->arena != NULL;
+  return node;
+}
+
+static void releaseNode(ParseContext* context, JsonNode* node)
+{
+  node->value.v_object = context->freeNodes;
+  context->freeNodes = node;
+}
+
+static void freeBytes(ParseContext* context, void* ptr)
+{
+  if (context->arena == NULL)
+    free(ptr);
+}
+
+static void dropFreeNodes(ParseContext* context)
+{
+  if (context->arena == NULL)
   {
-    if (strError != NULL)
-      *strError = vstrdup("Error: Cannot open file '%s'", filename);
-    return NULL;
+    while (context->freeNodes != NULL)
+    {
+      JsonNode* next = context->freeNodes->value.v_object;
+      free(context->freeNodes);
+      context->freeNodes = next;
+    }
   }
+  context->freeNodes = NULL;
+}
+
+void initParseContext(ParseContext* context, const char* json, TokenManager* manager, JsonArena* arena)
+{
+  context->arena = NULL;
+  context->freeNodes = NULL;
+  context->stack = NULL;
+  context->stackCapacity = 0;
+  context->scratch = NULL;
+  context->scratchCapacity = 0;
+  context->numbers = NULL;
+  context->numbersCapacity = 0;
+  resetParseContext(context, json, manager, arena);
+}
+
+void resetParseContext(ParseContext* context, const char* json, TokenManager* manager, JsonArena* arena)
+{
+  // Arena nodes do not outlive the tree they were allocated for
+  if (context->arena != NULL || arena != NULL)
+    dropFreeNodes(context);
+
+  context->json = json;
+  context->manager = manager;
+  context->arena = arena;
+  context->stackSize = 0;
+  context->indexObjects = false;
+  context->stats = NULL;
+  context->depth = 0;
+  context->keys = NULL;
+  context->projection = NULL;
+  context->projectionNode = 0;
+  context->inSitu = NULL;
+  context->packNumbers = false;
+}
+
+void clearParseContext(ParseContext* context)
+{
+  dropFreeNodes(context);
+
+  free(context->stack);
+  context->stack = NULL;
+  context->stackCapacity = 0;
+  context->stackSize = 0;
+
+  free(context->scratch);
+  context->scratch = NULL;
+  context->scratchCapacity = 0;
+
+  free(context->numbers);
+  context->numbers = NULL;
+  context->numbersCapacity = 0;
+}
 
+void initParseStats(ParseStats* stats)
+{
+  memset(stats, 0, sizeof(ParseStats));
+}
+
+void initParserOptions(ParserOptions* options)
+{
+  options->arena = NULL;
+  options->streamTokens = false;
+  options->indexObjects = false;
+  options->threads = 1;
+  options->lexAhead = 0;
+  options->stats = NULL;
+  options->keys = NULL;
+  options->projection = NULL;
+  options->packNumbers = false;
+}
+
+/**
+ * Parses data, decoding the strings into inSitu when it is not NULL. In
+ * that case data is inSitu itself. A reusable parser lends its lexer, token
+ * buffer and context, which are then kept instead of being released.
+ */
+static JsonNode* parseBuffer(const char* data, char* inSitu, size_t length, const ParserOptions* options, JsonParser* parser, char** strError)
+{
+  ParseStats* stats = options->stats;
+  size_t reallocations = 0;
+  double clock = 0;
+  if (stats != NULL)
+  {
+    stats->bytes += length;
+    reallocations = vecReallocationCount();
+    clock = monotonicSeconds();
+  }
+
+  // Invalid input falls through, so that its error is reported exactly,
+  // which in-situ parsing cannot do once the buffer has been decoded
+  JsonNode* parallelRoot;
+  if (options->threads != 1 && inSitu == NULL && parseJsonArrayParallel(data, length, options, &parallelRoot))
+  {
+    if (stats != NULL)
+      stats->reallocations += vecReallocationCount() - reallocations;
+    return parallelRoot;
+  }
+
+  Lexer localLexer;
+  Lexer* lexer = parser != NULL ? &parser->lexer : &localLexer;
   LexError lexError;
-  TokenManager* manager = lex(jsonFile, &lexError);
+  TokenManager* manager;
+  bool reusedTokens = false;
 
-  if (lexError.type != NO_LEX_ERROR)
+  if (parser != NULL)
+    resetLexer(lexer, data, length);
+  else
+    initLexer(lexer, data, length);
+  lexer->hashStrings = options->indexObjects;
+  lexer->stats = stats;
+
+  // Without a lexer thread the tokens are streamed by this one instead
+  manager = options->lexAhead > 0 ? createTokenPipeline(lexer, options->lexAhead) : NULL;
+  bool streamed = manager != NULL || options->streamTokens;
+
+  if (manager == NULL && streamed)
   {
-    if (strError != NULL)
-      *strError = buildLexStringError(&lexError);
-    deleteTokenManager(manager);
-    fclose(jsonFile);
-    return NULL;
+    manager = createTokenStream(lexer);
+  }
+  else if (manager == NULL)
+  {
+    if (parser != NULL)
+    {
+      manager = parser->tokens;
+      manager->size = 0;
+      manager->pos = 0;
+      reusedTokens = true;
+      lexTokensInto(lexer, manager, &lexError);
+    }
+    else
+    {
+      manager = lexTokens(lexer, &lexError);
+      clearLexer(lexer);
+    }
+    if (stats != NULL)
+      stats->lexSeconds += lapSeconds(&clock);
+
+    if (lexError.type != NO_LEX_ERROR)
+    {
+      if (strError != NULL)
+        *strError = buildLexStringError(&lexError);
+      if (!reusedTokens)
+        deleteTokenManager(manager);
+      if (stats != NULL)
+      {
+        stats->freeSeconds += lapSeconds(&clock);
+        stats->reallocations += vecReallocationCount() - reallocations;
+      }
+      return NULL;
+    }
   }
 
+  ParseContext localContext;
+  ParseContext* context = parser != NULL ? &parser->context : &localContext;
+  if (parser != NULL)
+    resetParseContext(context, data, manager, options->arena);
+  else
+    initParseContext(context, data, manager, options->arena);
+  context->indexObjects = options->indexObjects;
+  context->stats = stats;
+  context->keys = options->keys;
+  context->inSitu = inSitu;
+  context->packNumbers = options->packNumbers;
+  // A projection with an empty path keeps the whole document
+  if (options->projection != NULL && !options->projection->nodes[0].selected)
+    context->projection = options->projection;
+
   ParserError parserError;
-  JsonNode* root = parse(jsonFile, manager, &parserError);
+  JsonNode* root = parse(context, &parserError);
+
+  if (streamed)
+  {
+    // Lex what the parser did not read, lexical errors are reported first
+    // exactly as if all the tokens had been read upfront
+    while (advance(manager) != NULL)
+      ;
+    lexError = lexer->error;
+  }
+  if (stats != NULL)
+    stats->parseSeconds += lapSeconds(&clock);
 
-  if (parserError.type != NO_PARSER_ERROR)
+  if (lexError.type != NO_LEX_ERROR || parserError.type != NO_PARSER_ERROR)
   {
     if (strError != NULL)
-      *strError = buildParseStringError(&parserError);
-    freeJsonTree(root);
+      *strError = lexError.type != NO_LEX_ERROR ? buildLexStringError(&lexError) : buildParseStringError(&parserError);
+    // Arena nodes are released together with the arena
+    if (options->arena == NULL)
+      freeJsonTree(root);
     root = NULL;
   }
 
-  deleteTokenManager(manager);
-  fclose(jsonFile);
+  if (parser == NULL)
+    clearParseContext(context);
+  if (!reusedTokens)
+    deleteTokenManager(manager);
+  // The lexer thread, if any, has been stopped by deleteTokenManager
+  if (streamed && parser == NULL)
+    clearLexer(lexer);
+
+  if (stats != NULL)
+  {
+    stats->freeSeconds += lapSeconds(&clock);
+    stats->reallocations += vecReallocationCount() - reallocations;
+  }
   return root;
 }
 
-JsonNode* parse_helper(FILE* jsonFile, TokenManager* manager, ParserError* error)
+JsonNode* parseJsonBufferWithOptions(const char* data, size_t length, const ParserOptions* options, char** strError)
 {
-  if (error && error->type != NO_PARSER_ERROR)
+  return parseBuffer(data, NULL, length, options, NULL, strError);
+}
+
+JsonNode* parseJsonBufferInSitu(char* data, size_t length, const ParserOptions* options, char** strError)
+{
+  return parseBuffer(data, data, length, options, NULL, strError);
+}
+
+JsonNode* parseJsonBuffer(const char* data, size_t length, char** strError)
+{
+  ParserOptions options;
+  initParserOptions(&options);
+  return parseJsonBufferWithOptions(data, length, &options, strError);
+}
+
+JsonNode* parseJsonBufferArena(const char* data, size_t length, JsonArena* arena, char** strError)
+{
+  ParserOptions options;
+  initParserOptions(&options);
+  options.arena = arena;
+  return parseJsonBufferWithOptions(data, length, &options, strError);
+}
+
+JsonNode* parseJsonString(const char* str, char** strError)
+{
+  return parseJsonBuffer(str, strlen(str), strError);
+}
+
+JsonNode* parseJsonFileWithOptions(const char* filename, const ParserOptions* options, char** strError)
+{
+  FileBuffer jsonFile;
+  double clock = options->stats != NULL ? monotonicSeconds() : 0;
+
+  if (!openFileBuffer(filename, &jsonFile))
+  {
+    if (strError != NULL)
+      *strError = vstrdup("Error: Cannot open file '%s'", filename);
     return NULL;
+  }
+  if (options->stats != NULL)
+    options->stats->ioSeconds += lapSeconds(&clock);
+
+  JsonNode* root = parseJsonBufferWithOptions(jsonFile.data, jsonFile.length, options, strError);
+
+  if (options->stats != NULL)
+    clock = monotonicSeconds();
+  closeFileBuffer(&jsonFile);
+  if (options->stats != NULL)
+    options->stats->ioSeconds += lapSeconds(&clock);
+  return root;
+}
+
+JsonNode* parseJsonFile(const char* filename, char** strError)
+{
+  ParserOptions options;
+  initParserOptions(&options);
+  return parseJsonFileWithOptions(filename, &options, strError);
+}
+
+JsonNode* parseJsonFileArena(const char* filename, JsonArena* arena, char** strError)
+{
+  ParserOptions options;
+  initParserOptions(&options);
+  options.arena = arena;
+  return parseJsonFileWithOptions(filename, &options, strError);
+}
+
+JsonParser* createJsonParser(const ParserOptions* options, size_t retainLimit)
+{
+  JsonParser* parser = (JsonParser*)malloc(sizeof(JsonParser));
+  if (options != NULL)
+    parser->options = *options;
+  else
+    initParserOptions(&parser->options);
+
+  parser->arena = createJsonArena(0);
+  parser->options.arena = parser->arena;
+  initLexer(&parser->lexer, NULL, 0);
+  parser->tokens = createTokenManager();
+  initParseContext(&parser->context, NULL, NULL, parser->arena);
+  parser->retainLimit = retainLimit > 0 ? retainLimit : JSON_PARSER_RETAIN_LIMIT;
+  return parser;
+}
+
+void deleteJsonParser(JsonParser* parser)
+{
+  if (parser == NULL)
+    return;
+
+  clearParseContext(&parser->context);
+  deleteTokenManager(parser->tokens);
+  clearLexer(&parser->lexer);
+  deleteJsonArena(parser->arena);
+  free(parser);
+}
+
+/**
+ * Frees the buffers that grew past the retain limit, a document much
+ * bigger than the usual ones should not pin its memory.
+ */
+static void trimJsonParser(JsonParser* parser)
+{
+  size_t limit = parser->retainLimit;
+
+  TokenManager* tokens = parser->tokens;
+  if (tokens->capacity * sizeof(Token) > limit)
+  {
+    free(tokens->tokens);
+    tokens->tokens = NULL;
+    tokens->capacity = 0;
+  }
 
-  if (manager->size == 0 || manager->tokens == NULL)
+  StructuralIndex* index = parser->lexer.index;
+  if (index->capacity * sizeof(size_t) > limit)
   {
-    error->type = NO_TOKEN_FOUND;
+    free(index->offsets);
+    index->offsets = NULL;
+    index->capacity = 0;
+  }
+
+  ParseContext* context = &parser->context;
+  if (context->stackCapacity * sizeof(JsonNode) > limit)
+  {
+    free(context->stack);
+    context->stack = NULL;
+    context->stackCapacity = 0;
+  }
+  if (context->scratchCapacity > limit)
+  {
+    free(context->scratch);
+    context->scratch = NULL;
+    context->scratchCapacity = 0;
+  }
+  if (context->numbersCapacity * sizeof(JsonValue) > limit)
+  {
+    free(context->numbers);
+    context->numbers = NULL;
+    context->numbersCapacity = 0;
+  }
+}
+
+JsonNode* parseJsonBufferWithParser(JsonParser* parser, const char* data, size_t length, char** strError)
+{
+  // The previous tree goes away, its memory is kept for this one
+  resetJsonArena(parser->arena, parser->retainLimit);
+  JsonNode* root = parseBuffer(data, NULL, length, &parser->options, parser, strError);
+  trimJsonParser(parser);
+  return root;
+}
+
+JsonNode* parseJsonFileWithParser(JsonParser* parser, const char* filename, char** strError)
+{
+  ParseStats* stats = parser->options.stats;
+  FileBuffer jsonFile;
+  double clock = stats != NULL ? monotonicSeconds() : 0;
+
+  if (!openFileBuffer(filename, &jsonFile))
+  {
+    if (strError != NULL)
+      *strError = vstrdup("Error: Cannot open file '%s'", filename);
+    return NULL;
+  }
+  if (stats != NULL)
+    stats->ioSeconds += lapSeconds(&clock);
+
+  JsonNode* root = parseJsonBufferWithParser(parser, jsonFile.data, jsonFile.length, strError);
+
+  if (stats != NULL)
+    clock = monotonicSeconds();
+  closeFileBuffer(&jsonFile);
+  if (stats != NULL)
+    stats->ioSeconds += lapSeconds(&clock);
+  return root;
+}
+
+/**
+ * Reports a syntax error at token, or at the last token read when the input
+ * ended where a token was expected (e.g. "[1," or "{"a":1").
+ */
+static void setTokenError(TokenManager* manager, ParserErrorType type, Token* token, ParserError* error)
+{
+  if (error)
+  {
+    error->type = type;
     error->token.lineCount = 0;
     error->token.charCount = 0;
-    return NULL;
+
+    if (token == NULL)
+      token = previousToken(manager);
+    if (token != NULL)
+      error->token = *token;
   }
+}
+
+JsonNode* parse_helper(ParseContext* context, ParserError* error)
+{
+  if (error && error->type != NO_PARSER_ERROR)
+    return NULL;
 
+  TokenManager* manager = context->manager;
   Token* token = advance(manager);
   if (token == NULL)
+  {
+    setTokenError(manager, NO_TOKEN_FOUND, NULL, error);
     return NULL;
+  }
 
   if (token->type == CURLY_OPEN)
-    return parseObject(jsonFile, manager, error);
+    return parseObject(context, error);
   if (token->type == BRACKET_OPEN)
-    return parseArray(jsonFile, manager, error);
+    return parseArray(context, error);
   if (token->type == STRING_LEX)
-    return parseString(jsonFile, token);
+    return parseString(context, token, error);
   if (token->type == INTEGER_LEX)
-    return parseInteger(jsonFile, token, error);
+    return parseInteger(context, token, error);
   if (token->type == DOUBLE_LEX)
-    return parseDouble(jsonFile, token, error);
+    return parseDouble(context, token, error);
   if (token->type == BOOLEAN_LEX)
-    return parseBoolean(jsonFile, token);
+    return parseBoolean(context, token);
   if (token->type == NULL_LEX)
-    return parseNull(jsonFile, token);
+    return parseNull(context, token);
 
   if (error)
   {
@@ -105,11 +600,11 @@ JsonNode* parse_helper(FILE* jsonFile, TokenManager* manager, ParserError* error
   return NULL;
 }
 
-JsonNode* parse(FILE* jsonFile, TokenManager* manager, ParserError* error)
+JsonNode* parse(ParseContext* context, ParserError* error)
 {
   if (error)
     error->type = NO_PARSER_ERROR;
-  JsonNode* root = parse_helper(jsonFile, manager, error);
+  JsonNode* root = parse_helper(context, error);
   if (root != NULL)
     root->isRoot = true;
   return root;
@@ -118,25 +613,348 @@ JsonNode* parse(FILE* jsonFile, TokenManager* manager, ParserError* error)
 void addObjectPair(JsonNode* node, JsonNode* pairNode)
 {
   node->vSize++;
-  node->value.v_object = (JsonNode*)vec_alloc(node->value.v_object, &node->vCapacity, node->vSize, sizeof(JsonNode));
+  reserveJsonChildren(node, node->vSize);
   node->value.v_object[node->vSize - 1] = *pairNode;
 }
 
-JsonNode* parseObject(FILE* jsonFile, TokenManager* manager, ParserError* error)
+void addElement(JsonNode* node, JsonNode* elemNode)
+{
+  node->vSize++;
+  reserveJsonChildren(node, node->vSize);
+  node->value.v_array[node->vSize - 1] = *elemNode;
+}
+
+/**
+ * Decodes the content of a string token into dst, which has room for its
+ * raw bytes and the terminator.
+ */
+static bool decodeTokenString(ParseContext* context, Token* token, char* dst, size_t* strLength, ParserError* error)
+{
+  size_t errorOffset;
+  ParserErrorType errorType = decodeJsonString(context->json + token->startPos + 1, token->endPos - token->startPos - 1, dst, strLength, &errorOffset);
+  if (errorType != NO_PARSER_ERROR)
+  {
+    if (error)
+    {
+      // Strings never span lines, the column of the bad byte is exact
+      error->type = errorType;
+      error->token = *token;
+      error->token.charCount += errorOffset + 1;
+    }
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Decodes a string token into memory allocated by the context. Decoding
+ * never makes a string longer, so the raw length is enough: in-situ the
+ * string is decoded over its raw bytes and ends on the closing quote.
+ */
+static char* copyTokenString(ParseContext* context, Token* token, size_t* strLength, ParserError* error)
+{
+  if (context->inSitu != NULL)
+  {
+    char* str = context->inSitu + token->startPos + 1;
+    return decodeTokenString(context, token, str, strLength, error) ? str : NULL;
+  }
+
+  size_t rawLength = token->endPos - token->startPos - 1;
+  char* str = (char*)allocBytes(context, rawLength + 1);
+
+  if (!decodeTokenString(context, token, str, strLength, error))
+  {
+    freeBytes(context, str);
+    return NULL;
+  }
+  return str;
+}
+
+static char* copyTokenKey(ParseContext* context, Token* token, uint32_t* keyHash, ParserError* error)
+{
+  size_t keyLength;
+  char* key = copyTokenString(context, token, &keyLength, error);
+  if (key == NULL)
+    return NULL;
+
+  // The lexer hashes the raw bytes, which differ from the key if it had
+  // escape sequences (and then it is shorter)
+  *keyHash = keyLength == token->endPos - token->startPos - 1 ? token->hash : 0;
+  return key;
+}
+
+/**
+ * Points at the content of a string token without copying it: the input
+ * itself, or the scratch buffer when it has escape sequences to decode.
+ */
+static const char* viewTokenString(ParseContext* context, Token* token, size_t* length, ParserError* error)
+{
+  const char* raw = context->json + token->startPos + 1;
+  size_t rawLength = token->endPos - token->startPos - 1;
+
+  if (isPlainJsonString(raw, rawLength))
+  {
+    *length = rawLength;
+    return raw;
+  }
+
+  context->scratch = (char*)vec_alloc(context->scratch, &context->scratchCapacity, rawLength + 1, 1);
+  if (!decodeTokenString(context, token, context->scratch, length, error))
+    return NULL;
+  return context->scratch;
+}
+
+/**
+ * Interns a key token straight from the input, or from the scratch buffer
+ * when it has escape sequences to decode. Nothing is allocated for keys
+ * already in the table.
+ */
+static char* internTokenKey(ParseContext* context, Token* token, uint32_t* keyHash, ParserError* error)
+{
+  size_t length;
+  const char* str = viewTokenString(context, token, &length, error);
+  if (str == NULL)
+    return NULL;
+
+  // The lexer hash covers the raw bytes, which are the key only without escapes
+  char* key = internJsonKey(context->keys, str, length, str != context->scratch ? token->hash : 0);
+  if (key != NULL)
+    *keyHash = jsonInternedKey(key)->hash;
+  return key;
+}
+
+static void freeKey(ParseContext* context, char* key)
+{
+  // Interned keys belong to their table, in-situ keys to the input
+  if (context->keys == NULL && context->inSitu == NULL)
+    freeBytes(context, key);
+}
+
+/**
+ * Children of the containers being parsed are collected on a stack shared
+ * by every nesting level, each container then gets an exactly sized copy of
+ * its own children once it is closed.
+ */
+static void pushChild(ParseContext* context, JsonNode* child)
+{
+  context->stackSize++;
+  context->stack = (JsonNode*)vec_alloc(context->stack, &context->stackCapacity, context->stackSize, sizeof(JsonNode));
+  context->stack[context->stackSize - 1] = *child;
+  releaseNode(context, child);
+}
+
+static void closeContainer(ParseContext* context, JsonNode* node, size_t mark)
+{
+  node->vSize = context->stackSize - mark;
+  node->vCapacity = node->vSize;
+
+  if (node->vSize > 0)
+  {
+    node->value.v_object = (JsonNode*)allocBytes(context, node->vSize * sizeof(JsonNode));
+    memcpy(node->value.v_object, context->stack + mark, node->vSize * sizeof(JsonNode));
+  }
+
+  context->stackSize = mark;
+}
+
+/**
+ * Parses a value selected by the projection step, the whole subtree is
+ * kept once a path ends.
+ */
+static JsonNode* parseProjectedValue(ParseContext* context, size_t step, ParserError* error)
+{
+  const JsonProjection* projection = context->projection;
+  if (projection == NULL)
+    return parse_helper(context, error);
+
+  size_t node = context->projectionNode;
+  if (projection->nodes[step].selected)
+    context->projection = NULL;
+  else
+    context->projectionNode = step;
+
+  JsonNode* value = parse_helper(context, error);
+
+  context->projection = projection;
+  context->projectionNode = node;
+  return value;
+}
+
+/**
+ * Reads a value with only the bracket nesting, for projections that do
+ * not validate what they leave out.
+ */
+static bool jumpValue(ParseContext* context, ParserError* error)
 {
-  JsonNode* node = createJsonNode(OBJECT_NODE);
+  TokenManager* manager = context->manager;
+  size_t depth = 0;
+
+  do
+  {
+    Token* token = advance(manager);
+    if (token == NULL)
+    {
+      setTokenError(manager, NO_TOKEN_FOUND, NULL, error);
+      return false;
+    }
+
+    if (token->type == CURLY_OPEN || token->type == BRACKET_OPEN)
+    {
+      depth++;
+    }
+    else if (token->type == CURLY_CLOSE || token->type == BRACKET_CLOSE || (depth == 0 && (token->type == COMMA || token->type == COLON)))
+    {
+      if (depth == 0)
+      {
+        if (error)
+        {
+          error->type = UNEXPECTED_TOKEN;
+          error->token = *token;
+        }
+        return false;
+      }
+      depth--;
+    }
+  } while (depth > 0);
+
+  return true;
+}
+
+static bool skipValue(ParseContext* context, ParserError* error);
+
+static bool skipContainer(ParseContext* context, bool object, ParserError* error)
+{
+  TokenManager* manager = context->manager;
+  TokenType closeType = object ? CURLY_CLOSE : BRACKET_CLOSE;
+  ParserErrorType endError = object ? EXPECTED_END_OF_OBJECT_BRACE : EXPECTED_END_OF_ARRAY_BRACE;
 
   Token* token = advance(manager);
   if (token == NULL)
   {
+    setTokenError(manager, endError, NULL, error);
+    return false;
+  }
+  if (token->type == closeType)
+    return true;
+
+  manager->pos--;
+  while (true)
+  {
+    if (object)
+    {
+      token = advance(manager);
+      if (token == NULL || token->type != STRING_LEX)
+      {
+        setTokenError(manager, EXPECTED_OBJECT_KEY, token, error);
+        return false;
+      }
+
+      size_t keyLength;
+      if (viewTokenString(context, token, &keyLength, error) == NULL)
+        return false;
+
+      token = advance(manager);
+      if (token == NULL || token->type != COLON)
+      {
+        setTokenError(manager, EXPECTED_COLON, token, error);
+        return false;
+      }
+    }
+
+    if (!skipValue(context, error))
+      return false;
+
+    token = advance(manager);
+    if (token == NULL)
+    {
+      setTokenError(manager, endError, NULL, error);
+      return false;
+    }
+
+    if (token->type == closeType)
+      return true;
+
+    if (token->type != COMMA)
+    {
+      if (error)
+      {
+        error->type = EXPECTED_COMMA;
+        error->token = *token;
+      }
+      return false;
+    }
+  }
+}
+
+/**
+ * Reads a value left out by the projection with the same checks, and so
+ * the same errors, as parse_helper, but without allocating anything.
+ */
+static bool skipValue(ParseContext* context, ParserError* error)
+{
+  if (!context->projection->validate)
+    return jumpValue(context, error);
+
+  TokenManager* manager = context->manager;
+  Token* token = advance(manager);
+  if (token == NULL)
+  {
+    setTokenError(manager, NO_TOKEN_FOUND, NULL, error);
+    return false;
+  }
+
+  switch (token->type)
+  {
+  case CURLY_OPEN:
+    return skipContainer(context, true, error);
+  case BRACKET_OPEN:
+    return skipContainer(context, false, error);
+  case STRING_LEX:
+  {
+    size_t length;
+    return viewTokenString(context, token, &length, error) != NULL;
+  }
+  case INTEGER_LEX:
+  case DOUBLE_LEX:
+  {
+    JsonNodeType type;
+    JsonValue value;
+    if (parseJsonNumber(context->json + token->startPos, token->endPos - token->startPos, &type, &value))
+      return true;
+    if (error)
+    {
+      error->type = token->type == INTEGER_LEX ? INVALID_INTEGER_LITERAL : INVALID_DOUBLE_LITERAL;
+      error->token = *token;
+    }
+    return false;
+  }
+  case BOOLEAN_LEX:
+  case NULL_LEX:
+    return true;
+  default:
     if (error)
-      error->type = EXPECTED_END_OF_OBJECT_BRACE;
-    return node;
+    {
+      error->type = UNEXPECTED_TOKEN;
+      error->token = *token;
+    }
+    return false;
+  }
+}
+
+static void parseObjectMembers(ParseContext* context, ParserError* error)
+{
+  TokenManager* manager = context->manager;
+
+  Token* token = advance(manager);
+  if (token == NULL)
+  {
+    setTokenError(manager, EXPECTED_END_OF_OBJECT_BRACE, NULL, error);
+    return;
   }
 
   // Handle empty object {}
   if (token->type == CURLY_CLOSE)
-    return node;
+    return;
 
   manager->pos--;
   while (true)
@@ -146,50 +964,70 @@ JsonNode* parseObject(FILE* jsonFile, TokenManager* manager, ParserError* error)
     // Get object's pair key
     if (token == NULL || token->type != STRING_LEX)
     {
-      if (error)
-      {
-        error->type = EXPECTED_OBJECT_KEY;
-        if (token != NULL)
-          error->token = *token;
-      }
-      return node;
+      setTokenError(manager, EXPECTED_OBJECT_KEY, token, error);
+      return;
+    }
+
+    // Members outside the projection are read without building anything
+    size_t step = 0;
+    if (context->projection != NULL)
+    {
+      size_t keyLength;
+      const char* key = viewTokenString(context, token, &keyLength, error);
+      if (key == NULL)
+        return;
+      step = findJsonProjectionKey(context->projection, context->projectionNode, key, keyLength);
     }
 
-    JsonNode* strNode = parseString(jsonFile, token);
-    char* pairKey = strNode->value.v_string;
-    free(strNode);
+    uint32_t keyHash = 0;
+    char* pairKey = NULL;
+    if (context->projection == NULL || step != 0)
+    {
+      pairKey = context->keys != NULL ? internTokenKey(context, token, &keyHash, error) : copyTokenKey(context, token, &keyHash, error);
+      if (pairKey == NULL)
+        return;
+    }
 
     token = advance(manager);
     if (token == NULL || token->type != COLON)
     {
-      if (error)
-      {
-        error->type = EXPECTED_COLON;
-        if (token != NULL)
-          error->token = *token;
-      }
-      free(pairKey);
-      return node;
+      setTokenError(manager, EXPECTED_COLON, token, error);
+      freeKey(context, pairKey);
+      return;
     }
 
     // Get object's pair value
-    JsonNode* valueNode = parse_helper(jsonFile, manager, error);
-    valueNode->key = pairKey;
-    if (valueNode == NULL || (error && error->type != NO_PARSER_ERROR))
-      return node;
-    addObjectPair(node, valueNode);
-    free(valueNode);
+    if (pairKey == NULL)
+    {
+      if (!skipValue(context, error))
+        return;
+    }
+    else
+    {
+      JsonNode* valueNode = parseProjectedValue(context, step, error);
+      if (valueNode == NULL)
+      {
+        freeKey(context, pairKey);
+        return;
+      }
+      valueNode->key = pairKey;
+      valueNode->keyHash = keyHash;
+      valueNode->keyInterned = context->keys != NULL;
+      valueNode->keyInSitu = context->keys == NULL && context->inSitu != NULL;
+      pushChild(context, valueNode);
+      if (error && error->type != NO_PARSER_ERROR)
+        return;
+    }
 
     token = advance(manager);
     if (token == NULL)
     {
-      if (error)
-        error->type = EXPECTED_END_OF_OBJECT_BRACE;
-      return node;
+      setTokenError(manager, EXPECTED_END_OF_OBJECT_BRACE, NULL, error);
+      return;
     }
 
     if (token->type == CURLY_CLOSE)
-      return node;
+      return;
 
     if (token->type != COMMA)
     {
@@ -198,60 +1036,169 @@ JsonNode* parseObject(FILE* jsonFile, TokenManager* manager, ParserError* error)
         error->type = EXPECTED_COMMA;
         error->token = *token;
       }
-      return node;
+      return;
     }
   }
+}
 
-  if (error)
-  {
-    error->type = EXPECTED_END_OF_OBJECT_BRACE;
-    error->token = *token;
-  }
-  return node;
+/**
+ * Tracks the nesting depth, only when statistics are collected.
+ */
+static void enterContainer(ParseContext* context)
+{
+  if (context->stats != NULL && ++context->depth > context->stats->maxDepth)
+    context->stats->maxDepth = context->depth;
 }
 
-void addElement(JsonNode* node, JsonNode* elemNode)
+static void leaveContainer(ParseContext* context)
 {
-  node->vSize++;
-  node->value.v_array = (JsonNode*)vec_alloc(node->value.v_array, &node->vCapacity, node->vSize, sizeof(JsonNode));
-  node->value.v_array[node->vSize - 1] = *elemNode;
+  if (context->stats != NULL)
+    context->depth--;
 }
 
-JsonNode* parseArray(FILE* jsonFile, TokenManager* manager, ParserError* error)
+JsonNode* parseObject(ParseContext* context, ParserError* error)
 {
-  JsonNode* node = createJsonNode(ARRAY_NODE);
+  JsonNode* node = allocNode(context, OBJECT_NODE);
+  size_t mark = context->stackSize;
 
-  Token* token = advance(manager);
-  if (token == NULL)
-  {
-    if (error)
-      error->type = EXPECTED_END_OF_ARRAY_BRACE;
-    return node;
-  }
+  enterContainer(context);
+  parseObjectMembers(context, error);
+  leaveContainer(context);
 
-  // Handle empty array []
-  if (token->type == BRACKET_CLOSE)
-    return node;
+  // Also on errors, so that the pairs parsed so far are owned by the node
+  closeContainer(context, node, mark);
+
+  if (context->indexObjects && node->vSize >= JSON_INDEX_MIN_SIZE)
+    buildJsonObjectIndex(node, context->arena);
+  return node;
+}
+
+/**
+ * Reads the elements of an array while they are numbers of the same type.
+ * Returns true once the array is over (or broken), with node packed.
+ * Otherwise the count numbers read so far are pushed as nodes, and the
+ * caller goes on from the element that did not fit, which is unread.
+ */
+static bool parsePackedElements(ParseContext* context, JsonNode* node, size_t* count, ParserError* error)
+{
+  TokenManager* manager = context->manager;
+  JsonNodeType packedType = NULL_NODE;
+  size_t size = 0;
 
-  manager->pos--;
   while (true)
   {
-    JsonNode* elemNode = parse_helper(jsonFile, manager, error);
-    if (elemNode == NULL && error && error->type != NO_PARSER_ERROR)
-      return node;
-    addElement(node, elemNode);
-    free(elemNode);
+    // Invalid numbers are also left to the caller, which reports them
+    Token* token = advance(manager);
+    JsonNodeType type = NULL_NODE;
+    JsonValue value;
+    if (token != NULL && (token->type == INTEGER_LEX || token->type == DOUBLE_LEX) &&
+        !parseJsonNumber(context->json + token->startPos, token->endPos - token->startPos, &type, &value))
+      type = NULL_NODE;
+
+    if ((type != INTEGER_NODE && type != DOUBLE_NODE) || (size > 0 && type != packedType))
+    {
+      if (token != NULL)
+        manager->pos--;
+      for (size_t i = 0; i < size; i++)
+      {
+        JsonNode* elemNode = allocNode(context, packedType);
+        elemNode->value = context->numbers[i];
+        pushChild(context, elemNode);
+      }
+      *count = size;
+      return false;
+    }
+
+    packedType = type;
+    size++;
+    context->numbers = (JsonValue*)vec_alloc(context->numbers, &context->numbersCapacity, size, sizeof(JsonValue));
+    context->numbers[size - 1] = value;
 
     token = advance(manager);
+    if (token == NULL || token->type != COMMA)
+    {
+      if (token == NULL)
+      {
+        setTokenError(manager, EXPECTED_END_OF_ARRAY_BRACE, NULL, error);
+      }
+      else if (error && token->type != BRACKET_CLOSE)
+      {
+        error->type = EXPECTED_COMMA;
+        error->token = *token;
+      }
+      break;
+    }
+  }
+
+  node->type = packedType == INTEGER_NODE ? INTEGER_ARRAY_NODE : DOUBLE_ARRAY_NODE;
+  node->vSize = size;
+  node->vCapacity = size;
+  node->value.v_doubles = (double*)allocBytes(context, size * sizeof(JsonValue));
+  memcpy(node->value.v_doubles, context->numbers, size * sizeof(JsonValue));
+
+  if (context->stats != NULL)
+  {
+    context->stats->nodes[ARRAY_NODE]--;
+    context->stats->nodes[node->type]++;
+  }
+  return true;
+}
+
+/**
+ * Parses the elements of an array from the element at index, the first
+ * one also checks for an empty array.
+ */
+static void parseArrayElements(ParseContext* context, size_t index, ParserError* error)
+{
+  TokenManager* manager = context->manager;
+
+  if (index == 0)
+  {
+    Token* token = advance(manager);
     if (token == NULL)
     {
-      if (error)
-        error->type = EXPECTED_END_OF_ARRAY_BRACE;
-      return node;
+      setTokenError(manager, EXPECTED_END_OF_ARRAY_BRACE, NULL, error);
+      return;
     }
 
+    // Handle empty array []
     if (token->type == BRACKET_CLOSE)
-      return node;
+      return;
+
+    manager->pos--;
+  }
+
+  for (;; index++)
+  {
+    // Elements outside the projection are read without building anything
+    size_t step = 0;
+    if (context->projection != NULL)
+      step = findJsonProjectionElement(context->projection, context->projectionNode, index);
+
+    if (context->projection != NULL && step == 0)
+    {
+      if (!skipValue(context, error))
+        return;
+    }
+    else
+    {
+      JsonNode* elemNode = parseProjectedValue(context, step, error);
+      if (elemNode == NULL)
+        return;
+      pushChild(context, elemNode);
+      if (error && error->type != NO_PARSER_ERROR)
+        return;
+    }
+
+    Token* token = advance(manager);
+    if (token == NULL)
+    {
+      setTokenError(manager, EXPECTED_END_OF_ARRAY_BRACE, NULL, error);
+      return;
+    }
+
+    if (token->type == BRACKET_CLOSE)
+      return;
 
     if (token->type != COMMA)
     {
@@ -260,19 +1207,61 @@ JsonNode* parseArray(FILE* jsonFile, TokenManager* manager, ParserError* error)
         error->type = EXPECTED_COMMA;
         error->token = *token;
       }
-      return node;
+      return;
     }
   }
+}
 
-  if (error)
+JsonNode* parseArray(ParseContext* context, ParserError* error)
+{
+  JsonNode* node = allocNode(context, ARRAY_NODE);
+  size_t mark = context->stackSize;
+  size_t count = 0;
+
+  // Projections select single elements, so only whole arrays are packed
+  enterContainer(context);
+  bool packed = context->packNumbers && context->projection == NULL && parsePackedElements(context, node, &count, error);
+  if (!packed)
+    parseArrayElements(context, count, error);
+  leaveContainer(context);
+
+  if (!packed)
+    closeContainer(context, node, mark);
+  return node;
+}
+
+size_t parseArrayValues(ParseContext* context, JsonNode* values, size_t capacity, ParserError* error)
+{
+  TokenManager* manager = context->manager;
+  size_t count = 0;
+
+  while (true)
   {
-    error->type = EXPECTED_END_OF_ARRAY_BRACE;
-    error->token = *token;
+    JsonNode* elemNode = parse_helper(context, error);
+    if (elemNode == NULL)
+      return count;
+    values[count++] = *elemNode;
+    releaseNode(context, elemNode);
+    if (error && error->type != NO_PARSER_ERROR)
+      return count;
+
+    Token* token = advance(manager);
+    if (token == NULL)
+      return count;
+
+    if (token->type != COMMA || count == capacity)
+    {
+      if (error)
+      {
+        error->type = token->type != COMMA ? EXPECTED_COMMA : UNEXPECTED_TOKEN;
+        error->token = *token;
+      }
+      return count;
+    }
   }
-  return node;
 }
 
-char* getStringFromToken(FILE* jsonFile, Token* token)
+char* getStringFromToken(const char* json, Token* token)
 {
   // strLength has some implicit calculations
   // +1 for '\0' and -2 for the double quotes however
@@ -288,81 +1277,84 @@ char* getStringFromToken(FILE* jsonFile, Token* token)
 
   char* str = (char*)malloc(strLength);
 
-  fseek(jsonFile, startPos, SEEK_SET);
-  fgets(str, strLength, jsonFile);
+  memcpy(str, json + startPos, strLength - 1);
+  str[strLength - 1] = '\0';
 
   return str;
 }
 
-JsonNode* parseString(FILE* jsonFile, Token* token)
+JsonNode* parseString(ParseContext* context, Token* token, ParserError* error)
 {
-  JsonNode* node = createJsonNode(STRING_NODE);
-  node->value.v_string = getStringFromToken(jsonFile, token);
-  return node;
-}
-
-JsonNode* parseInteger(FILE* jsonFile, Token* token, ParserError* error)
-{
-  JsonNode* node = createJsonNode(INTEGER_NODE);
+  JsonNode* node = allocNode(context, STRING_NODE);
 
-  char* input = getStringFromToken(jsonFile, token);
-
-  char* endptr;
-  node->value.v_int = (int)strtol(input, &endptr, 10);
-
-  if (*endptr != '\0' && error)
+  // Decoding never makes a string longer, the raw length decides if it fits
+  if (context->inSitu != NULL)
   {
-    error->type = INVALID_INTEGER_LITERAL;
-    error->token = *token;
+    node->stringInSitu = true;
+    node->value.v_string = copyTokenString(context, token, NULL, error);
+  }
+  else if (token->endPos - token->startPos - 1 < JSON_INLINE_STRING_SIZE)
+  {
+    node->stringInline = true;
+    decodeTokenString(context, token, node->inlineString, NULL, error);
+  }
+  else
+  {
+    node->value.v_string = copyTokenString(context, token, NULL, error);
   }
-
-  free(input);
   return node;
 }
 
-JsonNode* parseDouble(FILE* jsonFile, Token* token, ParserError* error)
+/**
+ * Numbers are converted in place from the input bytes, the token type only
+ * decides which error is reported for an invalid number.
+ */
+static JsonNode* parseNumber(ParseContext* context, Token* token, ParserError* error, ParserErrorType errorType)
 {
-  JsonNode* node = createJsonNode(DOUBLE_NODE);
-
-  char* input = getStringFromToken(jsonFile, token);
+  JsonNodeType type = token->type == INTEGER_LEX ? INTEGER_NODE : DOUBLE_NODE;
+  JsonNode* node = allocNode(context, type);
 
-  char* endptr;
-  node->value.v_double = strtod(input, &endptr);
-
-  if (*endptr != '\0' && error)
+  if (!parseJsonNumber(context->json + token->startPos, token->endPos - token->startPos, &type, &node->value) && error)
   {
-    error->type = INVALID_DOUBLE_LITERAL;
+    error->type = errorType;
     error->token = *token;
   }
 
-  free(input);
+  node->type = type;
   return node;
 }
 
-JsonNode* parseBoolean(FILE* jsonFile, Token* token)
+JsonNode* parseInteger(ParseContext* context, Token* token, ParserError* error)
 {
-  JsonNode* node = createJsonNode(BOOLEAN_NODE);
+  return parseNumber(context, token, error, INVALID_INTEGER_LITERAL);
+}
 
-  fseek(jsonFile, token->startPos, SEEK_SET);
-  int c = fgetc(jsonFile);
+JsonNode* parseDouble(ParseContext* context, Token* token, ParserError* error)
+{
+  return parseNumber(context, token, error, INVALID_DOUBLE_LITERAL);
+}
+JsonNode* parseBoolean(ParseContext* context, Token* token)
+{
+  JsonNode* node = allocNode(context, BOOLEAN_NODE);
 
-  node->value.v_bool = (c == 't');
+  node->value.v_bool = (context->json[token->startPos] == 't');
 
   return node;
 }
 
-JsonNode* parseNull(FILE* jsonFile, Token* token)
+JsonNode* parseNull(ParseContext* context, Token* token)
 {
-  JsonNode* node = createJsonNode(NULL_NODE);
+  JsonNode* node = allocNode(context, NULL_NODE);
   return node;
 }
 
 void freeJsonTree(JsonNode* node)
 {
-  if (node == NULL)
+  // Arena nodes are released together with the arena
+  if (node == NULL || node->inArena)
     return;
 
-  if (node->key != NULL)
+  if (node->key != NULL && !node->keyInterned && !node->keyInSitu)
     free(node->key);
 
   switch (node->type)
@@ -373,7 +1365,12 @@ void freeJsonTree(JsonNode* node)
   case BOOLEAN_NODE:
     break; // freed below
   case STRING_NODE:
-    free(node->value.v_string);
+    if (!node->stringInline && !node->stringInSitu)
+      free(node->value.v_string);
+    break;
+  case INTEGER_ARRAY_NODE:
+  case DOUBLE_ARRAY_NODE:
+    free(node->value.v_doubles);
     break;
   case OBJECT_NODE:
   case ARRAY_NODE:
@@ -391,6 +1388,7 @@ void freeJsonTree(JsonNode* node)
       freeJsonTree(&nodeList[i]);
 
     free(nodeList);
+    free(node->index);
     break;
   }
 
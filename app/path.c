@@ -0,0 +1,240 @@
+#include "json-parser.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Converts a reference token to an array index as RFC 6901 defines it:
+ * "0" or digits without leading zeros. Anything else can only be a key.
+ */
+static size_t tokenToIndex(const char* token, size_t length)
+{
+  if (length == 0 || (token[0] == '0' && length > 1))
+    return JSON_PATH_NO_INDEX;
+
+  size_t index = 0;
+  for (size_t i = 0; i < length; i++)
+  {
+    if (token[i] < '0' || token[i] > '9')
+      return JSON_PATH_NO_INDEX;
+    size_t digit = (size_t)(token[i] - '0');
+    if (index > (JSON_PATH_NO_INDEX - 1 - digit) / 10)
+      return JSON_PATH_NO_INDEX;
+    index = index * 10 + digit;
+  }
+
+  return index;
+}
+
+JsonPath* compileJsonPath(const char* pointer, char** strError)
+{
+  size_t length = strlen(pointer);
+
+  if (length > 0 && pointer[0] != '/')
+  {
+    if (strError != NULL)
+      *strError = vstrdup("Error: Invalid JSON Pointer at position 1: Expected '/'\n");
+    return NULL;
+  }
+
+  size_t stepCount = 0;
+  for (size_t i = 0; i < length; i++)
+    if (pointer[i] == '/')
+      stepCount++;
+
+  JsonPath* path = (JsonPath*)malloc(sizeof(JsonPath));
+  path->steps = (JsonPathStep*)malloc((stepCount > 0 ? stepCount : 1) * sizeof(JsonPathStep));
+  path->size = stepCount;
+  // Unescaped keys are never longer than the pointer itself
+  path->keys = (char*)malloc(length + 1);
+
+  char* key = path->keys;
+  size_t pos = 1;
+  for (size_t s = 0; s < stepCount; s++)
+  {
+    JsonPathStep* step = &path->steps[s];
+    step->key = key;
+
+    for (; pos < length && pointer[pos] != '/'; pos++)
+    {
+      if (pointer[pos] != '~')
+      {
+        *key++ = pointer[pos];
+        continue;
+      }
+
+      if (pos + 1 < length && (pointer[pos + 1] == '0' || pointer[pos + 1] == '1'))
+      {
+        *key++ = pointer[pos + 1] == '0' ? '~' : '/';
+        pos++;
+        continue;
+      }
+
+      if (strError != NULL)
+        *strError = vstrdup("Error: Invalid JSON Pointer at position %zu: Expected '~0' or '~1'\n", pos + 1);
+      deleteJsonPath(path);
+      return NULL;
+    }
+
+    step->length = key - step->key;
+    step->hash = jsonHashKey(step->key, step->length);
+    step->index = tokenToIndex(step->key, step->length);
+    *key++ = '\0';
+    pos++; // skips the '/' of the next step
+  }
+
+  return path;
+}
+
+void deleteJsonPath(JsonPath* path)
+{
+  if (path == NULL)
+    return;
+
+  free(path->steps);
+  free(path->keys);
+  free(path);
+}
+
+static JsonNode* evalJsonPathStep(const JsonPathStep* step, JsonNode* node)
+{
+  if (node == NULL)
+    return NULL;
+
+  if (node->type == OBJECT_NODE)
+    return jsonObjectGetHashed(node, step->key, step->length, step->hash);
+
+  if (node->type == ARRAY_NODE && step->index < node->vSize)
+    return &node->value.v_array[step->index];
+
+  return NULL;
+}
+
+JsonNode* evalJsonPath(const JsonPath* path, JsonNode* root)
+{
+  JsonNode* node = root;
+  for (size_t s = 0; s < path->size && node != NULL; s++)
+    node = evalJsonPathStep(&path->steps[s], node);
+
+  return node;
+}
+
+static bool stepEquals(const JsonPathStep* a, const JsonPathStep* b)
+{
+  return a->hash == b->hash && a->length == b->length && memcmp(a->key, b->key, a->length) == 0;
+}
+
+static int compareSteps(const JsonPathStep* a, const JsonPathStep* b)
+{
+  size_t length = a->length < b->length ? a->length : b->length;
+  int result = memcmp(a->key, b->key, length);
+  if (result != 0)
+    return result;
+  return a->length < b->length ? -1 : a->length > b->length;
+}
+
+/**
+ * A path of a batch with its position in the caller's array, which is where
+ * its result is written.
+ */
+typedef struct BatchEntry
+{
+  const JsonPath* path;
+  size_t position;
+} BatchEntry;
+
+static int compareBatchEntries(const void* a, const void* b)
+{
+  const BatchEntry* entryA = (const BatchEntry*)a;
+  const BatchEntry* entryB = (const BatchEntry*)b;
+  const JsonPath* pathA = entryA->path;
+  const JsonPath* pathB = entryB->path;
+
+  size_t size = pathA->size < pathB->size ? pathA->size : pathB->size;
+  for (size_t s = 0; s < size; s++)
+  {
+    int result = compareSteps(&pathA->steps[s], &pathB->steps[s]);
+    if (result != 0)
+      return result;
+  }
+  if (pathA->size != pathB->size)
+    return pathA->size < pathB->size ? -1 : 1;
+  return entryA->position < entryB->position ? -1 : entryA->position > entryB->position;
+}
+
+JsonPathBatch* createJsonPathBatch(const JsonPath* const* paths, size_t count)
+{
+  size_t allocCount = count > 0 ? count : 1;
+  JsonPathBatch* batch = (JsonPathBatch*)malloc(sizeof(JsonPathBatch));
+  batch->count = count;
+  batch->paths = (const JsonPath**)malloc(allocCount * sizeof(JsonPath*));
+  batch->order = (size_t*)malloc(allocCount * sizeof(size_t));
+  batch->shared = (size_t*)malloc(allocCount * sizeof(size_t));
+
+  // Sorting puts the paths with a common prefix next to each other, so each
+  // one only has to walk the steps it does not share with the previous one
+  BatchEntry* entries = (BatchEntry*)malloc(allocCount * sizeof(BatchEntry));
+  for (size_t i = 0; i < count; i++)
+  {
+    entries[i].path = paths[i];
+    entries[i].position = i;
+  }
+  qsort(entries, count, sizeof(BatchEntry), compareBatchEntries);
+
+  size_t depth = 0;
+  for (size_t i = 0; i < count; i++)
+  {
+    const JsonPath* path = entries[i].path;
+    batch->paths[i] = path;
+    batch->order[i] = entries[i].position;
+    if (path->size > depth)
+      depth = path->size;
+
+    size_t shared = 0;
+    if (i > 0)
+    {
+      const JsonPath* previous = entries[i - 1].path;
+      while (shared < path->size && shared < previous->size && stepEquals(&path->steps[shared], &previous->steps[shared]))
+        shared++;
+    }
+    batch->shared[i] = shared;
+  }
+  free(entries);
+
+  batch->depth = depth;
+  batch->stack = (JsonNode**)malloc((depth + 1) * sizeof(JsonNode*));
+  return batch;
+}
+
+void deleteJsonPathBatch(JsonPathBatch* batch)
+{
+  if (batch == NULL)
+    return;
+
+  free(batch->paths);
+  free(batch->order);
+  free(batch->shared);
+  free(batch->stack);
+  free(batch);
+}
+
+void evalJsonPathBatch(JsonPathBatch* batch, JsonNode* root, JsonNode** results)
+{
+  // stack[s] is the node reached after the first s steps of the last path
+  JsonNode** stack = batch->stack;
+  stack[0] = root;
+
+  for (size_t i = 0; i < batch->count; i++)
+  {
+    const JsonPath* path = batch->paths[i];
+    JsonNode* node = stack[batch->shared[i]];
+
+    for (size_t s = batch->shared[i]; s < path->size; s++)
+    {
+      node = evalJsonPathStep(&path->steps[s], node);
+      stack[s + 1] = node;
+    }
+
+    results[batch->order[i]] = node;
+  }
+}
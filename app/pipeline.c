@@ -0,0 +1,147 @@
+#include "json-parser.h"
+#include "utils.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Busy waits before a waiting side gives its time slice away
+#define PIPELINE_SPINS 64
+
+// Keeps the counters of the two threads on separate cache lines
+#define PIPELINE_CACHE_LINE 64
+
+#define PIPELINE_MIN_CAPACITY 16
+
+/**
+ * Single-producer single-consumer ring: only the lexer thread writes head
+ * and only the parser thread writes tail, both grow forever and are
+ * reduced modulo the capacity (a power of two) to index the ring.
+ */
+typedef struct TokenPipeline
+{
+  Lexer* lexer;
+  Token* ring;
+  size_t mask;
+  pthread_t thread;
+
+  char producerLine[PIPELINE_CACHE_LINE];
+  size_t head;     // Tokens published by the lexer thread
+  bool finished;   // Set after the last token, the lexer then is not used anymore
+  size_t seenTail; // Lexer thread copy of tail
+
+  char consumerLine[PIPELINE_CACHE_LINE];
+  size_t tail;     // Tokens consumed by the parser thread
+  bool stopped;    // The parser does not want more tokens
+  size_t seenHead; // Parser thread copy of head
+} TokenPipeline;
+
+static void waitPipeline(unsigned* spins)
+{
+  if (++*spins < PIPELINE_SPINS)
+  {
+#ifdef __SSE2__
+    _mm_pause();
+#endif
+    return;
+  }
+  *spins = 0;
+  sched_yield();
+}
+
+static void* runPipelineLexer(void* arg)
+{
+  TokenPipeline* pipeline = (TokenPipeline*)arg;
+  size_t head = pipeline->head;
+  size_t reallocations = vecReallocationCount();
+
+  while (true)
+  {
+    // Wait for a free slot
+    unsigned spins = 0;
+    while (head - pipeline->seenTail > pipeline->mask)
+    {
+      if (__atomic_load_n(&pipeline->stopped, __ATOMIC_RELAXED))
+        return NULL;
+      pipeline->seenTail = __atomic_load_n(&pipeline->tail, __ATOMIC_ACQUIRE);
+      if (head - pipeline->seenTail > pipeline->mask)
+        waitPipeline(&spins);
+    }
+
+    if (!lexNextToken(pipeline->lexer, pipeline->ring + (head & pipeline->mask)))
+      break;
+    head++;
+    __atomic_store_n(&pipeline->head, head, __ATOMIC_RELEASE);
+  }
+
+  // Published by finished, the parser reads the statistics after it
+  if (pipeline->lexer->stats != NULL)
+    pipeline->lexer->stats->reallocations += vecReallocationCount() - reallocations;
+  __atomic_store_n(&pipeline->finished, true, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+TokenManager* createTokenPipeline(Lexer* lexer, size_t capacity)
+{
+  size_t size = PIPELINE_MIN_CAPACITY;
+  while (size < capacity)
+    size <<= 1;
+
+  TokenPipeline* pipeline = (TokenPipeline*)malloc(sizeof(TokenPipeline));
+  pipeline->lexer = lexer;
+  pipeline->ring = (Token*)malloc(size * sizeof(Token));
+  pipeline->mask = size - 1;
+  pipeline->head = 0;
+  pipeline->finished = false;
+  pipeline->seenTail = 0;
+  pipeline->tail = 0;
+  pipeline->stopped = false;
+  pipeline->seenHead = 0;
+
+  if (pthread_create(&pipeline->thread, NULL, runPipelineLexer, pipeline) != 0)
+  {
+    free(pipeline->ring);
+    free(pipeline);
+    return NULL;
+  }
+
+  // The parser keeps its usual window of recent tokens, filled from the ring
+  TokenManager* manager = createTokenStream(lexer);
+  manager->lexer = NULL;
+  manager->pipeline = pipeline;
+  return manager;
+}
+
+bool nextPipelineToken(TokenPipeline* pipeline, Token* token)
+{
+  size_t tail = pipeline->tail;
+
+  unsigned spins = 0;
+  while (tail == pipeline->seenHead)
+  {
+    // Reading finished first makes sure that no token is published after
+    // the head that is read next
+    bool finished = __atomic_load_n(&pipeline->finished, __ATOMIC_ACQUIRE);
+    pipeline->seenHead = __atomic_load_n(&pipeline->head, __ATOMIC_ACQUIRE);
+    if (tail != pipeline->seenHead)
+      break;
+    if (finished)
+      return false;
+    waitPipeline(&spins);
+  }
+
+  *token = pipeline->ring[tail & pipeline->mask];
+  __atomic_store_n(&pipeline->tail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+void deleteTokenPipeline(TokenPipeline* pipeline)
+{
+  __atomic_store_n(&pipeline->stopped, true, __ATOMIC_RELAXED);
+  pthread_join(pipeline->thread, NULL);
+  free(pipeline->ring);
+  free(pipeline);
+}
@@ -0,0 +1,194 @@
+#include "json-parser.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+static size_t addProjectionNode(JsonProjection* projection)
+{
+  projection->size++;
+  projection->nodes = (JsonProjectionNode*)vec_alloc(projection->nodes, &projection->capacity, projection->size, sizeof(JsonProjectionNode));
+
+  JsonProjectionNode* node = &projection->nodes[projection->size - 1];
+  node->key = NULL;
+  node->length = 0;
+  node->index = JSON_PATH_NO_INDEX;
+  node->selected = false;
+  node->firstChild = 0;
+  node->nextSibling = 0;
+  return projection->size - 1;
+}
+
+/**
+ * Returns the child of parent for a step, adding it if the trie does not
+ * have it yet. An element step that mixes "[*]" and indices under the same
+ * parent returns 0, a single active step per level keeps parsing simple.
+ */
+static size_t addProjectionStep(JsonProjection* projection, size_t parent, const char* key, size_t length, size_t index)
+{
+  size_t last = 0;
+  for (size_t child = projection->nodes[parent].firstChild; child != 0; child = projection->nodes[child].nextSibling)
+  {
+    JsonProjectionNode* node = &projection->nodes[child];
+    last = child;
+
+    if (key != NULL && node->key != NULL && node->length == length && memcmp(node->key, key, length) == 0)
+      return child;
+    if (key == NULL && node->key == NULL)
+    {
+      if (node->index == index)
+        return child;
+      if (node->index == JSON_PATH_NO_INDEX || index == JSON_PATH_NO_INDEX)
+        return 0;
+    }
+  }
+
+  size_t child = addProjectionNode(projection);
+  JsonProjectionNode* node = &projection->nodes[child];
+  node->index = index;
+  if (key != NULL)
+  {
+    node->key = (char*)malloc(length + 1);
+    memcpy(node->key, key, length);
+    node->key[length] = '\0';
+    node->length = length;
+  }
+
+  if (last != 0)
+    projection->nodes[last].nextSibling = child;
+  else
+    projection->nodes[parent].firstChild = child;
+  return child;
+}
+
+/**
+ * Parses the digits of an index step, without leading zeros.
+ */
+static size_t parseProjectionIndex(const char* path, size_t* pos)
+{
+  size_t start = *pos;
+  size_t index = 0;
+  while (path[*pos] >= '0' && path[*pos] <= '9')
+  {
+    size_t digit = (size_t)(path[*pos] - '0');
+    if (index > (JSON_PATH_NO_INDEX - 1 - digit) / 10)
+      return JSON_PATH_NO_INDEX;
+    index = index * 10 + digit;
+    (*pos)++;
+  }
+
+  if (*pos == start || (path[start] == '0' && *pos - start > 1))
+    return JSON_PATH_NO_INDEX;
+  return index;
+}
+
+/**
+ * Adds the steps of a path to the trie, returns the error message if the
+ * path is not valid.
+ */
+static const char* addProjectionPath(JsonProjection* projection, const char* path, size_t* pos)
+{
+  size_t node = 0;
+  *pos = 0;
+
+  while (path[*pos] != '\0')
+  {
+    size_t child;
+    if (path[*pos] == '[')
+    {
+      (*pos)++;
+      size_t index = JSON_PATH_NO_INDEX;
+      if (path[*pos] == '*')
+        (*pos)++;
+      else if ((index = parseProjectionIndex(path, pos)) == JSON_PATH_NO_INDEX)
+        return "Expected index or '*'";
+
+      if (path[*pos] != ']')
+        return "Expected ']'";
+      (*pos)++;
+
+      child = addProjectionStep(projection, node, NULL, 0, index);
+      if (child == 0)
+        return "Cannot mix '[*]' and indices on the same array";
+    }
+    else
+    {
+      // Only the first key has no leading '.'
+      if (*pos > 0)
+      {
+        if (path[*pos] != '.')
+          return "Expected '.' or '['";
+        (*pos)++;
+      }
+
+      size_t start = *pos;
+      while (path[*pos] != '\0' && path[*pos] != '.' && path[*pos] != '[')
+        (*pos)++;
+      if (*pos == start)
+        return "Expected key";
+
+      child = addProjectionStep(projection, node, path + start, *pos - start, JSON_PATH_NO_INDEX);
+    }
+    node = child;
+  }
+
+  projection->nodes[node].selected = true;
+  return NULL;
+}
+
+JsonProjection* compileJsonProjection(const char** paths, size_t count, char** strError)
+{
+  JsonProjection* projection = (JsonProjection*)malloc(sizeof(JsonProjection));
+  projection->nodes = NULL;
+  projection->size = 0;
+  projection->capacity = 0;
+  projection->validate = true;
+  addProjectionNode(projection);
+
+  for (size_t i = 0; i < count; i++)
+  {
+    size_t pos;
+    const char* message = addProjectionPath(projection, paths[i], &pos);
+    if (message != NULL)
+    {
+      if (strError != NULL)
+        *strError = vstrdup("Error: Invalid projection path '%s' at position %zu: %s\n", paths[i], pos + 1, message);
+      deleteJsonProjection(projection);
+      return NULL;
+    }
+  }
+
+  return projection;
+}
+
+void deleteJsonProjection(JsonProjection* projection)
+{
+  if (projection == NULL)
+    return;
+
+  for (size_t i = 0; i < projection->size; i++)
+    free(projection->nodes[i].key);
+  free(projection->nodes);
+  free(projection);
+}
+
+size_t findJsonProjectionKey(const JsonProjection* projection, size_t node, const char* key, size_t length)
+{
+  for (size_t child = projection->nodes[node].firstChild; child != 0; child = projection->nodes[child].nextSibling)
+  {
+    const JsonProjectionNode* step = &projection->nodes[child];
+    if (step->key != NULL && step->length == length && memcmp(step->key, key, length) == 0)
+      return child;
+  }
+  return 0;
+}
+
+size_t findJsonProjectionElement(const JsonProjection* projection, size_t node, size_t index)
+{
+  for (size_t child = projection->nodes[node].firstChild; child != 0; child = projection->nodes[child].nextSibling)
+  {
+    const JsonProjectionNode* step = &projection->nodes[child];
+    if (step->key == NULL && (step->index == JSON_PATH_NO_INDEX || step->index == index))
+      return child;
+  }
+  return 0;
+}
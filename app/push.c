@@ -0,0 +1,743 @@
+#include "json-parser.h"
+#include "utils.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * TREE BUILDING
+ */
+
+/**
+ * Builds a tree out of the events of a push parser created without a
+ * handler. Open containers are kept by value on a stack and copied into
+ * their parent once closed, like parse_helper does with its children stack.
+ */
+typedef struct JsonTreeBuilder
+{
+  JsonNode* stack;
+  size_t capacity;
+  size_t depth;
+  char* key; // Key of the next value, owned until the value takes it
+  JsonNode* root;
+} JsonTreeBuilder;
+
+static void addTreeValue(JsonTreeBuilder* builder, JsonNode* value)
+{
+  if (builder->depth == 0)
+  {
+    builder->root = createJsonNode(value->type);
+    *builder->root = *value;
+    builder->root->isRoot = true;
+    return;
+  }
+
+  JsonNode* parent = &builder->stack[builder->depth - 1];
+  reserveJsonChildren(parent, parent->vSize + 1);
+  parent->value.v_object[parent->vSize++] = *value;
+}
+
+static bool addTreeScalar(JsonTreeBuilder* builder, JsonNode* value)
+{
+  value->key = builder->key;
+  builder->key = NULL;
+  addTreeValue(builder, value);
+  return true;
+}
+
+static bool openTreeContainer(JsonTreeBuilder* builder, JsonNodeType type)
+{
+  builder->stack = (JsonNode*)vec_alloc(builder->stack, &builder->capacity, builder->depth + 1, sizeof(JsonNode));
+  JsonNode* node = &builder->stack[builder->depth++];
+  initJsonNode(node, type);
+  node->key = builder->key;
+  builder->key = NULL;
+  return true;
+}
+
+static bool closeTreeContainer(JsonTreeBuilder* builder)
+{
+  JsonNode node = builder->stack[--builder->depth];
+  addTreeValue(builder, &node);
+  return true;
+}
+
+static char* copyTreeString(const char* str, size_t length)
+{
+  char* copy = (char*)malloc(length + 1);
+  memcpy(copy, str, length);
+  copy[length] = '\0';
+  return copy;
+}
+
+static bool onTreeObjectStart(void* userData)
+{
+  return openTreeContainer((JsonTreeBuilder*)userData, OBJECT_NODE);
+}
+
+static bool onTreeArrayStart(void* userData)
+{
+  return openTreeContainer((JsonTreeBuilder*)userData, ARRAY_NODE);
+}
+
+static bool onTreeContainerEnd(void* userData)
+{
+  return closeTreeContainer((JsonTreeBuilder*)userData);
+}
+
+static bool onTreeKey(void* userData, const char* key, size_t length)
+{
+  JsonTreeBuilder* builder = (JsonTreeBuilder*)userData;
+  builder->key = copyTreeString(key, length);
+  return true;
+}
+
+static bool onTreeString(void* userData, const char* str, size_t length)
+{
+  JsonNode node;
+  initJsonNode(&node, STRING_NODE);
+  setJsonNodeString(&node, str, length);
+  return addTreeScalar((JsonTreeBuilder*)userData, &node);
+}
+
+static bool onTreeInt64(void* userData, int64_t value)
+{
+  JsonNode node;
+  initJsonNode(&node, INTEGER_NODE);
+  node.value.v_int = value;
+  return addTreeScalar((JsonTreeBuilder*)userData, &node);
+}
+
+static bool onTreeDouble(void* userData, double value)
+{
+  JsonNode node;
+  initJsonNode(&node, DOUBLE_NODE);
+  node.value.v_double = value;
+  return addTreeScalar((JsonTreeBuilder*)userData, &node);
+}
+
+static bool onTreeBool(void* userData, bool value)
+{
+  JsonNode node;
+  initJsonNode(&node, BOOLEAN_NODE);
+  node.value.v_bool = value;
+  return addTreeScalar((JsonTreeBuilder*)userData, &node);
+}
+
+static bool onTreeNull(void* userData)
+{
+  JsonNode node;
+  initJsonNode(&node, NULL_NODE);
+  return addTreeScalar((JsonTreeBuilder*)userData, &node);
+}
+
+static void deleteTreeBuilder(JsonTreeBuilder* builder)
+{
+  // Unfinished containers own their children and key but not themselves
+  for (size_t i = 0; i < builder->depth; i++)
+    freeJsonTree(&builder->stack[i]);
+
+  free(builder->stack);
+  free(builder->key);
+  freeJsonTree(builder->root);
+  free(builder);
+}
+
+/**
+ * PARSER
+ */
+
+JsonPushParser* createJsonPushParser(const JsonSaxHandler* handler)
+{
+  JsonPushParser* parser = (JsonPushParser*)malloc(sizeof(JsonPushParser));
+  memset(parser, 0, sizeof(JsonPushParser));
+
+  if (handler != NULL)
+  {
+    parser->handler = *handler;
+  }
+  else
+  {
+    JsonTreeBuilder* builder = (JsonTreeBuilder*)malloc(sizeof(JsonTreeBuilder));
+    memset(builder, 0, sizeof(JsonTreeBuilder));
+    parser->builder = builder;
+
+    parser->handler.userData = builder;
+    parser->handler.onObjectStart = onTreeObjectStart;
+    parser->handler.onObjectEnd = onTreeContainerEnd;
+    parser->handler.onArrayStart = onTreeArrayStart;
+    parser->handler.onArrayEnd = onTreeContainerEnd;
+    parser->handler.onKey = onTreeKey;
+    parser->handler.onString = onTreeString;
+    parser->handler.onInt64 = onTreeInt64;
+    parser->handler.onDouble = onTreeDouble;
+    parser->handler.onBool = onTreeBool;
+    parser->handler.onNull = onTreeNull;
+  }
+
+  parser->state = PUSH_EXPECT_VALUE;
+  parser->lexState = PUSH_LEX_NONE;
+  parser->lexError.type = NO_LEX_ERROR;
+  parser->parserError.type = NO_PARSER_ERROR;
+  return parser;
+}
+
+void deleteJsonPushParser(JsonPushParser* parser)
+{
+  if (parser == NULL)
+    return;
+
+  if (parser->builder != NULL)
+    deleteTreeBuilder(parser->builder);
+
+  free(parser->containers);
+  free(parser->pending);
+  free(parser->scratch);
+  free(parser);
+}
+
+static bool hasPushError(const JsonPushParser* parser)
+{
+  return parser->lexError.type != NO_LEX_ERROR || parser->parserError.type != NO_PARSER_ERROR;
+}
+
+static bool reportPushError(const JsonPushParser* parser, char** strError)
+{
+  if (strError != NULL)
+  {
+    if (parser->lexError.type != NO_LEX_ERROR)
+      *strError = buildLexStringError((LexError*)&parser->lexError);
+    else
+      *strError = buildParseStringError((ParserError*)&parser->parserError);
+  }
+  return false;
+}
+
+static bool setPushLexError(JsonPushParser* parser, LexErrorType type)
+{
+  parser->lexError.type = type;
+  parser->lexError.lineCount = parser->token.lineCount;
+  parser->lexError.charCount = parser->token.charCount;
+  return false;
+}
+
+static bool setPushParseError(JsonPushParser* parser, ParserErrorType type)
+{
+  parser->parserError.type = type;
+  parser->parserError.token = parser->token;
+  return false;
+}
+
+static bool checkPushCallback(JsonPushParser* parser, bool result)
+{
+  return result || setPushParseError(parser, PARSING_ABORTED);
+}
+
+/**
+ * GRAMMAR
+ */
+
+static bool finishPushValue(JsonPushParser* parser)
+{
+  parser->state = parser->depth == 0 ? PUSH_COMPLETE : PUSH_EXPECT_COMMA_OR_CLOSE;
+  return true;
+}
+
+/**
+ * Decodes the content of a string token, pointing str straight at it when
+ * there is nothing to decode.
+ */
+static bool decodePushString(JsonPushParser* parser, const char** str, size_t* length)
+{
+  if (isPlainJsonString(*str, *length))
+    return true;
+
+  parser->scratch = (char*)vec_alloc(parser->scratch, &parser->scratchCapacity, *length + 1, 1);
+
+  size_t errorOffset;
+  ParserErrorType errorType = decodeJsonString(*str, *length, parser->scratch, length, &errorOffset);
+  if (errorType != NO_PARSER_ERROR)
+  {
+    setPushParseError(parser, errorType);
+    parser->parserError.token.charCount += errorOffset + 1;
+    return false;
+  }
+
+  *str = parser->scratch;
+  return true;
+}
+
+static bool openPushContainer(JsonPushParser* parser, char brace)
+{
+  parser->containers = (char*)vec_alloc(parser->containers, &parser->containersCapacity, parser->depth + 1, 1);
+  parser->containers[parser->depth++] = brace;
+
+  const JsonSaxHandler* handler = &parser->handler;
+  if (brace == '{')
+  {
+    parser->state = PUSH_EXPECT_KEY_OR_CLOSE;
+    return !handler->onObjectStart || checkPushCallback(parser, handler->onObjectStart(handler->userData));
+  }
+
+  parser->state = PUSH_EXPECT_VALUE_OR_CLOSE;
+  return !handler->onArrayStart || checkPushCallback(parser, handler->onArrayStart(handler->userData));
+}
+
+static bool closePushContainer(JsonPushParser* parser)
+{
+  const JsonSaxHandler* handler = &parser->handler;
+  bool result = true;
+
+  if (parser->containers[--parser->depth] == '{')
+  {
+    if (handler->onObjectEnd)
+      result = handler->onObjectEnd(handler->userData);
+  }
+  else if (handler->onArrayEnd)
+  {
+    result = handler->onArrayEnd(handler->userData);
+  }
+
+  return checkPushCallback(parser, result) && finishPushValue(parser);
+}
+
+static bool pushValue(JsonPushParser* parser, const char* str, size_t length)
+{
+  const JsonSaxHandler* handler = &parser->handler;
+  bool result = true;
+
+  switch (parser->token.type)
+  {
+  case CURLY_OPEN:
+  case BRACKET_OPEN:
+    return openPushContainer(parser, (char)parser->token.type);
+  case STRING_LEX:
+    if (!decodePushString(parser, &str, &length))
+      return false;
+    if (handler->onString)
+      result = handler->onString(handler->userData, str, length);
+    break;
+  case INTEGER_LEX:
+  case DOUBLE_LEX:
+  {
+    JsonNodeType type;
+    JsonValue value;
+    if (!parseJsonNumber(str, length, &type, &value))
+      return setPushParseError(parser, parser->token.type == INTEGER_LEX ? INVALID_INTEGER_LITERAL : INVALID_DOUBLE_LITERAL);
+
+    if (type == INTEGER_NODE && handler->onInt64)
+      result = handler->onInt64(handler->userData, value.v_int);
+    else if (type == DOUBLE_NODE && handler->onDouble)
+      result = handler->onDouble(handler->userData, value.v_double);
+    break;
+  }
+  case BOOLEAN_LEX:
+    if (handler->onBool)
+      result = handler->onBool(handler->userData, str[0] == 't');
+    break;
+  case NULL_LEX:
+    if (handler->onNull)
+      result = handler->onNull(handler->userData);
+    break;
+  default:
+    return setPushParseError(parser, UNEXPECTED_TOKEN);
+  }
+
+  return checkPushCallback(parser, result) && finishPushValue(parser);
+}
+
+/**
+ * Advances the grammar by the token in parser->token, whose content is
+ * str[0..length) (without the quotes for strings).
+ */
+static bool pushToken(JsonPushParser* parser, const char* str, size_t length)
+{
+  const JsonSaxHandler* handler = &parser->handler;
+  TokenType type = parser->token.type;
+
+  switch (parser->state)
+  {
+  case PUSH_COMPLETE:
+    // Tokens after the root value are ignored, like parseJsonBuffer does
+    return true;
+
+  case PUSH_EXPECT_KEY_OR_CLOSE:
+    if (type == CURLY_CLOSE)
+      return closePushContainer(parser);
+    // fallthrough
+  case PUSH_EXPECT_KEY:
+    if (type != STRING_LEX)
+      return setPushParseError(parser, EXPECTED_OBJECT_KEY);
+    if (!decodePushString(parser, &str, &length))
+      return false;
+    parser->state = PUSH_EXPECT_COLON;
+    return !handler->onKey || checkPushCallback(parser, handler->onKey(handler->userData, str, length));
+
+  case PUSH_EXPECT_COLON:
+    if (type != COLON)
+      return setPushParseError(parser, EXPECTED_COLON);
+    parser->state = PUSH_EXPECT_VALUE;
+    return true;
+
+  case PUSH_EXPECT_COMMA_OR_CLOSE:
+  {
+    char brace = parser->containers[parser->depth - 1];
+    if (type == (brace == '{' ? CURLY_CLOSE : BRACKET_CLOSE))
+      return closePushContainer(parser);
+    if (type != COMMA)
+      return setPushParseError(parser, EXPECTED_COMMA);
+    parser->state = brace == '{' ? PUSH_EXPECT_KEY : PUSH_EXPECT_VALUE;
+    return true;
+  }
+
+  case PUSH_EXPECT_VALUE_OR_CLOSE:
+    if (type == BRACKET_CLOSE)
+      return closePushContainer(parser);
+    // fallthrough
+  case PUSH_EXPECT_VALUE:
+    return pushValue(parser, str, length);
+  }
+
+  return true;
+}
+
+/**
+ * TOKENIZATION
+ */
+
+static bool isPushNumberCharacter(char c)
+{
+  return isdigit((unsigned char)c) || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-';
+}
+
+static void appendPending(JsonPushParser* parser, const char* data, size_t length)
+{
+  // One spare byte, so that even an empty token has a buffer
+  parser->pending = (char*)vec_alloc(parser->pending, &parser->pendingCapacity, parser->pendingSize + length + 1, 1);
+  memcpy(parser->pending + parser->pendingSize, data, length);
+  parser->pendingSize += length;
+}
+
+/**
+ * Returns the position of the quote that closes the string, or length if
+ * the string goes on in the next chunk.
+ */
+static size_t findStringEnd(JsonPushParser* parser, const char* data, size_t length, size_t pos)
+{
+  if (parser->escaped && pos < length)
+  {
+    parser->escaped = false;
+    pos++;
+  }
+
+  for (; pos < length; pos++)
+  {
+    if (data[pos] == '"')
+      return pos;
+    if (data[pos] == '\\' && ++pos == length)
+      parser->escaped = true;
+  }
+
+  return length;
+}
+
+static size_t scanNumber(const char* data, size_t length, size_t pos, JsonPushParser* parser)
+{
+  for (; pos < length && isPushNumberCharacter(data[pos]); pos++)
+    if (data[pos] == '.' || data[pos] == 'e' || data[pos] == 'E')
+      parser->token.type = DOUBLE_LEX;
+  return pos;
+}
+
+/**
+ * Matches the literal against data starting from the pendingSize-th byte,
+ * returns how many bytes were consumed.
+ */
+static size_t matchPushLiteral(JsonPushParser* parser, const char* data, size_t length, bool* matched)
+{
+  size_t consumed = 0;
+  *matched = true;
+
+  while (parser->literal[parser->pendingSize] != '\0' && consumed < length)
+  {
+    if (data[consumed] != parser->literal[parser->pendingSize])
+    {
+      *matched = false;
+      return consumed;
+    }
+    consumed++;
+    parser->pendingSize++;
+  }
+
+  return consumed;
+}
+
+/**
+ * Continues the token left unfinished by the previous chunk, returns the
+ * position right after it (or length if it is still unfinished).
+ */
+static size_t resumePushToken(JsonPushParser* parser, const char* data, size_t length)
+{
+  size_t pos;
+
+  switch (parser->lexState)
+  {
+  case PUSH_LEX_STRING:
+    pos = findStringEnd(parser, data, length, 0);
+    appendPending(parser, data, pos);
+    parser->charCount += pos;
+    if (pos == length)
+      return length;
+
+    parser->charCount++;
+    parser->lexState = PUSH_LEX_NONE;
+    pushToken(parser, parser->pending, parser->pendingSize);
+    return pos + 1;
+
+  case PUSH_LEX_NUMBER:
+    pos = scanNumber(data, length, 0, parser);
+    appendPending(parser, data, pos);
+    parser->charCount += pos;
+    if (pos == length)
+      return length;
+
+    parser->lexState = PUSH_LEX_NONE;
+    pushToken(parser, parser->pending, parser->pendingSize);
+    return pos;
+
+  case PUSH_LEX_LITERAL:
+  {
+    bool matched;
+    pos = matchPushLiteral(parser, data, length, &matched);
+    parser->charCount += pos;
+    if (!matched)
+    {
+      setPushLexError(parser, parser->token.type == NULL_LEX ? INVALID_NULL_LITERAL : INVALID_BOOLEAN_LITERAL);
+      return length;
+    }
+    if (parser->literal[parser->pendingSize] != '\0')
+      return length;
+
+    parser->lexState = PUSH_LEX_NONE;
+    pushToken(parser, parser->literal, parser->pendingSize);
+    return pos;
+  }
+
+  default:
+    return 0;
+  }
+}
+
+/**
+ * Lexes the token that starts at data[pos], keeping it in the pending
+ * buffer if the chunk ends before it does. Returns the position right
+ * after the consumed bytes.
+ */
+static size_t lexPushToken(JsonPushParser* parser, const char* data, size_t length, size_t pos)
+{
+  char c = data[pos];
+  Token* token = &parser->token;
+  token->lineCount = parser->lineCount + 1;
+  token->charCount = ++parser->charCount;
+
+  switch (c)
+  {
+  case '{':
+  case '}':
+  case '[':
+  case ']':
+  case ',':
+  case ':':
+    token->type = (TokenType)c;
+    pushToken(parser, data + pos, 1);
+    return pos + 1;
+  }
+
+  size_t start = pos;
+
+  if (c == '"')
+  {
+    token->type = STRING_LEX;
+    start++;
+    pos = findStringEnd(parser, data, length, start);
+    parser->charCount += pos - start;
+
+    if (pos == length)
+    {
+      parser->lexState = PUSH_LEX_STRING;
+      parser->pendingSize = 0;
+      appendPending(parser, data + start, pos - start);
+      return length;
+    }
+
+    // Strings that fit in the chunk are used in place
+    parser->charCount++;
+    pushToken(parser, data + start, pos - start);
+    return pos + 1;
+  }
+
+  if (c == '-' || isdigit((unsigned char)c))
+  {
+    token->type = INTEGER_LEX;
+    pos = scanNumber(data, length, pos + 1, parser);
+    parser->charCount += pos - start - 1;
+
+    if (pos == length)
+    {
+      parser->lexState = PUSH_LEX_NUMBER;
+      parser->pendingSize = 0;
+      appendPending(parser, data + start, pos - start);
+      return length;
+    }
+
+    pushToken(parser, data + start, pos - start);
+    return pos;
+  }
+
+  if (c == 't' || c == 'f' || c == 'n')
+  {
+    token->type = c == 'n' ? NULL_LEX : BOOLEAN_LEX;
+    parser->literal = c == 't' ? "true" : c == 'f' ? "false" : "null";
+    parser->pendingSize = 1;
+    parser->lexState = PUSH_LEX_LITERAL;
+    return pos + 1 + resumePushToken(parser, data + pos + 1, length - pos - 1);
+  }
+
+  setPushLexError(parser, UNEXPECTED_CHARACTER);
+  return length;
+}
+
+bool feedJsonPushParser(JsonPushParser* parser, const char* data, size_t length, char** strError)
+{
+  if (hasPushError(parser))
+    return reportPushError(parser, strError);
+
+  size_t pos = 0;
+  if (parser->lexState != PUSH_LEX_NONE)
+    pos = resumePushToken(parser, data, length);
+
+  while (pos < length && !hasPushError(parser))
+  {
+    char c = data[pos];
+
+    // A "\r\n" split between two chunks is still a single newline
+    if (parser->afterCarriageReturn)
+    {
+      parser->afterCarriageReturn = false;
+      if (c == '\n')
+      {
+        pos++;
+        continue;
+      }
+    }
+
+    if (c == '\n' || c == '\r')
+    {
+      parser->lineCount++;
+      parser->charCount = 0;
+      parser->afterCarriageReturn = c == '\r';
+      pos++;
+    }
+    else if (isspace((unsigned char)c))
+    {
+      parser->charCount++;
+      pos++;
+    }
+    else
+    {
+      pos = lexPushToken(parser, data, length, pos);
+    }
+  }
+
+  if (hasPushError(parser))
+    return reportPushError(parser, strError);
+  return true;
+}
+
+/**
+ * Reports the end of the input in the middle of a value, at the position of
+ * the last token like the recursive parser does.
+ */
+static bool setPushEndError(JsonPushParser* parser)
+{
+  ParserErrorType type = NO_TOKEN_FOUND;
+
+  switch (parser->state)
+  {
+  case PUSH_EXPECT_VALUE:
+  case PUSH_COMPLETE:
+    break;
+  case PUSH_EXPECT_KEY_OR_CLOSE:
+    type = EXPECTED_END_OF_OBJECT_BRACE;
+    break;
+  case PUSH_EXPECT_VALUE_OR_CLOSE:
+    type = EXPECTED_END_OF_ARRAY_BRACE;
+    break;
+  case PUSH_EXPECT_KEY:
+    type = EXPECTED_OBJECT_KEY;
+    break;
+  case PUSH_EXPECT_COLON:
+    type = EXPECTED_COLON;
+    break;
+  case PUSH_EXPECT_COMMA_OR_CLOSE:
+    type = parser->containers[parser->depth - 1] == '{' ? EXPECTED_END_OF_OBJECT_BRACE : EXPECTED_END_OF_ARRAY_BRACE;
+    break;
+  }
+
+  return setPushParseError(parser, type);
+}
+
+bool finishJsonPushParser(JsonPushParser* parser, char** strError)
+{
+  if (hasPushError(parser))
+    return reportPushError(parser, strError);
+
+  switch (parser->lexState)
+  {
+  case PUSH_LEX_STRING:
+    setPushLexError(parser, EXPECTED_END_OF_STRING);
+    break;
+  case PUSH_LEX_NUMBER:
+    parser->lexState = PUSH_LEX_NONE;
+    pushToken(parser, parser->pending, parser->pendingSize);
+    break;
+  case PUSH_LEX_LITERAL:
+    setPushLexError(parser, parser->token.type == NULL_LEX ? INVALID_NULL_LITERAL : INVALID_BOOLEAN_LITERAL);
+    break;
+  default:
+    break;
+  }
+
+  if (!hasPushError(parser) && parser->state != PUSH_COMPLETE)
+  {
+    if (parser->lineCount == 0 && parser->charCount == 0)
+    {
+      parser->lexError.type = EMPTY_FILE;
+      parser->lexError.lineCount = 0;
+      parser->lexError.charCount = 0;
+    }
+    else
+    {
+      setPushEndError(parser);
+    }
+  }
+
+  if (hasPushError(parser))
+    return reportPushError(parser, strError);
+  return true;
+}
+
+bool isJsonPushComplete(const JsonPushParser* parser)
+{
+  return parser->state == PUSH_COMPLETE;
+}
+
+JsonNode* takeJsonPushTree(JsonPushParser* parser)
+{
+  if (parser->builder == NULL || parser->state != PUSH_COMPLETE)
+    return NULL;
+
+  JsonNode* root = parser->builder->root;
+  parser->builder->root = NULL;
+  return root;
+}
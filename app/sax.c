@@ -0,0 +1,241 @@
+#include "json-parser.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct SaxContext
+{
+  const char* json;
+  TokenManager* manager;
+  const JsonSaxHandler* handler;
+  char* scratch; // Decoded strings that cannot point into the input
+  size_t scratchCapacity;
+  ParserError* error;
+} SaxContext;
+
+static bool parseSaxValue(SaxContext* context);
+
+static bool setSaxError(SaxContext* context, ParserErrorType type, Token* token)
+{
+  if (context->error)
+  {
+    context->error->type = type;
+    context->error->token.lineCount = 0;
+    context->error->token.charCount = 0;
+
+    // The input ended where a token was expected (e.g. "[1,2")
+    if (token == NULL)
+      token = previousToken(context->manager);
+    if (token != NULL)
+      context->error->token = *token;
+  }
+  return false;
+}
+
+/**
+ * Reports a callback that asked to stop, token is the one that raised the
+ * event.
+ */
+static bool checkCallback(SaxContext* context, bool result, Token* token)
+{
+  return result || setSaxError(context, PARSING_ABORTED, token);
+}
+
+/**
+ * Points str at the content of a string token: the input itself when there
+ * is nothing to decode, the scratch buffer otherwise.
+ */
+static bool tokenString(SaxContext* context, Token* token, const char** str, size_t* length)
+{
+  const char* raw = context->json + token->startPos + 1;
+  size_t rawLength = token->endPos - token->startPos - 1;
+
+  if (isPlainJsonString(raw, rawLength))
+  {
+    *str = raw;
+    *length = rawLength;
+    return true;
+  }
+
+  context->scratch = (char*)vec_alloc(context->scratch, &context->scratchCapacity, rawLength + 1, 1);
+
+  size_t errorOffset;
+  ParserErrorType errorType = decodeJsonString(raw, rawLength, context->scratch, length, &errorOffset);
+  if (errorType != NO_PARSER_ERROR)
+  {
+    setSaxError(context, errorType, token);
+    if (context->error)
+      context->error->token.charCount += errorOffset + 1;
+    return false;
+  }
+
+  *str = context->scratch;
+  return true;
+}
+
+static bool parseSaxObject(SaxContext* context, Token* openToken)
+{
+  const JsonSaxHandler* handler = context->handler;
+  if (handler->onObjectStart && !checkCallback(context, handler->onObjectStart(handler->userData), openToken))
+    return false;
+
+  Token* token = advance(context->manager);
+  if (token == NULL)
+    return setSaxError(context, EXPECTED_END_OF_OBJECT_BRACE, NULL);
+
+  if (token->type != CURLY_CLOSE)
+  {
+    context->manager->pos--;
+    while (true)
+    {
+      token = advance(context->manager);
+      if (token == NULL || token->type != STRING_LEX)
+        return setSaxError(context, EXPECTED_OBJECT_KEY, token);
+
+      const char* key;
+      size_t keyLength;
+      if (!tokenString(context, token, &key, &keyLength))
+        return false;
+      if (handler->onKey && !checkCallback(context, handler->onKey(handler->userData, key, keyLength), token))
+        return false;
+
+      token = advance(context->manager);
+      if (token == NULL || token->type != COLON)
+        return setSaxError(context, EXPECTED_COLON, token);
+
+      if (!parseSaxValue(context))
+        return false;
+
+      token = advance(context->manager);
+      if (token == NULL)
+        return setSaxError(context, EXPECTED_END_OF_OBJECT_BRACE, NULL);
+
+      if (token->type == CURLY_CLOSE)
+        break;
+
+      if (token->type != COMMA)
+        return setSaxError(context, EXPECTED_COMMA, token);
+    }
+  }
+
+  return !handler->onObjectEnd || checkCallback(context, handler->onObjectEnd(handler->userData), token);
+}
+
+static bool parseSaxArray(SaxContext* context, Token* openToken)
+{
+  const JsonSaxHandler* handler = context->handler;
+  if (handler->onArrayStart && !checkCallback(context, handler->onArrayStart(handler->userData), openToken))
+    return false;
+
+  Token* token = advance(context->manager);
+  if (token == NULL)
+    return setSaxError(context, EXPECTED_END_OF_ARRAY_BRACE, NULL);
+
+  if (token->type != BRACKET_CLOSE)
+  {
+    context->manager->pos--;
+    while (true)
+    {
+      if (!parseSaxValue(context))
+        return false;
+
+      token = advance(context->manager);
+      if (token == NULL)
+        return setSaxError(context, EXPECTED_END_OF_ARRAY_BRACE, NULL);
+
+      if (token->type == BRACKET_CLOSE)
+        break;
+
+      if (token->type != COMMA)
+        return setSaxError(context, EXPECTED_COMMA, token);
+    }
+  }
+
+  return !handler->onArrayEnd || checkCallback(context, handler->onArrayEnd(handler->userData), token);
+}
+
+static bool parseSaxValue(SaxContext* context)
+{
+  const JsonSaxHandler* handler = context->handler;
+  TokenManager* manager = context->manager;
+
+  Token* token = advance(manager);
+  if (token == NULL)
+  {
+    return setSaxError(context, NO_TOKEN_FOUND, NULL);
+  }
+
+  switch (token->type)
+  {
+  case CURLY_OPEN:
+    return parseSaxObject(context, token);
+  case BRACKET_OPEN:
+    return parseSaxArray(context, token);
+  case STRING_LEX:
+  {
+    const char* str;
+    size_t length;
+    if (!tokenString(context, token, &str, &length))
+      return false;
+    return !handler->onString || checkCallback(context, handler->onString(handler->userData, str, length), token);
+  }
+  case INTEGER_LEX:
+  case DOUBLE_LEX:
+  {
+    JsonNodeType type;
+    JsonValue value;
+    if (!parseJsonNumber(context->json + token->startPos, token->endPos - token->startPos, &type, &value))
+      return setSaxError(context, token->type == INTEGER_LEX ? INVALID_INTEGER_LITERAL : INVALID_DOUBLE_LITERAL, token);
+
+    if (type == INTEGER_NODE)
+      return !handler->onInt64 || checkCallback(context, handler->onInt64(handler->userData, value.v_int), token);
+    return !handler->onDouble || checkCallback(context, handler->onDouble(handler->userData, value.v_double), token);
+  }
+  case BOOLEAN_LEX:
+    return !handler->onBool || checkCallback(context, handler->onBool(handler->userData, context->json[token->startPos] == 't'), token);
+  case NULL_LEX:
+    return !handler->onNull || checkCallback(context, handler->onNull(handler->userData), token);
+  default:
+    return setSaxError(context, UNEXPECTED_TOKEN, token);
+  }
+}
+
+bool parseJsonSax(const char* data, size_t length, const JsonSaxHandler* handler, char** strError)
+{
+  Lexer lexer;
+  initLexer(&lexer, data, length);
+  TokenManager* manager = createTokenStream(&lexer);
+
+  ParserError parserError;
+  parserError.type = NO_PARSER_ERROR;
+
+  SaxContext context;
+  context.json = data;
+  context.manager = manager;
+  context.handler = handler;
+  context.scratch = NULL;
+  context.scratchCapacity = 0;
+  context.error = &parserError;
+
+  parseSaxValue(&context);
+
+  // Lexical errors anywhere in the input take precedence, like in
+  // parseJsonBuffer, but a handler that stopped early does not want the rest
+  // of the input to be read
+  if (parserError.type != PARSING_ABORTED)
+  {
+    Token token;
+    while (lexNextToken(&lexer, &token))
+      ;
+  }
+
+  bool lexFailed = lexer.error.type != NO_LEX_ERROR && parserError.type != PARSING_ABORTED;
+  bool success = !lexFailed && parserError.type == NO_PARSER_ERROR;
+  if (!success && strError != NULL)
+    *strError = lexFailed ? buildLexStringError(&lexer.error) : buildParseStringError(&parserError);
+
+  free(context.scratch);
+  clearLexer(&lexer);
+  deleteTokenManager(manager);
+  return success;
+}
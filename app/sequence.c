@@ -0,0 +1,505 @@
+#include "json-parser.h"
+#include "utils.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bytes of documents handed to a worker at a time, large enough to make the
+// hand-off negligible and small enough to keep every worker busy
+#define SEQUENCE_BATCH_SIZE (256 * 1024)
+
+// Batches in flight per worker, bounds the memory used by parsed documents
+// that are waiting for their turn to be delivered
+#define SEQUENCE_BATCHES_PER_THREAD 4
+
+// Input indexed at a time when splitting concatenated documents
+#define SEQUENCE_INDEX_SIZE (64 * 1024)
+
+void initJsonSequenceOptions(JsonSequenceOptions* options)
+{
+  options->format = JSON_SEQUENCE_LINES;
+  options->threads = 0;
+  options->batchSize = 0;
+  options->unordered = false;
+  options->onDocument = NULL;
+  options->userData = NULL;
+}
+
+/**
+ * SPLITTING
+ */
+
+typedef struct SequenceSplitter
+{
+  const char* data;
+  size_t length;
+  size_t pos; // Lines only, start of the next line
+  JsonSequenceFormat format;
+  StructuralIndex* index; // Concatenated only, like the one of the lexer
+  size_t next;
+} SequenceSplitter;
+
+static bool isSequenceSpace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool nextLine(SequenceSplitter* splitter, const char** start, size_t* length)
+{
+  const char* data = splitter->data;
+
+  while (splitter->pos < splitter->length)
+  {
+    size_t begin = splitter->pos;
+    const char* newline = (const char*)memchr(data + begin, '\n', splitter->length - begin);
+    size_t end = newline != NULL ? (size_t)(newline - data) : splitter->length;
+    splitter->pos = end + 1;
+
+    while (begin < end && isSequenceSpace(data[begin]))
+      begin++;
+    while (end > begin && isSequenceSpace(data[end - 1]))
+      end--;
+
+    if (begin < end)
+    {
+      *start = data + begin;
+      *length = end - begin;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static bool nextSequenceStructural(SequenceSplitter* splitter, size_t* offset)
+{
+  StructuralIndex* index = splitter->index;
+  while (splitter->next >= index->size)
+  {
+    if (index->scanned >= splitter->length)
+      return false;
+
+    index->size = 0;
+    splitter->next = 0;
+    indexStructurals(index, splitter->data, splitter->length, SEQUENCE_INDEX_SIZE);
+  }
+
+  *offset = index->offsets[splitter->next++];
+  return true;
+}
+
+/**
+ * Finds the next top-level value by following the nesting of the structural
+ * characters. A stray ',', ':' or closing brace is a document of its own, so
+ * that it is reported instead of being silently ignored.
+ */
+static bool nextConcatenated(SequenceSplitter* splitter, const char** start, size_t* length)
+{
+  const char* data = splitter->data;
+  size_t depth = 0;
+  size_t begin = 0;
+  size_t end = splitter->length;
+  bool started = false;
+  size_t offset;
+
+  while (nextSequenceStructural(splitter, &offset))
+  {
+    if (!started)
+    {
+      begin = offset;
+      started = true;
+    }
+
+    char c = data[offset];
+    if (c == '"')
+    {
+      // The next structural after an opening quote is its closing quote
+      size_t close;
+      if (!nextSequenceStructural(splitter, &close))
+        break;
+      if (depth == 0)
+      {
+        end = close + 1;
+        break;
+      }
+    }
+    else if (c == '{' || c == '[')
+    {
+      depth++;
+    }
+    else if (c == '}' || c == ']')
+    {
+      if (depth > 0)
+        depth--;
+      if (depth == 0)
+      {
+        end = offset + 1;
+        break;
+      }
+    }
+    else if (c == ',' || c == ':')
+    {
+      if (depth == 0)
+      {
+        end = offset + 1;
+        break;
+      }
+    }
+    else if (depth == 0)
+    {
+      // A top-level number or literal runs up to the next structural
+      size_t following;
+      if (nextSequenceStructural(splitter, &following))
+      {
+        splitter->next--;
+        end = following;
+      }
+      break;
+    }
+  }
+
+  if (!started)
+    return false;
+
+  while (end > begin && isSequenceSpace(data[end - 1]))
+    end--;
+
+  *start = data + begin;
+  *length = end - begin;
+  return true;
+}
+
+static bool nextDocument(SequenceSplitter* splitter, const char** start, size_t* length)
+{
+  if (splitter->format == JSON_SEQUENCE_LINES)
+    return nextLine(splitter, start, length);
+  return nextConcatenated(splitter, start, length);
+}
+
+/**
+ * BATCHES
+ */
+
+typedef struct SequenceDocument
+{
+  const char* start;
+  size_t length;
+  JsonNode* root;
+  char* error;
+} SequenceDocument;
+
+typedef enum SequenceBatchState
+{
+  BATCH_FREE = 0,
+  BATCH_QUEUED,
+  BATCH_RUNNING,
+  BATCH_DONE
+} SequenceBatchState;
+
+typedef struct SequenceBatch
+{
+  SequenceBatchState state;
+  size_t seq;
+  SequenceDocument* documents;
+  size_t capacity;
+  size_t size;
+} SequenceBatch;
+
+/**
+ * Fills the batch with whole documents up to batchSize bytes, returns false
+ * if the input has no documents left.
+ */
+static bool fillBatch(SequenceBatch* batch, SequenceSplitter* splitter, size_t batchSize)
+{
+  batch->size = 0;
+
+  const char* start;
+  size_t length;
+  size_t bytes = 0;
+  while (bytes < batchSize && nextDocument(splitter, &start, &length))
+  {
+    batch->documents = (SequenceDocument*)vec_alloc(batch->documents, &batch->capacity, batch->size + 1, sizeof(SequenceDocument));
+    SequenceDocument* document = &batch->documents[batch->size++];
+    document->start = start;
+    document->length = length;
+    document->root = NULL;
+    document->error = NULL;
+    bytes += length;
+  }
+
+  return batch->size > 0;
+}
+
+/**
+ * Parses a document that, unlike parseJsonBuffer, must use up all of its
+ * tokens: a line like {"a":1} {"b":2} or 2] is reported at the first token
+ * left over instead of losing it.
+ */
+static JsonNode* parseDocument(const char* data, size_t length, char** strError)
+{
+  LexError lexError;
+  TokenManager* manager = lex(data, length, &lexError);
+  if (lexError.type != NO_LEX_ERROR)
+  {
+    *strError = buildLexStringError(&lexError);
+    deleteTokenManager(manager);
+    return NULL;
+  }
+
+  ParseContext context;
+  ParserError parserError;
+  initParseContext(&context, data, manager, NULL);
+  JsonNode* root = parse(&context, &parserError);
+  clearParseContext(&context);
+
+  if (parserError.type == NO_PARSER_ERROR && manager->pos < manager->size)
+  {
+    parserError.type = UNEXPECTED_TOKEN;
+    parserError.token = manager->tokens[manager->pos];
+  }
+
+  if (parserError.type != NO_PARSER_ERROR)
+  {
+    *strError = buildParseStringError(&parserError);
+    freeJsonTree(root);
+    root = NULL;
+  }
+
+  deleteTokenManager(manager);
+  return root;
+}
+
+static void parseBatch(SequenceBatch* batch)
+{
+  for (size_t i = 0; i < batch->size; i++)
+  {
+    SequenceDocument* document = &batch->documents[i];
+    document->root = parseDocument(document->start, document->length, &document->error);
+  }
+}
+
+/**
+ * Hands the documents of the batch to the callback, or frees them once the
+ * callback has asked to stop.
+ */
+static void deliverBatch(SequenceBatch* batch, const JsonSequenceOptions* options, bool* stopped)
+{
+  for (size_t i = 0; i < batch->size; i++)
+  {
+    SequenceDocument* document = &batch->documents[i];
+    if (!*stopped)
+    {
+      if (!options->onDocument(options->userData, document->start, document->length, document->root, document->error))
+        *stopped = true;
+    }
+    else
+    {
+      freeJsonTree(document->root);
+    }
+    free(document->error);
+  }
+  batch->size = 0;
+}
+
+/**
+ * THREAD POOL
+ */
+
+typedef struct SequencePool
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t batchQueued; // Signaled to the workers
+  pthread_cond_t batchDone;   // Signaled to the calling thread
+  SequenceBatch* batches;
+  size_t batchCount;
+  bool shutdown;
+} SequencePool;
+
+static SequenceBatch* findBatch(SequencePool* pool, SequenceBatchState state)
+{
+  // The oldest one, so that ordered delivery is never kept waiting
+  SequenceBatch* found = NULL;
+  for (size_t i = 0; i < pool->batchCount; i++)
+  {
+    SequenceBatch* batch = &pool->batches[i];
+    if (batch->state == state && (found == NULL || batch->seq < found->seq))
+      found = batch;
+  }
+  return found;
+}
+
+static void* runSequenceWorker(void* arg)
+{
+  SequencePool* pool = (SequencePool*)arg;
+
+  pthread_mutex_lock(&pool->mutex);
+  while (true)
+  {
+    SequenceBatch* batch = findBatch(pool, BATCH_QUEUED);
+    if (batch == NULL)
+    {
+      if (pool->shutdown)
+        break;
+      pthread_cond_wait(&pool->batchQueued, &pool->mutex);
+      continue;
+    }
+
+    batch->state = BATCH_RUNNING;
+    pthread_mutex_unlock(&pool->mutex);
+
+    parseBatch(batch);
+
+    pthread_mutex_lock(&pool->mutex);
+    batch->state = BATCH_DONE;
+    pthread_cond_signal(&pool->batchDone);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  return NULL;
+}
+
+static bool isPoolBusy(SequencePool* pool)
+{
+  for (size_t i = 0; i < pool->batchCount; i++)
+    if (pool->batches[i].state != BATCH_FREE)
+      return true;
+  return false;
+}
+
+/**
+ * Keeps the workers fed with batches and delivers the parsed ones, all from
+ * the calling thread. Returns false if the callback asked to stop.
+ */
+static bool runSequencePool(SequencePool* pool, SequenceSplitter* splitter, const JsonSequenceOptions* options, size_t batchSize)
+{
+  size_t nextSeq = 0;
+  size_t deliverSeq = 0;
+  bool hasInput = true;
+  bool stopped = false;
+
+  pthread_mutex_lock(&pool->mutex);
+  while (true)
+  {
+    // Free batches are only ever touched by this thread, fill them unlocked
+    SequenceBatch* batch;
+    while (hasInput && !stopped && (batch = findBatch(pool, BATCH_FREE)) != NULL)
+    {
+      pthread_mutex_unlock(&pool->mutex);
+      hasInput = fillBatch(batch, splitter, batchSize);
+      pthread_mutex_lock(&pool->mutex);
+
+      if (hasInput)
+      {
+        batch->seq = nextSeq++;
+        batch->state = BATCH_QUEUED;
+        pthread_cond_signal(&pool->batchQueued);
+      }
+    }
+
+    batch = findBatch(pool, BATCH_DONE);
+    if (batch != NULL && (options->unordered || batch->seq == deliverSeq))
+    {
+      pthread_mutex_unlock(&pool->mutex);
+      deliverBatch(batch, options, &stopped);
+      pthread_mutex_lock(&pool->mutex);
+
+      batch->state = BATCH_FREE;
+      deliverSeq++;
+      continue;
+    }
+
+    if (!isPoolBusy(pool))
+      break;
+    pthread_cond_wait(&pool->batchDone, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  return !stopped;
+}
+
+static bool runSequenceInline(SequenceBatch* batch, SequenceSplitter* splitter, const JsonSequenceOptions* options, size_t batchSize)
+{
+  bool stopped = false;
+  while (!stopped && fillBatch(batch, splitter, batchSize))
+  {
+    parseBatch(batch);
+    deliverBatch(batch, options, &stopped);
+  }
+  return !stopped;
+}
+
+bool parseJsonSequence(const char* data, size_t length, const JsonSequenceOptions* options, char** strError)
+{
+  size_t threads = options->threads > 0 ? options->threads : countProcessors();
+  size_t batchSize = options->batchSize > 0 ? options->batchSize : SEQUENCE_BATCH_SIZE;
+
+  SequenceSplitter splitter;
+  splitter.data = data;
+  splitter.length = length;
+  splitter.pos = 0;
+  splitter.format = options->format;
+  splitter.index = options->format == JSON_SEQUENCE_CONCATENATED ? createStructuralIndex() : NULL;
+  splitter.next = 0;
+
+  SequencePool pool;
+  pool.batchCount = threads * SEQUENCE_BATCHES_PER_THREAD;
+  pool.batches = (SequenceBatch*)calloc(pool.batchCount, sizeof(SequenceBatch));
+  pool.shutdown = false;
+  pthread_mutex_init(&pool.mutex, NULL);
+  pthread_cond_init(&pool.batchQueued, NULL);
+  pthread_cond_init(&pool.batchDone, NULL);
+
+  // A single worker would only add hand-offs, the calling thread parses
+  // alone also when no thread can be started
+  pthread_t* workers = (pthread_t*)malloc(threads * sizeof(pthread_t));
+  size_t started = 0;
+  while (threads > 1 && started < threads && pthread_create(&workers[started], NULL, runSequenceWorker, &pool) == 0)
+    started++;
+
+  bool completed;
+  if (started > 0)
+    completed = runSequencePool(&pool, &splitter, options, batchSize);
+  else
+    completed = runSequenceInline(&pool.batches[0], &splitter, options, batchSize);
+
+  pthread_mutex_lock(&pool.mutex);
+  pool.shutdown = true;
+  pthread_cond_broadcast(&pool.batchQueued);
+  pthread_mutex_unlock(&pool.mutex);
+
+  for (size_t i = 0; i < started; i++)
+    pthread_join(workers[i], NULL);
+  free(workers);
+
+  pthread_mutex_destroy(&pool.mutex);
+  pthread_cond_destroy(&pool.batchQueued);
+  pthread_cond_destroy(&pool.batchDone);
+
+  for (size_t i = 0; i < pool.batchCount; i++)
+    free(pool.batches[i].documents);
+  free(pool.batches);
+
+  if (splitter.index != NULL)
+    deleteStructuralIndex(splitter.index);
+
+  if (!completed && strError != NULL)
+    *strError = vstrdup("Error: Parsing aborted by the document callback\n");
+  return completed;
+}
+
+bool parseJsonSequenceFile(const char* filename, const JsonSequenceOptions* options, char** strError)
+{
+  FileBuffer jsonFile;
+
+  if (!openFileBuffer(filename, &jsonFile))
+  {
+    if (strError != NULL)
+      *strError = vstrdup("Error: Cannot open file '%s'", filename);
+    return false;
+  }
+
+  bool completed = parseJsonSequence(jsonFile.data, jsonFile.length, options, strError);
+
+  closeFileBuffer(&jsonFile);
+  return completed;
+}
@@ -0,0 +1,316 @@
+#include "json-parser.h"
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define STRING_BLOCK_SIZE 16
+
+static int trailingZeros32(uint32_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctz(bits);
+#else
+  int count = 0;
+  while ((bits & 1) == 0)
+  {
+    bits >>= 1;
+    count++;
+  }
+  return count;
+#endif
+}
+
+/**
+ * Copies the leading run of plain bytes (printable ASCII other than '\\')
+ * and returns its length. Only fully plain blocks are stored, so that dst
+ * may trail src in the same buffer without overwriting unread bytes.
+ */
+static size_t copyPlainRun(const char* src, size_t length, char* dst)
+{
+  size_t pos = 0;
+
+#ifdef __SSE2__
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i space = _mm_set1_epi8(' ');
+
+  while (length - pos >= STRING_BLOCK_SIZE)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)(src + pos));
+
+    // The signed comparison also flags bytes >= 0x80, which are negative
+    __m128i special = _mm_or_si128(_mm_cmpeq_epi8(v, backslash), _mm_cmplt_epi8(v, space));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(special);
+    if (mask != 0)
+    {
+      size_t run = (size_t)trailingZeros32(mask);
+      memmove(dst + pos, src + pos, run);
+      return pos + run;
+    }
+
+    _mm_storeu_si128((__m128i*)(dst + pos), v);
+    pos += STRING_BLOCK_SIZE;
+  }
+#endif
+
+  while (pos < length)
+  {
+    unsigned char c = (unsigned char)src[pos];
+    if (c == '\\' || c < 0x20 || c >= 0x80)
+      break;
+    dst[pos++] = (char)c;
+  }
+
+  return pos;
+}
+
+bool isPlainJsonString(const char* src, size_t length)
+{
+  size_t pos = 0;
+
+#ifdef __SSE2__
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i space = _mm_set1_epi8(' ');
+
+  while (length - pos >= STRING_BLOCK_SIZE)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)(src + pos));
+    __m128i special = _mm_or_si128(_mm_cmpeq_epi8(v, backslash), _mm_cmplt_epi8(v, space));
+    if (_mm_movemask_epi8(special) != 0)
+      return false;
+    pos += STRING_BLOCK_SIZE;
+  }
+#endif
+
+  for (; pos < length; pos++)
+  {
+    unsigned char c = (unsigned char)src[pos];
+    if (c == '\\' || c < 0x20 || c >= 0x80)
+      return false;
+  }
+
+  return true;
+}
+
+static int hexValue(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+/**
+ * Reads the four hex digits of a \u escape starting at src[pos] ('\\').
+ */
+static bool readUnicodeEscape(const char* src, size_t length, size_t pos, uint32_t* codeUnit)
+{
+  if (length - pos < 6 || src[pos + 1] != 'u')
+    return false;
+
+  uint32_t value = 0;
+  for (size_t i = pos + 2; i < pos + 6; i++)
+  {
+    int digit = hexValue(src[i]);
+    if (digit < 0)
+      return false;
+    value = value << 4 | (uint32_t)digit;
+  }
+
+  *codeUnit = value;
+  return true;
+}
+
+static size_t encodeUtf8(uint32_t codePoint, char* dst)
+{
+  if (codePoint < 0x80)
+  {
+    dst[0] = (char)codePoint;
+    return 1;
+  }
+  if (codePoint < 0x800)
+  {
+    dst[0] = (char)(0xC0 | codePoint >> 6);
+    dst[1] = (char)(0x80 | (codePoint & 0x3F));
+    return 2;
+  }
+  if (codePoint < 0x10000)
+  {
+    dst[0] = (char)(0xE0 | codePoint >> 12);
+    dst[1] = (char)(0x80 | (codePoint >> 6 & 0x3F));
+    dst[2] = (char)(0x80 | (codePoint & 0x3F));
+    return 3;
+  }
+  dst[0] = (char)(0xF0 | codePoint >> 18);
+  dst[1] = (char)(0x80 | (codePoint >> 12 & 0x3F));
+  dst[2] = (char)(0x80 | (codePoint >> 6 & 0x3F));
+  dst[3] = (char)(0x80 | (codePoint & 0x3F));
+  return 4;
+}
+
+/**
+ * Decodes the escape sequence at src[*pos] into dst, returns the number of
+ * bytes written or 0 if the sequence is invalid.
+ */
+static size_t decodeEscape(const char* src, size_t length, size_t* pos, char* dst)
+{
+  if (length - *pos < 2)
+    return 0;
+
+  char c;
+  switch (src[*pos + 1])
+  {
+  case '"':
+    c = '"';
+    break;
+  case '\\':
+    c = '\\';
+    break;
+  case '/':
+    c = '/';
+    break;
+  case 'b':
+    c = '\b';
+    break;
+  case 'f':
+    c = '\f';
+    break;
+  case 'n':
+    c = '\n';
+    break;
+  case 'r':
+    c = '\r';
+    break;
+  case 't':
+    c = '\t';
+    break;
+  case 'u':
+  {
+    uint32_t codePoint;
+    if (!readUnicodeEscape(src, length, *pos, &codePoint))
+      return 0;
+    *pos += 6;
+
+    // Characters outside the BMP are escaped as a surrogate pair
+    if (codePoint >= 0xDC00 && codePoint <= 0xDFFF)
+      return 0;
+    if (codePoint >= 0xD800 && codePoint <= 0xDBFF)
+    {
+      uint32_t low;
+      if (!readUnicodeEscape(src, length, *pos, &low) || low < 0xDC00 || low > 0xDFFF)
+        return 0;
+      *pos += 6;
+      codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+    }
+
+    return encodeUtf8(codePoint, dst);
+  }
+  default:
+    return 0;
+  }
+
+  *dst = c;
+  *pos += 2;
+  return 1;
+}
+
+/**
+ * Returns the length of the well-formed UTF-8 sequence at src[pos], or 0
+ * for overlong encodings, surrogates, code points above U+10FFFF and
+ * truncated or stray continuation bytes.
+ */
+static size_t validateUtf8Sequence(const unsigned char* src, size_t length, size_t pos)
+{
+  unsigned char c = src[pos];
+  size_t size;
+  unsigned char min = 0x80, max = 0xBF;
+
+  if (c >= 0xC2 && c <= 0xDF)
+    size = 2;
+  else if (c >= 0xE0 && c <= 0xEF)
+  {
+    size = 3;
+    if (c == 0xE0)
+      min = 0xA0;
+    else if (c == 0xED)
+      max = 0x9F;
+  }
+  else if (c >= 0xF0 && c <= 0xF4)
+  {
+    size = 4;
+    if (c == 0xF0)
+      min = 0x90;
+    else if (c == 0xF4)
+      max = 0x8F;
+  }
+  else
+    return 0;
+
+  if (length - pos < size)
+    return 0;
+
+  // Only the second byte has a restricted range
+  if (src[pos + 1] < min || src[pos + 1] > max)
+    return 0;
+  for (size_t i = 2; i < size; i++)
+    if (src[pos + i] < 0x80 || src[pos + i] > 0xBF)
+      return 0;
+
+  return size;
+}
+
+ParserErrorType decodeJsonString(const char* src, size_t length, char* dst, size_t* dstLength, size_t* errorOffset)
+{
+  size_t pos = 0;
+  size_t out = 0;
+
+  while (true)
+  {
+    size_t run = copyPlainRun(src + pos, length - pos, dst + out);
+    pos += run;
+    out += run;
+
+    if (pos == length)
+      break;
+
+    unsigned char c = (unsigned char)src[pos];
+    ParserErrorType error = NO_PARSER_ERROR;
+
+    if (c == '\\')
+    {
+      size_t written = decodeEscape(src, length, &pos, dst + out);
+      if (written == 0)
+        error = INVALID_ESCAPE_SEQUENCE;
+      out += written;
+    }
+    else if (c < 0x20)
+    {
+      error = UNESCAPED_CONTROL_CHARACTER;
+    }
+    else
+    {
+      size_t size = validateUtf8Sequence((const unsigned char*)src, length, pos);
+      if (size == 0)
+        error = INVALID_UTF8_SEQUENCE;
+      memmove(dst + out, src + pos, size);
+      pos += size;
+      out += size;
+    }
+
+    if (error != NO_PARSER_ERROR)
+    {
+      if (errorOffset != NULL)
+        *errorOffset = pos;
+      return error;
+    }
+  }
+
+  dst[out] = '\0';
+  if (dstLength != NULL)
+    *dstLength = out;
+  return NO_PARSER_ERROR;
+}
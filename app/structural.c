@@ -0,0 +1,282 @@
+#include "json-parser.h"
+#include "utils.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// SIMD classification needs GCC/Clang for target attributes and CPU detection
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define STRUCTURAL_X86
+#include <immintrin.h>
+#endif
+
+#define BLOCK_SIZE 64
+
+/**
+ * Bitmask di classificazione di un blocco da 64 byte: il bit i corrisponde
+ * al byte i del blocco.
+ */
+typedef struct BlockMasks
+{
+  uint64_t quote;      /**< Doppi apici */
+  uint64_t backslash;  /**< Backslash */
+  uint64_t operators;  /**< Caratteri { } [ ] , : */
+  uint64_t whitespace; /**< Spazi (come isspace) */
+} BlockMasks;
+
+StructuralIndex* createStructuralIndex()
+{
+  StructuralIndex* index = (StructuralIndex*)malloc(sizeof(StructuralIndex));
+  index->offsets = NULL;
+  index->capacity = 0;
+  resetStructuralIndex(index);
+  return index;
+}
+
+void resetStructuralIndex(StructuralIndex* index)
+{
+  index->size = 0;
+  index->scanned = 0;
+  index->inString = 0;
+  index->escaped = 0;
+  index->inScalar = 0;
+}
+
+void deleteStructuralIndex(StructuralIndex* index)
+{
+  free(index->offsets);
+  free(index);
+}
+
+static void classifyScalar(const unsigned char* block, BlockMasks* masks)
+{
+  masks->quote = masks->backslash = masks->operators = masks->whitespace = 0;
+
+  for (int i = 0; i < BLOCK_SIZE; i++)
+  {
+    uint64_t bit = (uint64_t)1 << i;
+    unsigned char c = block[i];
+
+    switch (c)
+    {
+    case '"':
+      masks->quote |= bit;
+      break;
+    case '\\':
+      masks->backslash |= bit;
+      break;
+    case '{':
+    case '}':
+    case '[':
+    case ']':
+    case ',':
+    case ':':
+      masks->operators |= bit;
+      break;
+    case ' ':
+    case '\t':
+    case '\n':
+    case '\v':
+    case '\f':
+    case '\r':
+      masks->whitespace |= bit;
+      break;
+    }
+  }
+}
+
+#ifdef STRUCTURAL_X86
+__attribute__((target("sse2"))) static void classifySSE2(const unsigned char* block, BlockMasks* masks)
+{
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i curlyOpen = _mm_set1_epi8('{');
+  const __m128i curlyClose = _mm_set1_epi8('}');
+  const __m128i bracketOpen = _mm_set1_epi8('[');
+  const __m128i bracketClose = _mm_set1_epi8(']');
+  const __m128i comma = _mm_set1_epi8(',');
+  const __m128i colon = _mm_set1_epi8(':');
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i four = _mm_set1_epi8(4);
+
+  masks->quote = masks->backslash = masks->operators = masks->whitespace = 0;
+
+  for (int i = 0; i < BLOCK_SIZE; i += 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)(block + i));
+
+    __m128i ops = _mm_or_si128(
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, curlyOpen), _mm_cmpeq_epi8(v, curlyClose)),
+                     _mm_or_si128(_mm_cmpeq_epi8(v, bracketOpen), _mm_cmpeq_epi8(v, bracketClose))),
+        _mm_or_si128(_mm_cmpeq_epi8(v, comma), _mm_cmpeq_epi8(v, colon)));
+
+    // '\t'..'\r' are five consecutive values: (c - '\t') <= 4 as unsigned bytes
+    __m128i controls = _mm_sub_epi8(v, tab);
+    __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(_mm_min_epu8(controls, four), controls));
+
+    masks->quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << i;
+    masks->backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)) << i;
+    masks->operators |= (uint64_t)(uint16_t)_mm_movemask_epi8(ops) << i;
+    masks->whitespace |= (uint64_t)(uint16_t)_mm_movemask_epi8(ws) << i;
+  }
+}
+
+__attribute__((target("avx2"))) static void classifyAVX2(const unsigned char* block, BlockMasks* masks)
+{
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i curlyOpen = _mm256_set1_epi8('{');
+  const __m256i curlyClose = _mm256_set1_epi8('}');
+  const __m256i bracketOpen = _mm256_set1_epi8('[');
+  const __m256i bracketClose = _mm256_set1_epi8(']');
+  const __m256i comma = _mm256_set1_epi8(',');
+  const __m256i colon = _mm256_set1_epi8(':');
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i four = _mm256_set1_epi8(4);
+
+  masks->quote = masks->backslash = masks->operators = masks->whitespace = 0;
+
+  for (int i = 0; i < BLOCK_SIZE; i += 32)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(block + i));
+
+    __m256i ops = _mm256_or_si256(
+        _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, curlyOpen), _mm256_cmpeq_epi8(v, curlyClose)),
+                        _mm256_or_si256(_mm256_cmpeq_epi8(v, bracketOpen), _mm256_cmpeq_epi8(v, bracketClose))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, comma), _mm256_cmpeq_epi8(v, colon)));
+
+    __m256i controls = _mm256_sub_epi8(v, tab);
+    __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(_mm256_min_epu8(controls, four), controls));
+
+    masks->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)) << i;
+    masks->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash)) << i;
+    masks->operators |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ops) << i;
+    masks->whitespace |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << i;
+  }
+}
+#endif
+
+typedef void (*ClassifyFunction)(const unsigned char* block, BlockMasks* masks);
+
+static ClassifyFunction selectClassifier()
+{
+#ifdef STRUCTURAL_X86
+  if (__builtin_cpu_supports("avx2"))
+    return classifyAVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return classifySSE2;
+#endif
+  return classifyScalar;
+}
+
+static uint64_t prefixXor(uint64_t bits)
+{
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+  return bits;
+}
+
+static int trailingZeros(uint64_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(bits);
+#else
+  int count = 0;
+  while ((bits & 1) == 0)
+  {
+    bits >>= 1;
+    count++;
+  }
+  return count;
+#endif
+}
+
+/**
+ * Restituisce la maschera dei caratteri preceduti da un numero dispari di
+ * backslash, propagando lo stato tra un blocco e il successivo.
+ */
+static uint64_t findEscaped(uint64_t backslash, uint64_t* prevEscaped)
+{
+  const uint64_t evenBits = 0x5555555555555555ULL;
+
+  backslash &= ~*prevEscaped;
+  uint64_t followsEscape = backslash << 1 | *prevEscaped;
+
+  // Adding the start of each run beginning on an odd bit to the backslashes
+  // carries it past the end of the run, which flips the parity of the bits
+  // that are escaped for those runs
+  uint64_t oddSequenceStarts = backslash & ~evenBits & ~followsEscape;
+  uint64_t sequencesStartingOnEvenBits = oddSequenceStarts + backslash;
+  *prevEscaped = sequencesStartingOnEvenBits < oddSequenceStarts;
+
+  uint64_t invertMask = sequencesStartingOnEvenBits << 1;
+  return (evenBits ^ invertMask) & followsEscape;
+}
+
+void indexStructurals(StructuralIndex* index, const char* json, size_t length, size_t maxBytes)
+{
+  // Threads parsing at the same time may all select it, they store the same
+  // function so relaxed atomics are enough to keep the accesses well defined
+  static ClassifyFunction selected = NULL;
+  ClassifyFunction classify = __atomic_load_n(&selected, __ATOMIC_RELAXED);
+  if (classify == NULL)
+  {
+    classify = selectClassifier();
+    __atomic_store_n(&selected, classify, __ATOMIC_RELAXED);
+  }
+
+  size_t end = length - index->scanned > maxBytes ? index->scanned + maxBytes : length;
+
+  while (index->scanned < end)
+  {
+    // Every byte of a block may be a structural
+    if (index->size + BLOCK_SIZE > index->capacity)
+      index->offsets = (size_t*)vec_alloc(index->offsets, &index->capacity, index->size + BLOCK_SIZE, sizeof(size_t));
+
+    const unsigned char* block = (const unsigned char*)json + index->scanned;
+    unsigned char padded[BLOCK_SIZE];
+
+    // The last partial block is padded with spaces which are never indexed
+    if (length - index->scanned < BLOCK_SIZE)
+    {
+      memset(padded, ' ', BLOCK_SIZE);
+      memcpy(padded, block, length - index->scanned);
+      block = padded;
+    }
+
+    BlockMasks masks;
+    classify(block, &masks);
+
+    uint64_t escaped = findEscaped(masks.backslash, &index->escaped);
+    uint64_t quotes = masks.quote & ~escaped;
+
+    // Bits from an opening quote up to (excluding) its closing quote
+    uint64_t inString = prefixXor(quotes) ^ index->inString;
+    index->inString = (uint64_t)((int64_t)inString >> 63);
+
+    // Anything that is neither whitespace nor an operator nor part of a
+    // string belongs to a scalar (numbers, literals or invalid characters)
+    uint64_t scalar = ~(masks.operators | masks.whitespace | quotes | inString);
+    uint64_t scalarStarts = scalar & ~(scalar << 1 | index->inScalar);
+    index->inScalar = scalar >> 63;
+
+    uint64_t structurals = (masks.operators & ~inString) | quotes | scalarStarts;
+
+    while (structurals != 0)
+    {
+      index->offsets[index->size++] = index->scanned + trailingZeros(structurals);
+      structurals &= structurals - 1;
+    }
+
+    index->scanned += BLOCK_SIZE;
+  }
+
+  if (index->scanned > length)
+    index->scanned = length;
+}
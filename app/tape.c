@@ -0,0 +1,559 @@
+#include "json-parser.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Each tape word keeps its tag in the top byte and a 56 bit payload
+#define TAPE_TAG_SHIFT 56
+#define TAPE_PAYLOAD_MASK (((uint64_t)1 << TAPE_TAG_SHIFT) - 1)
+
+// Open container payload: index after the matching close in the low 32
+// bits, number of children (saturated) in the next 24 bits
+#define TAPE_COUNT_SHIFT 32
+#define TAPE_COUNT_MAX 0xFFFFFF
+
+#define TAPE_OBJECT_OPEN '{'
+#define TAPE_OBJECT_CLOSE '}'
+#define TAPE_ARRAY_OPEN '['
+#define TAPE_ARRAY_CLOSE ']'
+#define TAPE_STRING '"'
+#define TAPE_INTEGER 'l'
+#define TAPE_DOUBLE 'd'
+#define TAPE_TRUE 't'
+#define TAPE_FALSE 'f'
+#define TAPE_NULL 'n'
+
+JsonTape* createJsonTape()
+{
+  JsonTape* tape = (JsonTape*)malloc(sizeof(JsonTape));
+  tape->words = NULL;
+  tape->capacity = 0;
+  tape->size = 0;
+  tape->strings = NULL;
+  tape->stringsCapacity = 0;
+  tape->stringsSize = 0;
+  return tape;
+}
+
+void deleteJsonTape(JsonTape* tape)
+{
+  if (tape == NULL)
+    return;
+
+  free(tape->words);
+  free(tape->strings);
+  free(tape);
+}
+
+static size_t appendWord(JsonTape* tape, uint64_t word)
+{
+  tape->size++;
+  tape->words = (uint64_t*)vec_alloc(tape->words, &tape->capacity, tape->size, sizeof(uint64_t));
+  tape->words[tape->size - 1] = word;
+  return tape->size - 1;
+}
+
+static uint64_t tapeWord(char tag, uint64_t payload)
+{
+  return (uint64_t)(unsigned char)tag << TAPE_TAG_SHIFT | (payload & TAPE_PAYLOAD_MASK);
+}
+
+static char tapeTag(const JsonTape* tape, size_t ref)
+{
+  return (char)(tape->words[ref] >> TAPE_TAG_SHIFT);
+}
+
+static uint64_t tapePayload(const JsonTape* tape, size_t ref)
+{
+  return tape->words[ref] & TAPE_PAYLOAD_MASK;
+}
+
+/**
+ * Strings are stored in the string buffer as a 32 bit length followed by
+ * the bytes and a '\0', the tape word points at the length.
+ */
+static void appendString(JsonTape* tape, const char* str, size_t length)
+{
+  size_t offset = tape->stringsSize;
+  uint32_t length32 = (uint32_t)length;
+
+  tape->stringsSize += sizeof(uint32_t) + length + 1;
+  tape->strings = (char*)vec_alloc(tape->strings, &tape->stringsCapacity, tape->stringsSize, 1);
+
+  memcpy(tape->strings + offset, &length32, sizeof(uint32_t));
+  memcpy(tape->strings + offset + sizeof(uint32_t), str, length);
+  tape->strings[offset + sizeof(uint32_t) + length] = '\0';
+
+  appendWord(tape, tapeWord(TAPE_STRING, offset));
+}
+
+/**
+ * Decodes a string token straight into the string buffer, which is first
+ * grown for the raw length and then shrunk to the decoded one.
+ */
+static bool appendTokenString(JsonTape* tape, const char* json, Token* token, ParserError* error)
+{
+  size_t offset = tape->stringsSize;
+  size_t rawLength = token->endPos - token->startPos - 1;
+
+  tape->strings = (char*)vec_alloc(tape->strings, &tape->stringsCapacity, offset + sizeof(uint32_t) + rawLength + 1, 1);
+
+  size_t length, errorOffset;
+  ParserErrorType errorType = decodeJsonString(json + token->startPos + 1, rawLength, tape->strings + offset + sizeof(uint32_t), &length, &errorOffset);
+  if (errorType != NO_PARSER_ERROR)
+  {
+    if (error)
+    {
+      error->type = errorType;
+      error->token = *token;
+      error->token.charCount += errorOffset + 1;
+    }
+    return false;
+  }
+
+  uint32_t length32 = (uint32_t)length;
+  memcpy(tape->strings + offset, &length32, sizeof(uint32_t));
+  tape->stringsSize = offset + sizeof(uint32_t) + length + 1;
+
+  appendWord(tape, tapeWord(TAPE_STRING, offset));
+  return true;
+}
+
+static void appendInteger(JsonTape* tape, int64_t value)
+{
+  appendWord(tape, tapeWord(TAPE_INTEGER, 0));
+  uint64_t word;
+  memcpy(&word, &value, sizeof(word));
+  appendWord(tape, word);
+}
+
+static void appendDouble(JsonTape* tape, double value)
+{
+  appendWord(tape, tapeWord(TAPE_DOUBLE, 0));
+  uint64_t word;
+  memcpy(&word, &value, sizeof(word));
+  appendWord(tape, word);
+}
+
+static void closeTapeContainer(JsonTape* tape, size_t openRef, char closeTag, size_t count)
+{
+  size_t closeRef = appendWord(tape, tapeWord(closeTag, openRef));
+  if (count > TAPE_COUNT_MAX)
+    count = TAPE_COUNT_MAX;
+
+  char openTag = tapeTag(tape, openRef);
+  tape->words[openRef] = tapeWord(openTag, (uint64_t)count << TAPE_COUNT_SHIFT | (closeRef + 1));
+}
+
+/**
+ * TAPE ACCESSORS
+ */
+
+JsonNodeType jsonTapeType(const JsonTape* tape, size_t ref)
+{
+  switch (tapeTag(tape, ref))
+  {
+  case TAPE_OBJECT_OPEN:
+    return OBJECT_NODE;
+  case TAPE_ARRAY_OPEN:
+    return ARRAY_NODE;
+  case TAPE_STRING:
+    return STRING_NODE;
+  case TAPE_INTEGER:
+    return INTEGER_NODE;
+  case TAPE_DOUBLE:
+    return DOUBLE_NODE;
+  case TAPE_TRUE:
+  case TAPE_FALSE:
+    return BOOLEAN_NODE;
+  }
+  return NULL_NODE;
+}
+
+const char* jsonTapeString(const JsonTape* tape, size_t ref, size_t* length)
+{
+  const char* entry = tape->strings + tapePayload(tape, ref);
+  if (length != NULL)
+  {
+    uint32_t length32;
+    memcpy(&length32, entry, sizeof(uint32_t));
+    *length = length32;
+  }
+  return entry + sizeof(uint32_t);
+}
+
+int64_t jsonTapeInteger(const JsonTape* tape, size_t ref)
+{
+  int64_t value;
+  memcpy(&value, &tape->words[ref + 1], sizeof(value));
+  return value;
+}
+
+double jsonTapeDouble(const JsonTape* tape, size_t ref)
+{
+  double value;
+  memcpy(&value, &tape->words[ref + 1], sizeof(value));
+  return value;
+}
+
+bool jsonTapeBoolean(const JsonTape* tape, size_t ref)
+{
+  return tapeTag(tape, ref) == TAPE_TRUE;
+}
+
+size_t jsonTapeSize(const JsonTape* tape, size_t ref)
+{
+  return (size_t)(tapePayload(tape, ref) >> TAPE_COUNT_SHIFT);
+}
+
+size_t jsonTapeFirstChild(const JsonTape* tape, size_t ref)
+{
+  // The first child always follows the opening word
+  (void)tape;
+  return ref + 1;
+}
+
+size_t jsonTapeEnd(const JsonTape* tape, size_t ref)
+{
+  return (size_t)(tapePayload(tape, ref) & 0xFFFFFFFF) - 1;
+}
+
+size_t jsonTapeNext(const JsonTape* tape, size_t ref)
+{
+  switch (tapeTag(tape, ref))
+  {
+  case TAPE_OBJECT_OPEN:
+  case TAPE_ARRAY_OPEN:
+    return (size_t)(tapePayload(tape, ref) & 0xFFFFFFFF);
+  case TAPE_INTEGER:
+  case TAPE_DOUBLE:
+    return ref + 2;
+  }
+  return ref + 1;
+}
+
+size_t jsonTapeNextMember(const JsonTape* tape, size_t keyRef)
+{
+  return jsonTapeNext(tape, keyRef + 1);
+}
+
+/**
+ * TAPE BUILDING
+ */
+
+static bool parseTapeValue(JsonTape* tape, const char* json, TokenManager* manager, ParserError* error);
+
+/**
+ * Reports a syntax error at token, or at the last token read when the input
+ * ended where a token was expected.
+ */
+static bool setTapeError(TokenManager* manager, ParserError* error, ParserErrorType type, Token* token)
+{
+  if (error)
+  {
+    error->type = type;
+    error->token.lineCount = 0;
+    error->token.charCount = 0;
+
+    if (token == NULL)
+      token = previousToken(manager);
+    if (token != NULL)
+      error->token = *token;
+  }
+  return false;
+}
+
+static bool parseTapeObject(JsonTape* tape, const char* json, TokenManager* manager, ParserError* error)
+{
+  size_t openRef = appendWord(tape, tapeWord(TAPE_OBJECT_OPEN, 0));
+  size_t count = 0;
+
+  Token* token = advance(manager);
+  if (token == NULL)
+    return setTapeError(manager, error, EXPECTED_END_OF_OBJECT_BRACE, NULL);
+
+  if (token->type != CURLY_CLOSE)
+  {
+    manager->pos--;
+    while (true)
+    {
+      token = advance(manager);
+      if (token == NULL || token->type != STRING_LEX)
+        return setTapeError(manager, error, EXPECTED_OBJECT_KEY, token);
+
+      if (!appendTokenString(tape, json, token, error))
+        return false;
+
+      token = advance(manager);
+      if (token == NULL || token->type != COLON)
+        return setTapeError(manager, error, EXPECTED_COLON, token);
+
+      if (!parseTapeValue(tape, json, manager, error))
+        return false;
+      count++;
+
+      token = advance(manager);
+      if (token == NULL)
+        return setTapeError(manager, error, EXPECTED_END_OF_OBJECT_BRACE, NULL);
+
+      if (token->type == CURLY_CLOSE)
+        break;
+
+      if (token->type != COMMA)
+        return setTapeError(manager, error, EXPECTED_COMMA, token);
+    }
+  }
+
+  closeTapeContainer(tape, openRef, TAPE_OBJECT_CLOSE, count);
+  return true;
+}
+
+static bool parseTapeArray(JsonTape* tape, const char* json, TokenManager* manager, ParserError* error)
+{
+  size_t openRef = appendWord(tape, tapeWord(TAPE_ARRAY_OPEN, 0));
+  size_t count = 0;
+
+  Token* token = advance(manager);
+  if (token == NULL)
+    return setTapeError(manager, error, EXPECTED_END_OF_ARRAY_BRACE, NULL);
+
+  if (token->type != BRACKET_CLOSE)
+  {
+    manager->pos--;
+    while (true)
+    {
+      if (!parseTapeValue(tape, json, manager, error))
+        return false;
+      count++;
+
+      token = advance(manager);
+      if (token == NULL)
+        return setTapeError(manager, error, EXPECTED_END_OF_ARRAY_BRACE, NULL);
+
+      if (token->type == BRACKET_CLOSE)
+        break;
+
+      if (token->type != COMMA)
+        return setTapeError(manager, error, EXPECTED_COMMA, token);
+    }
+  }
+
+  closeTapeContainer(tape, openRef, TAPE_ARRAY_CLOSE, count);
+  return true;
+}
+
+static bool parseTapeValue(JsonTape* tape, const char* json, TokenManager* manager, ParserError* error)
+{
+  Token* token = advance(manager);
+  if (token == NULL)
+  {
+    return setTapeError(manager, error, NO_TOKEN_FOUND, NULL);
+  }
+
+  size_t length = token->endPos - token->startPos;
+
+  switch (token->type)
+  {
+  case CURLY_OPEN:
+    return parseTapeObject(tape, json, manager, error);
+  case BRACKET_OPEN:
+    return parseTapeArray(tape, json, manager, error);
+  case STRING_LEX:
+    return appendTokenString(tape, json, token, error);
+  case INTEGER_LEX:
+  case DOUBLE_LEX:
+  {
+    JsonNodeType type;
+    JsonValue value;
+    if (!parseJsonNumber(json + token->startPos, length, &type, &value))
+      return setTapeError(manager, error, token->type == INTEGER_LEX ? INVALID_INTEGER_LITERAL : INVALID_DOUBLE_LITERAL, token);
+
+    if (type == INTEGER_NODE)
+      appendInteger(tape, value.v_int);
+    else
+      appendDouble(tape, value.v_double);
+    return true;
+  }
+  case BOOLEAN_LEX:
+    appendWord(tape, tapeWord(json[token->startPos] == 't' ? TAPE_TRUE : TAPE_FALSE, 0));
+    return true;
+  case NULL_LEX:
+    appendWord(tape, tapeWord(TAPE_NULL, 0));
+    return true;
+  default:
+    return setTapeError(manager, error, UNEXPECTED_TOKEN, token);
+  }
+}
+
+JsonTape* parseJsonTapeBuffer(const char* data, size_t length, char** strError)
+{
+  Lexer lexer;
+  initLexer(&lexer, data, length);
+  TokenManager* manager = createTokenStream(&lexer);
+
+  JsonTape* tape = createJsonTape();
+
+  ParserError parserError;
+  parserError.type = NO_PARSER_ERROR;
+  parseTapeValue(tape, data, manager, &parserError);
+
+  // Lexical errors anywhere in the input take precedence, like in parseJsonBuffer
+  Token token;
+  while (lexNextToken(&lexer, &token))
+    ;
+
+  if (lexer.error.type != NO_LEX_ERROR || parserError.type != NO_PARSER_ERROR)
+  {
+    if (strError != NULL)
+      *strError = lexer.error.type != NO_LEX_ERROR ? buildLexStringError(&lexer.error) : buildParseStringError(&parserError);
+    deleteJsonTape(tape);
+    tape = NULL;
+  }
+
+  clearLexer(&lexer);
+  deleteTokenManager(manager);
+  return tape;
+}
+
+/**
+ * CONVERSION
+ */
+
+static void fillNodeFromTape(const JsonTape* tape, size_t ref, JsonNode* node)
+{
+  initJsonNode(node, jsonTapeType(tape, ref));
+
+  size_t length;
+  const char* str;
+
+  switch (node->type)
+  {
+  case NULL_NODE:
+  case INTEGER_ARRAY_NODE:
+  case DOUBLE_ARRAY_NODE:
+    break; // tapes do not pack numbers
+  case STRING_NODE:
+    str = jsonTapeString(tape, ref, &length);
+    setJsonNodeString(node, str, length);
+    break;
+  case INTEGER_NODE:
+    node->value.v_int = jsonTapeInteger(tape, ref);
+    break;
+  case DOUBLE_NODE:
+    node->value.v_double = jsonTapeDouble(tape, ref);
+    break;
+  case BOOLEAN_NODE:
+    node->value.v_bool = jsonTapeBoolean(tape, ref);
+    break;
+  case OBJECT_NODE:
+  case ARRAY_NODE:
+  {
+    // The children count may be saturated, count them while filling
+    size_t capacity = jsonTapeSize(tape, ref);
+    node->value.v_object = capacity > 0 ? (JsonNode*)malloc(capacity * sizeof(JsonNode)) : NULL;
+    node->vCapacity = capacity;
+
+    size_t end = jsonTapeEnd(tape, ref);
+    size_t child = jsonTapeFirstChild(tape, ref);
+    while (child != end)
+    {
+      const char* key = NULL;
+      size_t keyLength = 0;
+      if (node->type == OBJECT_NODE)
+      {
+        key = jsonTapeString(tape, child, &keyLength);
+        child++;
+      }
+
+      node->vSize++;
+      reserveJsonChildren(node, node->vSize);
+
+      JsonNode* childNode = &node->value.v_object[node->vSize - 1];
+      fillNodeFromTape(tape, child, childNode);
+
+      if (key != NULL)
+      {
+        childNode->key = (char*)malloc(keyLength + 1);
+        memcpy(childNode->key, key, keyLength + 1);
+      }
+
+      child = jsonTapeNext(tape, child);
+    }
+    break;
+  }
+  }
+}
+
+JsonNode* jsonTapeToTree(const JsonTape* tape, size_t ref)
+{
+  JsonNode* root = createJsonNode(NULL_NODE);
+  fillNodeFromTape(tape, ref, root);
+  root->isRoot = true;
+  return root;
+}
+
+static void appendTreeNode(JsonTape* tape, const JsonNode* node)
+{
+  switch (node->type)
+  {
+  case NULL_NODE:
+    appendWord(tape, tapeWord(TAPE_NULL, 0));
+    break;
+  case STRING_NODE:
+  {
+    const char* str = jsonNodeString(node);
+    appendString(tape, str, strlen(str));
+    break;
+  }
+  case INTEGER_NODE:
+    appendInteger(tape, node->value.v_int);
+    break;
+  case DOUBLE_NODE:
+    appendDouble(tape, node->value.v_double);
+    break;
+  case BOOLEAN_NODE:
+    appendWord(tape, tapeWord(node->value.v_bool ? TAPE_TRUE : TAPE_FALSE, 0));
+    break;
+  case INTEGER_ARRAY_NODE:
+  case DOUBLE_ARRAY_NODE:
+  {
+    size_t openRef = appendWord(tape, tapeWord(TAPE_ARRAY_OPEN, 0));
+
+    for (size_t i = 0; i < node->vSize; i++)
+    {
+      if (node->type == INTEGER_ARRAY_NODE)
+        appendInteger(tape, node->value.v_integers[i]);
+      else
+        appendDouble(tape, node->value.v_doubles[i]);
+    }
+
+    closeTapeContainer(tape, openRef, TAPE_ARRAY_CLOSE, node->vSize);
+    break;
+  }
+  case OBJECT_NODE:
+  case ARRAY_NODE:
+  {
+    bool isObject = node->type == OBJECT_NODE;
+    size_t openRef = appendWord(tape, tapeWord(isObject ? TAPE_OBJECT_OPEN : TAPE_ARRAY_OPEN, 0));
+
+    for (size_t i = 0; i < node->vSize; i++)
+    {
+      const JsonNode* child = &node->value.v_object[i];
+      if (isObject)
+        appendString(tape, child->key, strlen(child->key));
+      appendTreeNode(tape, child);
+    }
+
+    closeTapeContainer(tape, openRef, isObject ? TAPE_OBJECT_CLOSE : TAPE_ARRAY_CLOSE, node->vSize);
+    break;
+  }
+  }
+}
+
+JsonTape* jsonTreeToTape(const JsonNode* root)
+{
+  JsonTape* tape = createJsonTape();
+  if (root != NULL)
+    appendTreeNode(tape, root);
+  return tape;
+}
@@ -4,17 +4,39 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <stdio.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _MSC_VER
+static __declspec(thread) size_t vecReallocations = 0;
+#else
+static __thread size_t vecReallocations = 0;
+#endif
 
 void* vec_alloc(void* vec, size_t* cap, const size_t size, const size_t elemSize)
 {
   if (size == 0 || elemSize == 0)
     return vec;
 
+  // Already big enough, nothing to do
+  if (vec != NULL && size <= *cap)
+    return vec;
+
   // Funnily enough, there's actually no condition needed to check whether to
   // resize or not since what we want is to have the minimum possible capacity
   // to hold size which can be achieved by taking the log2 of the current size,
   // flooring it then incrementing it by one.
   *cap = pow(2, floor(log2(size)) + 1);
+  vecReallocations++;
 
   void* newVec = realloc(vec, *cap * elemSize);
 
@@ -25,6 +47,139 @@ void* vec_alloc(void* vec, size_t* cap, const size_t size, const size_t elemSize
   return newVec;
 }
 
+size_t vecReallocationCount()
+{
+  return vecReallocations;
+}
+
+double monotonicSeconds()
+{
+#ifdef _WIN32
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+#endif
+}
+
+double lapSeconds(double* clock)
+{
+  double now = monotonicSeconds();
+  double elapsed = now - *clock;
+  *clock = now;
+  return elapsed;
+}
+
+#ifdef _WIN32
+bool openFileBuffer(const char* filename, FileBuffer* buffer)
+{
+  FILE* file = fopen(filename, "rb");
+  if (!file)
+    return false;
+
+  size_t capacity = 0;
+  buffer->data = NULL;
+  buffer->length = 0;
+  buffer->isMapped = false;
+
+  size_t count;
+  do
+  {
+    buffer->data = (char*)vec_alloc(buffer->data, &capacity, buffer->length + BUFSIZ, 1);
+    count = fread(buffer->data + buffer->length, 1, capacity - buffer->length, file);
+    buffer->length += count;
+  } while (count > 0);
+
+  fclose(file);
+  return true;
+}
+#else
+bool openFileBuffer(const char* filename, FileBuffer* buffer)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  buffer->data = NULL;
+  buffer->length = 0;
+  buffer->isMapped = false;
+
+  struct stat info;
+  if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode))
+  {
+    buffer->length = info.st_size;
+
+    // mmap does not accept empty mappings, an empty file is just no content
+    if (buffer->length == 0)
+    {
+      close(fd);
+      return true;
+    }
+
+    void* data = mmap(NULL, buffer->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED)
+    {
+      madvise(data, buffer->length, MADV_SEQUENTIAL);
+      buffer->data = (char*)data;
+      buffer->isMapped = true;
+      close(fd);
+      return true;
+    }
+    buffer->length = 0;
+  }
+
+  // Not a regular file (pipe, socket, device...) or mmap failed, read it all
+  size_t capacity = 0;
+  ssize_t count;
+  do
+  {
+    buffer->data = (char*)vec_alloc(buffer->data, &capacity, buffer->length + BUFSIZ, 1);
+    count = read(fd, buffer->data + buffer->length, capacity - buffer->length);
+    if (count > 0)
+      buffer->length += count;
+  } while (count > 0);
+
+  close(fd);
+
+  if (count < 0)
+  {
+    closeFileBuffer(buffer);
+    return false;
+  }
+  return true;
+}
+#endif
+
+void closeFileBuffer(FileBuffer* buffer)
+{
+#ifndef _WIN32
+  if (buffer->isMapped)
+    munmap(buffer->data, buffer->length);
+  else
+#endif
+    free(buffer->data);
+
+  buffer->data = NULL;
+  buffer->length = 0;
+  buffer->isMapped = false;
+}
+
+size_t countProcessors()
+{
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors;
+#else
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (size_t)count : 1;
+#endif
+}
+
 char* vstrdup(const char* fmt, ...)
 {
   va_list args;
@@ -102,6 +257,18 @@ char* buildParseStringError(ParserError* error)
 
   case UNEXPECTED_TOKEN:
     return buildErrorString("Syntax Error", error->token.lineCount, error->token.charCount, "Unexpected token");
+
+  case INVALID_ESCAPE_SEQUENCE:
+    return buildErrorString("Syntax Error", error->token.lineCount, error->token.charCount, "Invalid escape sequence in string");
+
+  case UNESCAPED_CONTROL_CHARACTER:
+    return buildErrorString("Syntax Error", error->token.lineCount, error->token.charCount, "Unescaped control character in string");
+
+  case INVALID_UTF8_SEQUENCE:
+    return buildErrorString("Syntax Error", error->token.lineCount, error->token.charCount, "Invalid UTF-8 sequence in string");
+
+  case PARSING_ABORTED:
+    return buildErrorString("Parsing Error", error->token.lineCount, error->token.charCount, "Aborted by the event handler");
   }
 
   return NULL;
@@ -159,8 +326,7 @@ void printWithIndent(size_t indent, const char* fmt, ...)
   va_list args;
   va_start(args, fmt);
 
-  for (size_t i = 0; i < indent; i++)
-    printf(" ");
+  printf("%*s", (int)indent, "");
   vprintf(fmt, args);
 
   va_end(args);
@@ -183,13 +349,13 @@ void traverse(JsonNode* node, size_t indent, bool isParentArray)
     printWithIndent(indent, "- ");
     if (!isParentArray)
       printf("%s: ", node->key);
-    printf("%s\n", node->value.v_string);
+    printf("%s\n", jsonNodeString(node));
     break;
   case INTEGER_NODE:
     printWithIndent(indent, "- ");
     if (!isParentArray)
       printf("%s: ", node->key);
-    printf("%d\n", node->value.v_int);
+    printf("%lld\n", (long long)node->value.v_int);
     break;
   case DOUBLE_NODE:
     printWithIndent(indent, "- ");
@@ -205,9 +371,12 @@ void traverse(JsonNode* node, size_t indent, bool isParentArray)
     break;
   case OBJECT_NODE:
   case ARRAY_NODE:
+  case INTEGER_ARRAY_NODE:
+  case DOUBLE_ARRAY_NODE:
   {
     JsonNode* nodeList;
     bool hasNoKey = node->key == NULL;
+    bool isArray = node->type != OBJECT_NODE;
 
     if (node->type == OBJECT_NODE)
     {
@@ -233,11 +402,27 @@ void traverse(JsonNode* node, size_t indent, bool isParentArray)
     }
 
     size_t indentAdd = hasNoKey ? 0 : 2;
-    if (!node->isRoot && hasNoKey && node->type == ARRAY_NODE)
+    if (!node->isRoot && hasNoKey && isArray)
       indentAdd += 2;
 
     for (size_t i = 0; i < node->vSize; i++)
-      traverse(&nodeList[i], indent + indentAdd, node->type == ARRAY_NODE);
+    {
+      // Packed numbers are printed through a node of their own
+      if (node->type == INTEGER_ARRAY_NODE || node->type == DOUBLE_ARRAY_NODE)
+      {
+        JsonNode element;
+        initJsonNode(&element, node->type == INTEGER_ARRAY_NODE ? INTEGER_NODE : DOUBLE_NODE);
+        if (node->type == INTEGER_ARRAY_NODE)
+          element.value.v_int = node->value.v_integers[i];
+        else
+          element.value.v_double = node->value.v_doubles[i];
+        traverse(&element, indent + indentAdd, true);
+      }
+      else
+      {
+        traverse(&nodeList[i], indent + indentAdd, isArray);
+      }
+    }
     break;
   }
   default:
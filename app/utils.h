@@ -19,10 +19,73 @@
  * @return Puntatore all'array ridimensionato, o NULL se l'allocazione fallisce.
  *
  * @note Se `size` o `elemSize` sono zero, la funzione restituisce il puntatore originale senza alcuna modifica.
+ * @note Se la capacità attuale è già sufficiente, la funzione restituisce il puntatore originale senza riallocare.
  * @note Se la riallocazione fallisce, la memoria precedente viene liberata.
  */
 void* vec_alloc(void* vec, size_t* cap, const size_t size, const size_t elemSize);
 
+/**
+ * @brief Restituisce il numero di riallocazioni eseguite da `vec_alloc`.
+ *
+ * Il conteggio è separato per ogni thread e non viene mai azzerato: va
+ * confrontato con un valore letto in precedenza.
+ *
+ * @return Riallocazioni eseguite finora dal thread corrente.
+ */
+size_t vecReallocationCount();
+
+/**
+ * @brief Restituisce il tempo di un orologio monotono, in secondi.
+ * @return Secondi trascorsi da un istante di riferimento non specificato.
+ */
+double monotonicSeconds();
+
+/**
+ * @brief Misura una fase: restituisce i secondi trascorsi da `*clock` e lo
+ *        porta all'istante corrente, pronto per la fase successiva.
+ * @param clock Istante di inizio della fase, letto con `monotonicSeconds`.
+ * @return Durata della fase in secondi.
+ */
+double lapSeconds(double* clock);
+
+/**
+ * @struct FileBuffer
+ * @brief Contenuto di un file caricato in memoria.
+ */
+typedef struct FileBuffer
+{
+  char* data;     /**< Contenuto del file */
+  size_t length;  /**< Numero di byte del contenuto */
+  bool isMapped;  /**< Indica se il contenuto è mappato con mmap */
+} FileBuffer;
+
+/**
+ * @brief Carica in memoria il contenuto di un file.
+ *
+ * I file regolari vengono mappati in memoria con `mmap`, evitando qualsiasi
+ * copia. Per gli altri file (pipe, dispositivi, ecc.) il contenuto viene letto
+ * interamente in un buffer allocato dinamicamente.
+ *
+ * @param filename Il percorso del file da caricare.
+ * @param buffer Puntatore alla struttura da inizializzare.
+ * @return `true` se il file è stato caricato, `false` altrimenti.
+ * @warning Il buffer va rilasciato con `closeFileBuffer`.
+ */
+bool openFileBuffer(const char* filename, FileBuffer* buffer);
+
+/**
+ * @brief Rilascia il contenuto caricato da `openFileBuffer`.
+ *
+ * @param buffer Puntatore alla struttura da rilasciare.
+ */
+void closeFileBuffer(FileBuffer* buffer);
+
+/**
+ * @brief Restituisce il numero di processori disponibili.
+ * @return Numero di processori in linea, almeno 1.
+ */
+size_t countProcessors();
+
 /**
  * @file vstrdup.h
  * @brief Funzione per creare una stringa terminata con null formattata secondo specifiche.
@@ -0,0 +1,790 @@
+#include "json-parser.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <io.h>
+#define write _write
+#else
+#include <unistd.h>
+#endif
+
+#define WRITER_BUFFER_SIZE (64 * 1024)
+#define WRITER_BLOCK_SIZE 16
+
+void initJsonWriter(JsonWriter* writer)
+{
+  writer->buffer = NULL;
+  writer->capacity = 0;
+  writer->size = 0;
+  writer->file = NULL;
+  writer->fd = -1;
+  writer->failed = false;
+}
+
+void initJsonFileWriter(JsonWriter* writer, FILE* file)
+{
+  initJsonWriter(writer);
+  writer->file = file;
+  writer->buffer = (char*)malloc(WRITER_BUFFER_SIZE);
+  writer->capacity = WRITER_BUFFER_SIZE;
+}
+
+void initJsonFdWriter(JsonWriter* writer, int fd)
+{
+  initJsonWriter(writer);
+  writer->fd = fd;
+  writer->buffer = (char*)malloc(WRITER_BUFFER_SIZE);
+  writer->capacity = WRITER_BUFFER_SIZE;
+}
+
+bool flushJsonWriter(JsonWriter* writer)
+{
+  if (writer->file == NULL && writer->fd < 0)
+    return !writer->failed;
+
+  if (writer->file != NULL)
+  {
+    if (fwrite(writer->buffer, 1, writer->size, writer->file) != writer->size)
+      writer->failed = true;
+  }
+  else
+  {
+    size_t written = 0;
+    while (written < writer->size)
+    {
+      long result = (long)write(writer->fd, writer->buffer + written, (unsigned)(writer->size - written));
+      if (result <= 0)
+      {
+        writer->failed = true;
+        break;
+      }
+      written += (size_t)result;
+    }
+  }
+
+  writer->size = 0;
+  return !writer->failed;
+}
+
+void clearJsonWriter(JsonWriter* writer)
+{
+  free(writer->buffer);
+  writer->buffer = NULL;
+  writer->capacity = 0;
+  writer->size = 0;
+}
+
+/**
+ * Makes room for at least `size` more bytes. Sinks are flushed first, the
+ * in-memory buffer grows geometrically. Returns the write position.
+ */
+static char* reserve(JsonWriter* writer, size_t size)
+{
+  if (writer->capacity - writer->size >= size)
+    return writer->buffer + writer->size;
+
+  if (writer->file != NULL || writer->fd >= 0)
+  {
+    flushJsonWriter(writer);
+    if (writer->capacity >= size)
+      return writer->buffer;
+  }
+
+  size_t capacity = writer->capacity > 0 ? writer->capacity : 256;
+  while (capacity - writer->size < size)
+    capacity *= 2;
+
+  char* buffer = (char*)realloc(writer->buffer, capacity);
+  if (buffer == NULL)
+  {
+    writer->failed = true;
+    return NULL;
+  }
+
+  writer->buffer = buffer;
+  writer->capacity = capacity;
+  return writer->buffer + writer->size;
+}
+
+static void writeBytes(JsonWriter* writer, const char* bytes, size_t length)
+{
+  char* out = reserve(writer, length);
+  if (out == NULL)
+    return;
+  memcpy(out, bytes, length);
+  writer->size += length;
+}
+
+static void writeChar(JsonWriter* writer, char c)
+{
+  char* out = reserve(writer, 1);
+  if (out == NULL)
+    return;
+  *out = c;
+  writer->size++;
+}
+
+static void writeIndent(JsonWriter* writer, size_t indent)
+{
+  char* out = reserve(writer, indent + 1);
+  if (out == NULL)
+    return;
+  out[0] = '\n';
+  memset(out + 1, ' ', indent);
+  writer->size += indent + 1;
+}
+
+/**
+ * INTEGERS
+ */
+
+static const char digitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/**
+ * Writes the digits of value backwards, ending right before `end`, two at
+ * a time. Returns the position of the first digit.
+ */
+static char* formatDigits(uint64_t value, char* end)
+{
+  while (value >= 100)
+  {
+    size_t pair = (size_t)(value % 100) * 2;
+    value /= 100;
+    *--end = digitPairs[pair + 1];
+    *--end = digitPairs[pair];
+  }
+
+  if (value >= 10)
+  {
+    *--end = digitPairs[value * 2 + 1];
+    *--end = digitPairs[value * 2];
+  }
+  else
+  {
+    *--end = (char)('0' + value);
+  }
+
+  return end;
+}
+
+size_t formatJsonInteger(int64_t value, char* buffer)
+{
+  char digits[20];
+  char* end = digits + sizeof(digits);
+
+  uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+  char* start = formatDigits(magnitude, end);
+
+  size_t length = 0;
+  if (value < 0)
+    buffer[length++] = '-';
+  memcpy(buffer + length, start, end - start);
+  return length + (end - start);
+}
+
+/**
+ * DOUBLES
+ *
+ * Grisu2 (Loitsch, "Printing Floating-Point Numbers Quickly and Accurately
+ * with Integers"), with the boundaries and rounding used by nlohmann/json:
+ * the output always reads back as the same double and is the shortest one
+ * for nearly all inputs, without any big-integer arithmetic.
+ */
+
+typedef struct DiyFp
+{
+  uint64_t f;
+  int e;
+} DiyFp;
+
+typedef struct CachedPower
+{
+  uint64_t f;
+  int e;
+  int k;
+} CachedPower;
+
+#define GRISU_ALPHA -60
+#define GRISU_GAMMA -32
+#define CACHED_POWERS_MIN_DEC_EXP -300
+#define CACHED_POWERS_DEC_STEP 8
+
+/** Normalized 64-bit approximations of 10^k for k = -300, -292, ..., 324 */
+static const CachedPower cachedPowers[] = {
+    {0xAB70FE17C79AC6CAULL, -1060, -300},
+    {0xFF77B1FCBEBCDC4FULL, -1034, -292},
+    {0xBE5691EF416BD60CULL, -1007, -284},
+    {0x8DD01FAD907FFC3CULL, -980, -276},
+    {0xD3515C2831559A83ULL, -954, -268},
+    {0x9D71AC8FADA6C9B5ULL, -927, -260},
+    {0xEA9C227723EE8BCBULL, -901, -252},
+    {0xAECC49914078536DULL, -874, -244},
+    {0x823C12795DB6CE57ULL, -847, -236},
+    {0xC21094364DFB5637ULL, -821, -228},
+    {0x9096EA6F3848984FULL, -794, -220},
+    {0xD77485CB25823AC7ULL, -768, -212},
+    {0xA086CFCD97BF97F4ULL, -741, -204},
+    {0xEF340A98172AACE5ULL, -715, -196},
+    {0xB23867FB2A35B28EULL, -688, -188},
+    {0x84C8D4DFD2C63F3BULL, -661, -180},
+    {0xC5DD44271AD3CDBAULL, -635, -172},
+    {0x936B9FCEBB25C996ULL, -608, -164},
+    {0xDBAC6C247D62A584ULL, -582, -156},
+    {0xA3AB66580D5FDAF6ULL, -555, -148},
+    {0xF3E2F893DEC3F126ULL, -529, -140},
+    {0xB5B5ADA8AAFF80B8ULL, -502, -132},
+    {0x87625F056C7C4A8BULL, -475, -124},
+    {0xC9BCFF6034C13053ULL, -449, -116},
+    {0x964E858C91BA2655ULL, -422, -108},
+    {0xDFF9772470297EBDULL, -396, -100},
+    {0xA6DFBD9FB8E5B88FULL, -369, -92},
+    {0xF8A95FCF88747D94ULL, -343, -84},
+    {0xB94470938FA89BCFULL, -316, -76},
+    {0x8A08F0F8BF0F156BULL, -289, -68},
+    {0xCDB02555653131B6ULL, -263, -60},
+    {0x993FE2C6D07B7FACULL, -236, -52},
+    {0xE45C10C42A2B3B06ULL, -210, -44},
+    {0xAA242499697392D3ULL, -183, -36},
+    {0xFD87B5F28300CA0EULL, -157, -28},
+    {0xBCE5086492111AEBULL, -130, -20},
+    {0x8CBCCC096F5088CCULL, -103, -12},
+    {0xD1B71758E219652CULL, -77, -4},
+    {0x9C40000000000000ULL, -50, 4},
+    {0xE8D4A51000000000ULL, -24, 12},
+    {0xAD78EBC5AC620000ULL, 3, 20},
+    {0x813F3978F8940984ULL, 30, 28},
+    {0xC097CE7BC90715B3ULL, 56, 36},
+    {0x8F7E32CE7BEA5C70ULL, 83, 44},
+    {0xD5D238A4ABE98068ULL, 109, 52},
+    {0x9F4F2726179A2245ULL, 136, 60},
+    {0xED63A231D4C4FB27ULL, 162, 68},
+    {0xB0DE65388CC8ADA8ULL, 189, 76},
+    {0x83C7088E1AAB65DBULL, 216, 84},
+    {0xC45D1DF942711D9AULL, 242, 92},
+    {0x924D692CA61BE758ULL, 269, 100},
+    {0xDA01EE641A708DEAULL, 295, 108},
+    {0xA26DA3999AEF774AULL, 322, 116},
+    {0xF209787BB47D6B85ULL, 348, 124},
+    {0xB454E4A179DD1877ULL, 375, 132},
+    {0x865B86925B9BC5C2ULL, 402, 140},
+    {0xC83553C5C8965D3DULL, 428, 148},
+    {0x952AB45CFA97A0B3ULL, 455, 156},
+    {0xDE469FBD99A05FE3ULL, 481, 164},
+    {0xA59BC234DB398C25ULL, 508, 172},
+    {0xF6C69A72A3989F5CULL, 534, 180},
+    {0xB7DCBF5354E9BECEULL, 561, 188},
+    {0x88FCF317F22241E2ULL, 588, 196},
+    {0xCC20CE9BD35C78A5ULL, 614, 204},
+    {0x98165AF37B2153DFULL, 641, 212},
+    {0xE2A0B5DC971F303AULL, 667, 220},
+    {0xA8D9D1535CE3B396ULL, 694, 228},
+    {0xFB9B7CD9A4A7443CULL, 720, 236},
+    {0xBB764C4CA7A44410ULL, 747, 244},
+    {0x8BAB8EEFB6409C1AULL, 774, 252},
+    {0xD01FEF10A657842CULL, 800, 260},
+    {0x9B10A4E5E9913129ULL, 827, 268},
+    {0xE7109BFBA19C0C9DULL, 853, 276},
+    {0xAC2820D9623BF429ULL, 880, 284},
+    {0x80444B5E7AA7CF85ULL, 907, 292},
+    {0xBF21E44003ACDD2DULL, 933, 300},
+    {0x8E679C2F5E44FF8FULL, 960, 308},
+    {0xD433179D9C8CB841ULL, 986, 316},
+    {0x9E19DB92B4E31BA9ULL, 1013, 324},
+};
+
+static DiyFp makeDiyFp(uint64_t f, int e)
+{
+  DiyFp result;
+  result.f = f;
+  result.e = e;
+  return result;
+}
+
+static DiyFp diyFpMultiply(DiyFp x, DiyFp y)
+{
+#ifdef __SIZEOF_INT128__
+  unsigned __int128 product = (unsigned __int128)x.f * y.f;
+  uint64_t high = (uint64_t)(product >> 64);
+  uint64_t low = (uint64_t)product;
+#else
+  uint64_t xLow = (uint32_t)x.f, xHigh = x.f >> 32;
+  uint64_t yLow = (uint32_t)y.f, yHigh = y.f >> 32;
+  uint64_t lowLow = xLow * yLow;
+  uint64_t lowHigh = xLow * yHigh;
+  uint64_t highLow = xHigh * yLow;
+  uint64_t middle = (lowLow >> 32) + (uint32_t)lowHigh + (uint32_t)highLow;
+  uint64_t high = xHigh * yHigh + (lowHigh >> 32) + (highLow >> 32) + (middle >> 32);
+  uint64_t low = middle << 32;
+#endif
+  // Rounded to nearest
+  return makeDiyFp(high + (low >> 63), x.e + y.e + 64);
+}
+
+static DiyFp diyFpNormalize(DiyFp x)
+{
+  while ((x.f >> 63) == 0)
+  {
+    x.f <<= 1;
+    x.e--;
+  }
+  return x;
+}
+
+/**
+ * Splits a positive double into its value w and the boundaries m- and m+
+ * of the interval of reals that round to it, all with the exponent of m+.
+ */
+static void computeBoundaries(double value, DiyFp* w, DiyFp* minus, DiyFp* plus)
+{
+  const uint64_t hiddenBit = (uint64_t)1 << 52;
+  const int exponentBias = 1023 + 52;
+
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint64_t fraction = bits & (hiddenBit - 1);
+  int exponent = (int)(bits >> 52 & 0x7FF);
+
+  DiyFp v = exponent == 0 ? makeDiyFp(fraction, 1 - exponentBias) : makeDiyFp(fraction + hiddenBit, exponent - exponentBias);
+
+  // The lower boundary is closer when the fraction is 0 (powers of two)
+  bool lowerCloser = fraction == 0 && exponent > 1;
+  DiyFp mPlus = makeDiyFp(2 * v.f + 1, v.e - 1);
+  DiyFp mMinus = lowerCloser ? makeDiyFp(4 * v.f - 1, v.e - 2) : makeDiyFp(2 * v.f - 1, v.e - 1);
+
+  *plus = diyFpNormalize(mPlus);
+  *minus = makeDiyFp(mMinus.f << (mMinus.e - plus->e), plus->e);
+  *w = diyFpNormalize(v);
+}
+
+static CachedPower cachedPowerForExponent(int e)
+{
+  // k = ceil((alpha - e - 1) * log10(2))
+  int f = GRISU_ALPHA - e - 1;
+  int k = (f * 78913) / (1 << 18) + (f > 0);
+  int index = (-CACHED_POWERS_MIN_DEC_EXP + k + (CACHED_POWERS_DEC_STEP - 1)) / CACHED_POWERS_DEC_STEP;
+  return cachedPowers[index];
+}
+
+static int largestPow10(uint32_t n, uint32_t* pow10)
+{
+  static const uint32_t powers[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+  int digits = 10;
+  while (digits > 1 && n < powers[digits - 1])
+    digits--;
+  *pow10 = powers[digits - 1];
+  return digits;
+}
+
+static void grisuRound(char* buffer, int length, uint64_t distance, uint64_t delta, uint64_t rest, uint64_t tenK)
+{
+  // Moves the last digit towards w while it stays inside the interval
+  while (rest < distance && delta - rest >= tenK && (rest + tenK < distance || distance - rest > rest + tenK - distance))
+  {
+    buffer[length - 1]--;
+    rest += tenK;
+  }
+}
+
+static void grisuDigits(char* buffer, int* length, int* decimalExponent, DiyFp mMinus, DiyFp w, DiyFp mPlus)
+{
+  uint64_t delta = mPlus.f - mMinus.f;
+  uint64_t distance = mPlus.f - w.f;
+
+  DiyFp one = makeDiyFp((uint64_t)1 << -mPlus.e, mPlus.e);
+  uint32_t p1 = (uint32_t)(mPlus.f >> -one.e);
+  uint64_t p2 = mPlus.f & (one.f - 1);
+
+  uint32_t pow10;
+  int n = largestPow10(p1, &pow10);
+
+  // Integral part
+  while (n > 0)
+  {
+    uint32_t digit = p1 / pow10;
+    p1 %= pow10;
+    buffer[(*length)++] = (char)('0' + digit);
+    n--;
+
+    uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+    if (rest <= delta)
+    {
+      *decimalExponent += n;
+      grisuRound(buffer, *length, distance, delta, rest, (uint64_t)pow10 << -one.e);
+      return;
+    }
+    pow10 /= 10;
+  }
+
+  // Fractional part
+  int m = 0;
+  while (true)
+  {
+    p2 *= 10;
+    buffer[(*length)++] = (char)('0' + (p2 >> -one.e));
+    p2 &= one.f - 1;
+    m++;
+
+    delta *= 10;
+    distance *= 10;
+    if (p2 <= delta)
+      break;
+  }
+
+  *decimalExponent -= m;
+  grisuRound(buffer, *length, distance, delta, p2, one.f);
+}
+
+/**
+ * Writes the shortest digits of a positive finite double: value is
+ * digits * 10^decimalExponent.
+ */
+static int grisu2(double value, char* digits, int* decimalExponent)
+{
+  DiyFp w, mMinus, mPlus;
+  computeBoundaries(value, &w, &mMinus, &mPlus);
+
+  CachedPower cached = cachedPowerForExponent(mPlus.e);
+  DiyFp c = makeDiyFp(cached.f, cached.e);
+
+  DiyFp scaledW = diyFpMultiply(w, c);
+  DiyFp scaledMinus = diyFpMultiply(mMinus, c);
+  DiyFp scaledPlus = diyFpMultiply(mPlus, c);
+
+  // Shrinks the interval by one unit on both sides to stay inside it
+  // despite the rounding of the multiplications
+  scaledMinus.f++;
+  scaledPlus.f--;
+
+  int length = 0;
+  *decimalExponent = -cached.k;
+  grisuDigits(digits, &length, decimalExponent, scaledMinus, scaledW, scaledPlus);
+  return length;
+}
+
+size_t formatJsonDouble(double value, char* buffer)
+{
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  // NaN and infinity have no JSON representation
+  if ((bits >> 52 & 0x7FF) == 0x7FF)
+  {
+    memcpy(buffer, "null", 4);
+    return 4;
+  }
+
+  size_t length = 0;
+  if (bits >> 63)
+  {
+    buffer[length++] = '-';
+    value = -value;
+  }
+
+  if (value == 0)
+  {
+    memcpy(buffer + length, "0.0", 3);
+    return length + 3;
+  }
+
+  char digits[18];
+  int decimalExponent;
+  int k = grisu2(value, digits, &decimalExponent);
+  // Position of the decimal point relative to the first digit
+  int n = k + decimalExponent;
+  char* out = buffer + length;
+
+  if (k <= n && n <= 15)
+  {
+    // 1234e2 -> 123400.0, the ".0" keeps it a double when read back
+    memcpy(out, digits, k);
+    memset(out + k, '0', n - k);
+    out[n] = '.';
+    out[n + 1] = '0';
+    return length + n + 2;
+  }
+
+  if (0 < n && n <= 15)
+  {
+    // 1234e-2 -> 12.34
+    memcpy(out, digits, n);
+    out[n] = '.';
+    memcpy(out + n + 1, digits + n, k - n);
+    return length + k + 1;
+  }
+
+  if (-4 < n && n <= 0)
+  {
+    // 1234e-6 -> 0.001234
+    out[0] = '0';
+    out[1] = '.';
+    memset(out + 2, '0', -n);
+    memcpy(out + 2 - n, digits, k);
+    return length + 2 - n + k;
+  }
+
+  // d.ddde+-xx
+  size_t pos = 0;
+  out[pos++] = digits[0];
+  if (k > 1)
+  {
+    out[pos++] = '.';
+    memcpy(out + pos, digits + 1, k - 1);
+    pos += k - 1;
+  }
+
+  out[pos++] = 'e';
+  int exponent = n - 1;
+  if (exponent < 0)
+  {
+    out[pos++] = '-';
+    exponent = -exponent;
+  }
+  else
+  {
+    out[pos++] = '+';
+  }
+  pos += formatJsonInteger(exponent, out + pos);
+
+  return length + pos;
+}
+
+/**
+ * STRINGS
+ */
+
+static const char hexDigits[] = "0123456789abcdef";
+
+/**
+ * Returns the length of the leading run of bytes that need no escaping.
+ */
+static size_t plainRunLength(const char* str, size_t length)
+{
+  size_t pos = 0;
+
+#ifdef __SSE2__
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  // Bytes below 0x20 are the only ones below 0x20 once 0x80 is flipped
+  const __m128i flip = _mm_set1_epi8((char)0x80);
+  const __m128i limit = _mm_set1_epi8((char)(0x20 ^ 0x80));
+
+  while (length - pos >= WRITER_BLOCK_SIZE)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)(str + pos));
+    __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                                   _mm_cmplt_epi8(_mm_xor_si128(v, flip), limit));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(special);
+    if (mask != 0)
+      return pos + __builtin_ctz(mask);
+    pos += WRITER_BLOCK_SIZE;
+  }
+#endif
+
+  while (pos < length)
+  {
+    unsigned char c = (unsigned char)str[pos];
+    if (c == '"' || c == '\\' || c < 0x20)
+      break;
+    pos++;
+  }
+
+  return pos;
+}
+
+static void writeString(JsonWriter* writer, const char* str)
+{
+  size_t length = strlen(str);
+
+  // Worst case: every byte becomes \u00XX
+  char* out = reserve(writer, length * 6 + 2);
+  if (out == NULL)
+    return;
+
+  char* start = out;
+  *out++ = '"';
+
+  size_t pos = 0;
+  while (true)
+  {
+    size_t run = plainRunLength(str + pos, length - pos);
+    memcpy(out, str + pos, run);
+    out += run;
+    pos += run;
+
+    if (pos == length)
+      break;
+
+    unsigned char c = (unsigned char)str[pos++];
+    *out++ = '\\';
+    switch (c)
+    {
+    case '"':
+      *out++ = '"';
+      break;
+    case '\\':
+      *out++ = '\\';
+      break;
+    case '\b':
+      *out++ = 'b';
+      break;
+    case '\f':
+      *out++ = 'f';
+      break;
+    case '\n':
+      *out++ = 'n';
+      break;
+    case '\r':
+      *out++ = 'r';
+      break;
+    case '\t':
+      *out++ = 't';
+      break;
+    default:
+      memcpy(out, "u00", 3);
+      out[3] = hexDigits[c >> 4];
+      out[4] = hexDigits[c & 0xF];
+      out += 5;
+      break;
+    }
+  }
+
+  *out++ = '"';
+  writer->size += out - start;
+}
+
+/**
+ * TREE
+ */
+
+static void writeNode(JsonWriter* writer, const JsonNode* node, size_t indent, size_t depth)
+{
+  switch (node->type)
+  {
+  case NULL_NODE:
+    writeBytes(writer, "null", 4);
+    break;
+  case BOOLEAN_NODE:
+    if (node->value.v_bool)
+      writeBytes(writer, "true", 4);
+    else
+      writeBytes(writer, "false", 5);
+    break;
+  case INTEGER_NODE:
+  {
+    char* out = reserve(writer, JSON_NUMBER_MAX_LENGTH);
+    if (out != NULL)
+      writer->size += formatJsonInteger(node->value.v_int, out);
+    break;
+  }
+  case DOUBLE_NODE:
+  {
+    char* out = reserve(writer, JSON_NUMBER_MAX_LENGTH);
+    if (out != NULL)
+      writer->size += formatJsonDouble(node->value.v_double, out);
+    break;
+  }
+  case STRING_NODE:
+  {
+    const char* str = jsonNodeString(node);
+    writeString(writer, str != NULL ? str : "");
+    break;
+  }
+  case INTEGER_ARRAY_NODE:
+  case DOUBLE_ARRAY_NODE:
+  {
+    writeChar(writer, '[');
+
+    for (size_t i = 0; i < node->vSize; i++)
+    {
+      if (i > 0)
+        writeChar(writer, ',');
+      if (indent > 0)
+        writeIndent(writer, (depth + 1) * indent);
+
+      char* out = reserve(writer, JSON_NUMBER_MAX_LENGTH);
+      if (out == NULL)
+        continue;
+      if (node->type == INTEGER_ARRAY_NODE)
+        writer->size += formatJsonInteger(node->value.v_integers[i], out);
+      else
+        writer->size += formatJsonDouble(node->value.v_doubles[i], out);
+    }
+
+    if (indent > 0 && node->vSize > 0)
+      writeIndent(writer, depth * indent);
+    writeChar(writer, ']');
+    break;
+  }
+  case OBJECT_NODE:
+  case ARRAY_NODE:
+  {
+    bool isObject = node->type == OBJECT_NODE;
+    writeChar(writer, isObject ? '{' : '[');
+
+    for (size_t i = 0; i < node->vSize; i++)
+    {
+      const JsonNode* child = &node->value.v_object[i];
+      if (i > 0)
+        writeChar(writer, ',');
+      if (indent > 0)
+        writeIndent(writer, (depth + 1) * indent);
+
+      if (isObject)
+      {
+        writeString(writer, child->key != NULL ? child->key : "");
+        if (indent > 0)
+          writeBytes(writer, ": ", 2);
+        else
+          writeChar(writer, ':');
+      }
+
+      writeNode(writer, child, indent, depth + 1);
+    }
+
+    if (indent > 0 && node->vSize > 0)
+      writeIndent(writer, depth * indent);
+    writeChar(writer, isObject ? '}' : ']');
+    break;
+  }
+  }
+}
+
+bool writeJson(JsonWriter* writer, const JsonNode* node, size_t indent)
+{
+  writeNode(writer, node, indent, 0);
+  return !writer->failed;
+}
+
+char* serializeJson(const JsonNode* node, size_t indent, size_t* length)
+{
+  JsonWriter writer;
+  initJsonWriter(&writer);
+
+  writeJson(&writer, node, indent);
+  writeChar(&writer, '\0');
+
+  if (writer.failed)
+  {
+    clearJsonWriter(&writer);
+    return NULL;
+  }
+
+  if (length != NULL)
+    *length = writer.size - 1;
+  return writer.buffer;
+}
@@ -0,0 +1,624 @@
+/**
+ * Benchmark del parser JSON
+ *
+ * Genera localmente dei corpora rappresentativi (oggetti simili a twitter,
+ * array di numeri simili a canada, cataloghi annidati simili a citm,
+ * documenti molto annidati e documenti con stringhe lunghe) in diverse
+ * dimensioni e misura separatamente le fasi `lex`, `parse`, `freeJsonTree`
+ * e l'analisi completa con `parseJsonFile`.
+ *
+ * Per ogni corpus e fase riporta MB/s, ns per token, numero di allocazioni
+ * e picco di memoria residente, in formato CSV (predefinito) o JSON, così
+ * che i risultati di esecuzioni diverse possano essere confrontati.
+ *
+ * Si compila insieme ai sorgenti di `app` con il task "C/C++: gcc build
+ * bench", che aggiunge `-O2`, `-DBENCH_COUNT_ALLOCATIONS` e le opzioni del
+ * linker `-Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free`.
+ *
+ * Senza `BENCH_COUNT_ALLOCATIONS` (e le opzioni `--wrap` del linker) le
+ * allocazioni non vengono contate e la colonna vale -1.
+ *
+ * Utilizzo:
+ *   bench.exe [-f csv|json] [-s small|medium|large|all] [-r ripetizioni]
+ *             [-c corpus] [-d cartella]
+ */
+
+#include "../app/json-parser.h"
+#include "../app/utils.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/resource.h>
+#include <sys/stat.h>
+#endif
+
+#define BENCH_DEFAULT_REPEAT 5
+#define BENCH_DEFAULT_DIR "bench-data"
+
+// Nesting of each element of the deep corpus
+#define BENCH_DEEP_DEPTH 256
+
+/**
+ * ALLOCATION COUNTING
+ */
+
+#ifdef BENCH_COUNT_ALLOCATIONS
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+  void* __real_malloc(size_t size);
+  void* __real_calloc(size_t count, size_t size);
+  void* __real_realloc(void* ptr, size_t size);
+  void __real_free(void* ptr);
+
+  // Only the calls made by the parser and by this file are counted, the
+  // ones made inside the C library are not wrapped by the linker
+  static size_t allocations = 0;
+
+  void* __wrap_malloc(size_t size)
+  {
+    allocations++;
+    return __real_malloc(size);
+  }
+
+  void* __wrap_calloc(size_t count, size_t size)
+  {
+    allocations++;
+    return __real_calloc(count, size);
+  }
+
+  void* __wrap_realloc(void* ptr, size_t size)
+  {
+    allocations++;
+    return __real_realloc(ptr, size);
+  }
+
+  void __wrap_free(void* ptr)
+  {
+    __real_free(ptr);
+  }
+#ifdef __cplusplus
+}
+#endif
+
+static long long countAllocations()
+{
+  return (long long)allocations;
+}
+#else
+static long long countAllocations()
+{
+  return -1;
+}
+#endif
+
+static long long allocationsSince(long long start)
+{
+  return start < 0 ? -1 : countAllocations() - start;
+}
+
+/**
+ * MEASUREMENTS
+ */
+
+static double now()
+{
+  struct timespec time;
+  timespec_get(&time, TIME_UTC);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/**
+ * Resets the peak resident set size of the process where the kernel allows
+ * it (Linux), so that every stage reports its own peak.
+ */
+static void resetPeakRss()
+{
+  FILE* file = fopen("/proc/self/clear_refs", "w");
+  if (file == NULL)
+    return;
+  fputs("5", file);
+  fclose(file);
+}
+
+static long peakRssKb()
+{
+  FILE* file = fopen("/proc/self/status", "r");
+  if (file != NULL)
+  {
+    char line[256];
+    long peak = -1;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+      if (strncmp(line, "VmHWM:", 6) == 0)
+      {
+        peak = strtol(line + 6, NULL, 10);
+        break;
+      }
+    }
+    fclose(file);
+    if (peak >= 0)
+      return peak;
+  }
+
+#ifndef _WIN32
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    return usage.ru_maxrss;
+#endif
+  return -1;
+}
+
+/**
+ * CORPORA
+ */
+
+typedef struct BenchBuffer
+{
+  char* data;
+  size_t length;
+  size_t capacity;
+} BenchBuffer;
+
+static void appendf(BenchBuffer* buffer, const char* fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  int length = vsnprintf(NULL, 0, fmt, args);
+  va_end(args);
+
+  buffer->data = (char*)vec_alloc(buffer->data, &buffer->capacity, buffer->length + length + 1, 1);
+
+  va_start(args, fmt);
+  vsnprintf(buffer->data + buffer->length, length + 1, fmt, args);
+  va_end(args);
+  buffer->length += length;
+}
+
+// xorshift64*, the corpora must be the same on every run
+static uint64_t randomState;
+
+static uint64_t nextRandom()
+{
+  randomState ^= randomState >> 12;
+  randomState ^= randomState << 25;
+  randomState ^= randomState >> 27;
+  return randomState * 0x2545F4914F6CDD1DULL;
+}
+
+static size_t randomBelow(size_t bound)
+{
+  return (size_t)(nextRandom() % bound);
+}
+
+static double randomDouble(double min, double max)
+{
+  return min + (max - min) * (double)(nextRandom() >> 11) / (double)(1ULL << 53);
+}
+
+static const char* const words[] = {
+  "json", "parser", "fast", "caf\\u00e9", "na\\u00efve", "\xe6\x97\xa5\xe6\x9c\xac", "stream", "token",
+  "arena", "\\\"quoted\\\"", "tab\\tbed", "line\\nbreak", "emoji \\ud83d\\ude00", "\xc3\xbc" "ber", "bench", "data"};
+
+#define WORD_COUNT (sizeof(words) / sizeof(words[0]))
+
+static void appendText(BenchBuffer* buffer, size_t wordCount)
+{
+  for (size_t i = 0; i < wordCount; i++)
+    appendf(buffer, i > 0 ? " %s" : "%s", words[randomBelow(WORD_COUNT)]);
+}
+
+static void generateTwitter(BenchBuffer* buffer, size_t target)
+{
+  appendf(buffer, "{\"statuses\": [");
+  for (size_t i = 0; buffer->length < target; i++)
+  {
+    uint64_t id = 500000000000000000ULL + nextRandom() % 100000000000000000ULL;
+    appendf(buffer, "%s\n  {\"created_at\": \"Sun Aug 31 00:%02d:%02d +0000 2014\", \"id\": %llu, \"id_str\": \"%llu\", \"text\": \"",
+            i > 0 ? "," : "", (int)randomBelow(60), (int)randomBelow(60), (unsigned long long)id, (unsigned long long)id);
+    appendText(buffer, 5 + randomBelow(15));
+    appendf(buffer, "\", \"truncated\": false, \"entities\": {\"hashtags\": [");
+    size_t hashtags = randomBelow(3);
+    for (size_t j = 0; j < hashtags; j++)
+      appendf(buffer, "%s{\"text\": \"%s\", \"indices\": [%d, %d]}", j > 0 ? ", " : "", words[randomBelow(WORD_COUNT)], (int)j * 10, (int)j * 10 + 8);
+    appendf(buffer, "], \"urls\": []}, \"user\": {\"id\": %llu, \"name\": \"user_%zu\", \"screen_name\": \"", (unsigned long long)(nextRandom() % 4000000000ULL), i);
+    appendText(buffer, 1 + randomBelow(2));
+    appendf(buffer, "\", \"followers_count\": %d, \"verified\": %s, \"profile_image_url\": \"http://pbs.twimg.com/profile_images/%zu/normal.jpeg\"},"
+                    " \"geo\": null, \"retweet_count\": %d, \"favorite_count\": %d, \"favorited\": false, \"lang\": \"%s\"}",
+            (int)randomBelow(100000), randomBelow(10) == 0 ? "true" : "false", i, (int)randomBelow(1000), (int)randomBelow(1000), randomBelow(2) ? "en" : "ja");
+  }
+  appendf(buffer, "\n], \"search_metadata\": {\"completed_in\": 0.087, \"max_id\": 505874924095815681, \"count\": 100}}\n");
+}
+
+static void generateCanada(BenchBuffer* buffer, size_t target)
+{
+  appendf(buffer, "{\"type\": \"FeatureCollection\", \"features\": [{\"type\": \"Feature\", \"properties\": {\"name\": \"Canada\"}, "
+                  "\"geometry\": {\"type\": \"Polygon\", \"coordinates\": [");
+  for (size_t ring = 0; buffer->length < target; ring++)
+  {
+    appendf(buffer, "%s[", ring > 0 ? "," : "");
+    size_t points = 50 + randomBelow(500);
+    for (size_t i = 0; i < points; i++)
+      appendf(buffer, "%s[%.15f,%.15f]", i > 0 ? "," : "", randomDouble(-141.0, -52.0), randomDouble(41.0, 83.0));
+    appendf(buffer, "]\n");
+  }
+  appendf(buffer, "]}}]}\n");
+}
+
+static void generateCitm(BenchBuffer* buffer, size_t target)
+{
+  // Events take about half of the document, performances the rest
+  appendf(buffer, "{\"areaNames\": {\"205705993\": \"Arri\\u00e8re-sc\\u00e8ne central\", \"205705994\": \"1er balcon central\"},\n\"events\": {");
+  for (size_t i = 0; buffer->length < target / 2; i++)
+  {
+    size_t id = 138586341 + i * 4;
+    appendf(buffer, "%s\n  \"%zu\": {\"description\": null, \"id\": %zu, \"logo\": %s, \"name\": \"", i > 0 ? "," : "", id, id,
+            randomBelow(2) ? "null" : "\"/images/UE0AAAAACEKo6QAAAAZDSVRN\"");
+    appendText(buffer, 2 + randomBelow(4));
+    appendf(buffer, "\", \"subTitle\": null, \"subjectCode\": null, \"subtopicIds\": [337184%03d, 337184%03d], \"topicIds\": [324846099, 107888604]}",
+            (int)randomBelow(1000), (int)randomBelow(1000));
+  }
+  appendf(buffer, "\n},\n\"performances\": [");
+  for (size_t i = 0; buffer->length < target; i++)
+  {
+    appendf(buffer, "%s\n  {\"eventId\": %zu, \"id\": %zu, \"logo\": null, \"name\": null, \"prices\": [", i > 0 ? "," : "", 138586341 + i * 4, 339887544 + i);
+    size_t prices = 1 + randomBelow(4);
+    for (size_t j = 0; j < prices; j++)
+      appendf(buffer, "%s{\"amount\": %d, \"audienceSubCategoryId\": 337100890, \"seatCategoryId\": %zu}", j > 0 ? ", " : "", 9000 + (int)randomBelow(90000), 338937295 + j);
+    appendf(buffer, "], \"seatCategories\": [");
+    for (size_t j = 0; j < prices; j++)
+    {
+      appendf(buffer, "%s{\"areas\": [", j > 0 ? ", " : "");
+      size_t areas = 1 + randomBelow(6);
+      for (size_t k = 0; k < areas; k++)
+        appendf(buffer, "%s{\"areaId\": %zu, \"blockIds\": []}", k > 0 ? ", " : "", 205705993 + k);
+      appendf(buffer, "], \"seatCategoryId\": %zu}", 338937295 + j);
+    }
+    appendf(buffer, "], \"seatMapImage\": null, \"start\": %llu, \"venueCode\": \"PLEYEL_PLEYEL\"}", 1372616400000ULL + (unsigned long long)i * 86400000ULL);
+  }
+  appendf(buffer, "\n]}\n");
+}
+
+static void generateDeep(BenchBuffer* buffer, size_t target)
+{
+  appendf(buffer, "[");
+  for (size_t i = 0; buffer->length < target; i++)
+  {
+    appendf(buffer, "%s\n", i > 0 ? "," : "");
+    for (size_t depth = 0; depth < BENCH_DEEP_DEPTH; depth++)
+      appendf(buffer, depth % 2 == 0 ? "{\"k%zu\":" : "[%zu,", depth);
+    appendf(buffer, "%zu", i);
+    for (size_t depth = BENCH_DEEP_DEPTH; depth > 0; depth--)
+      appendf(buffer, "%c", depth % 2 == 1 ? '}' : ']');
+  }
+  appendf(buffer, "\n]\n");
+}
+
+static void generateStrings(BenchBuffer* buffer, size_t target)
+{
+  appendf(buffer, "[");
+  for (size_t i = 0; buffer->length < target; i++)
+  {
+    appendf(buffer, "%s\n\"", i > 0 ? "," : "");
+    size_t length = 1024 + randomBelow(7 * 1024);
+    size_t start = buffer->length;
+    while (buffer->length - start < length)
+    {
+      // Mostly plain text, escapes and raw UTF-8 here and there
+      if (randomBelow(8) == 0)
+        appendf(buffer, "%s ", words[randomBelow(WORD_COUNT)]);
+      else
+        appendf(buffer, "Lorem ipsum dolor sit amet, consectetur adipiscing elit. ");
+    }
+    appendf(buffer, "\"");
+  }
+  appendf(buffer, "\n]\n");
+}
+
+typedef struct BenchCorpus
+{
+  const char* name;
+  void (*generate)(BenchBuffer* buffer, size_t target);
+} BenchCorpus;
+
+static const BenchCorpus corpora[] = {
+  {"twitter", generateTwitter},
+  {"canada", generateCanada},
+  {"citm", generateCitm},
+  {"deep", generateDeep},
+  {"strings", generateStrings},
+};
+
+typedef struct BenchSize
+{
+  const char* name;
+  size_t bytes;
+} BenchSize;
+
+static const BenchSize sizes[] = {
+  {"small", 64 * 1024},
+  {"medium", 1024 * 1024},
+  {"large", 16 * 1024 * 1024},
+};
+
+#define CORPUS_COUNT (sizeof(corpora) / sizeof(corpora[0]))
+#define SIZE_COUNT (sizeof(sizes) / sizeof(sizes[0]))
+
+/**
+ * STAGES
+ */
+
+typedef struct BenchResult
+{
+  const char* corpus;
+  const char* size;
+  const char* stage;
+  size_t bytes;
+  size_t tokens;
+  double seconds; // Best of the repetitions
+  long long allocations;
+  long peakRss;
+} BenchResult;
+
+typedef struct BenchReport
+{
+  bool json;
+  size_t count;
+} BenchReport;
+
+static void report(BenchReport* output, const BenchResult* result)
+{
+  double mbPerSecond = result->bytes / 1e6 / result->seconds;
+  double nsPerToken = result->tokens > 0 ? result->seconds * 1e9 / result->tokens : 0;
+
+  if (output->json)
+  {
+    printf("%s\n  {\"corpus\": \"%s\", \"size\": \"%s\", \"stage\": \"%s\", \"bytes\": %zu, \"tokens\": %zu, \"seconds\": %.6f, "
+           "\"mb_per_s\": %.2f, \"ns_per_token\": %.2f, \"allocations\": %lld, \"peak_rss_kb\": %ld}",
+           output->count > 0 ? "," : "", result->corpus, result->size, result->stage, result->bytes, result->tokens,
+           result->seconds, mbPerSecond, nsPerToken, result->allocations, result->peakRss);
+  }
+  else
+  {
+    printf("%s,%s,%s,%zu,%zu,%.6f,%.2f,%.2f,%lld,%ld\n", result->corpus, result->size, result->stage, result->bytes,
+           result->tokens, result->seconds, mbPerSecond, nsPerToken, result->allocations, result->peakRss);
+  }
+  output->count++;
+  fflush(stdout);
+}
+
+/**
+ * Times every stage of one corpus, each one repeated and reported with its
+ * best time. Allocations and peak RSS are the ones of the last repetition.
+ */
+static bool benchCorpus(BenchReport* output, const char* corpus, const char* size, const BenchBuffer* buffer, const char* path, size_t repeat)
+{
+  BenchResult lexResult = {corpus, size, "lex", buffer->length, 0, 0, 0, 0};
+  BenchResult parseResult = {corpus, size, "parse", buffer->length, 0, 0, 0, 0};
+  BenchResult freeResult = {corpus, size, "free", buffer->length, 0, 0, countAllocations() < 0 ? -1 : 0, 0};
+  BenchResult fileResult = {corpus, size, "parse_file", buffer->length, 0, 0, 0, 0};
+  BenchResult reuseResult = {corpus, size, "parse_reuse", buffer->length, 0, 0, 0, 0};
+  TokenManager* manager = NULL;
+
+  for (size_t i = 0; i < repeat; i++)
+  {
+    if (manager != NULL)
+      deleteTokenManager(manager);
+    resetPeakRss();
+    long long allocations = countAllocations();
+
+    LexError lexError;
+    double start = now();
+    manager = lex(buffer->data, buffer->length, &lexError);
+    double seconds = now() - start;
+
+    lexResult.allocations = allocationsSince(allocations);
+    lexResult.peakRss = peakRssKb();
+    if (lexError.type != NO_LEX_ERROR)
+    {
+      char* strError = buildLexStringError(&lexError);
+      fprintf(stderr, "%s/%s: %s", corpus, size, strError);
+      free(strError);
+      deleteTokenManager(manager);
+      return false;
+    }
+    if (i == 0 || seconds < lexResult.seconds)
+      lexResult.seconds = seconds;
+  }
+
+  lexResult.tokens = parseResult.tokens = freeResult.tokens = fileResult.tokens = reuseResult.tokens = manager->size;
+
+  for (size_t i = 0; i < repeat; i++)
+  {
+    resetPeakRss();
+    long long allocations = countAllocations();
+
+    ParseContext context;
+    ParserError parserError;
+    manager->pos = 0;
+    initParseContext(&context, buffer->data, manager, NULL);
+    double start = now();
+    JsonNode* root = parse(&context, &parserError);
+    double seconds = now() - start;
+    clearParseContext(&context);
+
+    parseResult.allocations = allocationsSince(allocations);
+    parseResult.peakRss = peakRssKb();
+    if (parserError.type != NO_PARSER_ERROR)
+    {
+      char* strError = buildParseStringError(&parserError);
+      fprintf(stderr, "%s/%s: %s", corpus, size, strError);
+      free(strError);
+      freeJsonTree(root);
+      deleteTokenManager(manager);
+      return false;
+    }
+    if (i == 0 || seconds < parseResult.seconds)
+      parseResult.seconds = seconds;
+
+    start = now();
+    freeJsonTree(root);
+    seconds = now() - start;
+    freeResult.peakRss = parseResult.peakRss;
+    if (i == 0 || seconds < freeResult.seconds)
+      freeResult.seconds = seconds;
+  }
+  deleteTokenManager(manager);
+
+  for (size_t i = 0; i < repeat; i++)
+  {
+    resetPeakRss();
+    long long allocations = countAllocations();
+
+    char* strError = NULL;
+    double start = now();
+    JsonNode* root = parseJsonFile(path, &strError);
+    double seconds = now() - start;
+
+    fileResult.allocations = allocationsSince(allocations);
+    fileResult.peakRss = peakRssKb();
+    if (root == NULL)
+    {
+      fprintf(stderr, "%s/%s: %s\n", corpus, size, strError);
+      free(strError);
+      return false;
+    }
+    freeJsonTree(root);
+    if (i == 0 || seconds < fileResult.seconds)
+      fileResult.seconds = seconds;
+  }
+
+  // The first parse sizes the buffers of the parser, the repetitions
+  // measure the steady state in which they are reused
+  JsonParser* parser = createJsonParser(NULL, 0);
+  parseJsonBufferWithParser(parser, buffer->data, buffer->length, NULL);
+  for (size_t i = 0; i < repeat; i++)
+  {
+    resetPeakRss();
+    long long allocations = countAllocations();
+
+    double start = now();
+    parseJsonBufferWithParser(parser, buffer->data, buffer->length, NULL);
+    double seconds = now() - start;
+
+    reuseResult.allocations = allocationsSince(allocations);
+    reuseResult.peakRss = peakRssKb();
+    if (i == 0 || seconds < reuseResult.seconds)
+      reuseResult.seconds = seconds;
+  }
+  deleteJsonParser(parser);
+
+  report(output, &lexResult);
+  report(output, &parseResult);
+  report(output, &freeResult);
+  report(output, &fileResult);
+  report(output, &reuseResult);
+  return true;
+}
+
+static bool writeCorpus(const char* path, const BenchBuffer* buffer)
+{
+  FILE* file = fopen(path, "wb");
+  if (file == NULL)
+    return false;
+  bool written = fwrite(buffer->data, 1, buffer->length, file) == buffer->length;
+  return fclose(file) == 0 && written;
+}
+
+static void printUsage(const char* program)
+{
+  fprintf(stderr, "Usage: %s [-f csv|json] [-s small|medium|large|all] [-r repeat] [-c corpus] [-d dir]\n", program);
+}
+
+int main(int argc, char** argv)
+{
+  BenchReport output = {false, 0};
+  const char* sizeName = "all";
+  const char* corpusName = NULL;
+  const char* dir = BENCH_DEFAULT_DIR;
+  size_t repeat = BENCH_DEFAULT_REPEAT;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (i + 1 >= argc)
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+
+    const char* value = argv[++i];
+    if (strcmp(argv[i - 1], "-f") == 0)
+      output.json = strcmp(value, "json") == 0;
+    else if (strcmp(argv[i - 1], "-s") == 0)
+      sizeName = value;
+    else if (strcmp(argv[i - 1], "-r") == 0)
+      repeat = (size_t)strtoul(value, NULL, 10);
+    else if (strcmp(argv[i - 1], "-c") == 0)
+      corpusName = value;
+    else if (strcmp(argv[i - 1], "-d") == 0)
+      dir = value;
+    else
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (repeat == 0)
+    repeat = 1;
+
+  // Corpora are written next to each other, an existing directory is fine
+#ifdef _WIN32
+  _mkdir(dir);
+#else
+  mkdir(dir, 0755);
+#endif
+
+  if (output.json)
+    printf("[");
+  else
+    printf("corpus,size,stage,bytes,tokens,seconds,mb_per_s,ns_per_token,allocations,peak_rss_kb\n");
+
+  bool success = true;
+  for (size_t s = 0; s < SIZE_COUNT; s++)
+  {
+    if (strcmp(sizeName, "all") != 0 && strcmp(sizeName, sizes[s].name) != 0)
+      continue;
+
+    for (size_t c = 0; c < CORPUS_COUNT; c++)
+    {
+      if (corpusName != NULL && strcmp(corpusName, corpora[c].name) != 0)
+        continue;
+
+      BenchBuffer buffer = {NULL, 0, 0};
+      randomState = 0x9E3779B97F4A7C15ULL + c;
+      corpora[c].generate(&buffer, sizes[s].bytes);
+
+      // The end-to-end stage reads the corpus back from a file
+      char* path = vstrdup("%s/%s-%s.json", dir, corpora[c].name, sizes[s].name);
+      if (!writeCorpus(path, &buffer))
+      {
+        fprintf(stderr, "Error: Cannot write file '%s'\n", path);
+        success = false;
+      }
+      else if (!benchCorpus(&output, corpora[c].name, sizes[s].name, &buffer, path, repeat))
+      {
+        success = false;
+      }
+
+      free(path);
+      free(buffer.data);
+    }
+  }
+
+  if (output.json)
+    printf("\n]\n");
+  return success ? 0 : 1;
+}